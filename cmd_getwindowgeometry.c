@@ -2,24 +2,27 @@
 
 int cmd_getwindowgeometry(context_t *context) {
   char *cmd = context->argv[0];
-  int x, y;
-  Screen *screen;
-  unsigned int width, height;
+  int ret = EXIT_SUCCESS;
+  int i;
 
   int shell_output = False;
   char out_prefix[17] = {'\0'};
+  int output = -1;
 
   int c;
   static struct option longopts[] = {
     { "help", no_argument, NULL, 'h' },
     { "shell", no_argument, NULL, 's' },
     { "prefix", required_argument, NULL, 'p' },
+    { "format", required_argument, NULL, 'f' },
     { 0, 0, 0, 0 },
   };
-  static const char *usage = 
-    "Usage: %s [window=%1] [--shell] [--prefix <STR>]\n"
+  static const char *usage =
+    "Usage: %s [window=%1] [--shell] [--prefix <STR>] [--format <FORMAT>]\n"
     "--shell      - output shell variables for use with eval\n"
     "--prefix STR - use prefix for shell variables names (max 16 chars) \n"
+    "--format FMT - output one record per window; FMT is 'tsv', 'json'\n"
+    "               or 'nul'. Default is the global --output mode\n"
     HELP_SEE_WINDOW_STACK;
   int option_index;
 
@@ -38,6 +41,14 @@ int cmd_getwindowgeometry(context_t *context) {
         strncpy(out_prefix, optarg, sizeof(out_prefix)-1);
         out_prefix[ sizeof(out_prefix)-1 ] = '\0'; //just in case
         break;
+      case 'f':
+        output = xdotool_output_parse(optarg);
+        if (output < 0) {
+          fprintf(stderr, "Invalid format '%s'\n", optarg);
+          fprintf(stderr, usage, cmd);
+          return EXIT_FAILURE;
+        }
+        break;
       default:
         fprintf(stderr, usage, cmd);
         return EXIT_FAILURE;
@@ -46,38 +57,65 @@ int cmd_getwindowgeometry(context_t *context) {
 
   consume_args(context, optind);
 
+  /* An explicit --shell wins over the global --output mode */
+  if (output < 0) {
+    output = shell_output ? OUTPUT_TEXT : context->output;
+  }
+
   const char *window_arg = "%1";
   if (!window_get_arg(context, 0, 0, &window_arg)) {
     fprintf(stderr, usage, cmd);
     return EXIT_FAILURE;
   }
 
-  window_each(context, window_arg, {
-    int ret = 0;
-    ret = xdo_get_window_size(context->xdo, window, &width, &height);
-    if (ret != XDO_SUCCESS) {
-      fprintf(stderr, "window %ld - failed to get height/width?\n", window);
-    }
+  /* Query every window in one go rather than a few round trips per window. */
+  Window *windows;
+  int nwindows;
+  xdo_window_geometry_t *geometry;
 
-    ret = xdo_get_window_location(context->xdo, window, &x, &y, &screen);
-    if (ret != XDO_SUCCESS) {
-      fprintf(stderr, "window %ld - failed to get location?\n", window);
+  window_list(context, window_arg, &windows, &nwindows, False);
+  if (nwindows == 0) {
+    return EXIT_SUCCESS;
+  }
+  geometry = calloc(nwindows, sizeof(xdo_window_geometry_t));
+  xdo_get_windows_geometry(context->xdo, windows, nwindows, geometry);
+
+  for (i = 0; i < nwindows; i++) {
+    xdo_window_geometry_t *g = &geometry[i];
+    if (g->status != XDO_SUCCESS) {
+      fprintf(stderr, "window %ld - failed to get geometry\n", g->window);
+      ret = EXIT_FAILURE;
+      continue;
     }
 
-    if (shell_output) {
-      xdotool_output(context, "%sWINDOW=%ld", out_prefix, window);
-      xdotool_output(context, "%sX=%d", out_prefix, x);
-      xdotool_output(context, "%sY=%d", out_prefix, y);
-      xdotool_output(context, "%sWIDTH=%u", out_prefix, width);
-      xdotool_output(context, "%sHEIGHT=%u", out_prefix, height);
-      xdotool_output(context, "%sSCREEN=%d", out_prefix, XScreenNumberOfScreen(screen));
+    if (output != OUTPUT_TEXT) {
+      /* --format applies to this command only */
+      int saved_output = context->output;
+      context->output = output;
+      xdotool_record_begin(context);
+      xdotool_record_int(context, "window", g->window);
+      xdotool_record_int(context, "x", g->x);
+      xdotool_record_int(context, "y", g->y);
+      xdotool_record_int(context, "width", g->width);
+      xdotool_record_int(context, "height", g->height);
+      xdotool_record_int(context, "screen", g->screen);
+      xdotool_record_end(context);
+      context->output = saved_output;
+    } else if (shell_output) {
+      xdotool_output(context, "%sWINDOW=%ld", out_prefix, g->window);
+      xdotool_output(context, "%sX=%d", out_prefix, g->x);
+      xdotool_output(context, "%sY=%d", out_prefix, g->y);
+      xdotool_output(context, "%sWIDTH=%u", out_prefix, g->width);
+      xdotool_output(context, "%sHEIGHT=%u", out_prefix, g->height);
+      xdotool_output(context, "%sSCREEN=%d", out_prefix, g->screen);
     } else {
-      xdotool_output(context, "Window %ld", window);
-      xdotool_output(context, "  Position: %d,%d (screen: %d)", x, y,
-                     XScreenNumberOfScreen(screen));
-      xdotool_output(context, "  Geometry: %ux%u", width, height);
+      xdotool_output(context, "Window %ld", g->window);
+      xdotool_output(context, "  Position: %d,%d (screen: %d)", g->x, g->y,
+                     g->screen);
+      xdotool_output(context, "  Geometry: %ux%u", g->width, g->height);
     }
-  }); /* window_each(...) */
-  return EXIT_SUCCESS;
-}
+  }
 
+  free(geometry);
+  return ret;
+}
@@ -1,4 +1,23 @@
 #include "xdo_cmd.h"
+#include <X11/Xatom.h>
+
+/* A name of type STRING is Latin-1, but records are written as UTF-8 */
+static char *latin1_to_utf8(const unsigned char *text, int len, int *len_ret) {
+  char *utf8 = malloc(len * 2 + 1);
+  int i, n = 0;
+
+  for (i = 0; i < len; i++) {
+    if (text[i] < 0x80) {
+      utf8[n++] = text[i];
+    } else {
+      utf8[n++] = 0xc0 | (text[i] >> 6);
+      utf8[n++] = 0x80 | (text[i] & 0x3f);
+    }
+  }
+  utf8[n] = '\0';
+  *len_ret = n;
+  return utf8;
+}
 
 int cmd_getwindowname(context_t *context) {
   char *cmd = context->argv[0];
@@ -41,7 +60,21 @@ int cmd_getwindowname(context_t *context) {
 
   window_each(context, window_arg, {
     xdo_get_window_name(context->xdo, window, &name, &name_len, &name_type);
-    xdotool_output(context, "%.*s", name_len, name);
+    if (context->output == OUTPUT_TEXT) {
+      xdotool_output(context, "%.*s", name_len, name);
+    } else {
+      xdotool_record_begin(context);
+      xdotool_record_int(context, "window", window);
+      if (name_type == XA_STRING) {
+        int utf8_len;
+        char *utf8 = latin1_to_utf8(name, name_len, &utf8_len);
+        xdotool_record_string(context, "name", utf8, utf8_len);
+        free(utf8);
+      } else {
+        xdotool_record_string(context, "name", (char *)name, name_len);
+      }
+      xdotool_record_end(context);
+    }
     XFree(name);
   }); /* window_each(...) */
   return EXIT_SUCCESS;
@@ -137,7 +137,7 @@ int cmd_key(context_t *context) {
 
       /* Sleep if --repeat-delay given and not on the last repetition */
       if (repeat_delay > 0 && j < (repeat-1))  {
-        usleep(repeat_delay);
+        xdotool_usleep(repeat_delay);
       }
     } /* repeat */
 
@@ -0,0 +1,370 @@
+#include "xdo_cmd.h"
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h> /* for clock_gettime */
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#if defined(MISSING_CLOCK_GETTIME)
+#  include "patch_clock_gettime.h"
+#endif
+
+/* An event as the probe window saw it, sent from the receiving process */
+struct probe_event {
+  int type;
+  int send_event;
+  Window window;
+  struct timespec arrived;
+};
+
+/* Latencies, in seconds, for one kind of event */
+struct probe_samples {
+  const char *name;
+  double *latency;
+  unsigned int count;
+  unsigned int lost;
+};
+
+/* How long to wait for an injected event before calling it lost */
+#define PROBE_TIMEOUT_MS 1000
+/* Histogram buckets are powers of two microseconds, 16us to 1s */
+#define PROBE_BUCKET_MIN 4
+#define PROBE_BUCKET_MAX 20
+
+static double probe_seconds(const struct timespec *ts) {
+  return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+/* The receiving side runs in its own process with its own connection, as
+ * a real client would, so an event's arrival is timed when the server
+ * delivers it and not when xdotool next reads its own connection. */
+static void probe_receive(const char *display_name, int screen, int x, int y,
+                          int events_fd, int control_fd) {
+  Display *dpy = XOpenDisplay(display_name);
+  XSetWindowAttributes attr;
+  struct pollfd fds[2];
+  struct probe_event probe;
+  XEvent e;
+  Window window;
+
+  if (dpy == NULL) {
+    return;
+  }
+
+  /* A tiny override-redirect window under the pointer, so window managers
+   * leave it alone and pointer events land on it. */
+  attr.override_redirect = True;
+  attr.event_mask = KeyPressMask | KeyReleaseMask | ButtonPressMask
+                    | ButtonReleaseMask | PointerMotionMask
+                    | StructureNotifyMask;
+  window = XCreateWindow(dpy, RootWindow(dpy, screen), x - 5, y - 5, 11, 11,
+                         0, 0, InputOnly, CopyFromParent,
+                         CWOverrideRedirect | CWEventMask, &attr);
+  XMapRaised(dpy, window);
+  XFlush(dpy);
+
+  fds[0].fd = ConnectionNumber(dpy);
+  fds[0].events = POLLIN;
+  fds[1].fd = control_fd;
+  fds[1].events = POLLIN;
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    /* xdotool closes its end when it is done */
+    if (fds[1].revents != 0) {
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &probe.arrived);
+    while (XPending(dpy)) {
+      XNextEvent(dpy, &e);
+      probe.type = e.type;
+      probe.send_event = e.xany.send_event;
+      probe.window = window;
+      if (write(events_fd, &probe, sizeof(probe)) != sizeof(probe)) {
+        break;
+      }
+    }
+  }
+  XCloseDisplay(dpy);
+} /* void probe_receive */
+
+/* Wait for an event of 'type' from the probe window. Events that did not
+ * come by the path being measured, such as real input, are skipped. */
+static int probe_wait(int events_fd, int type, int send_event,
+                      struct probe_event *probe_ret) {
+  struct pollfd fds[1];
+  int timeout = PROBE_TIMEOUT_MS;
+  struct timespec start, now;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  fds[0].fd = events_fd;
+  fds[0].events = POLLIN;
+  while (timeout > 0 && poll(fds, 1, timeout) > 0) {
+    if (read(events_fd, probe_ret, sizeof(*probe_ret)) != sizeof(*probe_ret)) {
+      return False;
+    }
+    if (probe_ret->type == type && !probe_ret->send_event == !send_event) {
+      return True;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timeout = PROBE_TIMEOUT_MS
+              - (int)((probe_seconds(&now) - probe_seconds(&start)) * 1000);
+  }
+  return False;
+} /* int probe_wait */
+
+/* Time from 'sent', just before an event was injected, until the probe
+ * window got it */
+static void probe_record(struct probe_samples *samples, int events_fd,
+                         int type, int send_event,
+                         const struct timespec *sent) {
+  struct probe_event probe;
+
+  if (probe_wait(events_fd, type, send_event, &probe)) {
+    samples->latency[samples->count++] = probe_seconds(&probe.arrived)
+                                         - probe_seconds(sent);
+  } else {
+    samples->lost++;
+  }
+}
+
+static int probe_compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void probe_report(context_t *context, struct probe_samples *samples) {
+  unsigned int buckets[PROBE_BUCKET_MAX + 2] = { 0 };
+  unsigned int i, first, last, most = 0;
+  double *latency = samples->latency;
+  char bar[41];
+
+  if (samples->count > 0) {
+    qsort(latency, samples->count, sizeof(double), probe_compare);
+  }
+
+  /* With --output, one record per kind of event, latencies in microseconds
+   * and 0 if no events arrived */
+  if (context->output != OUTPUT_TEXT) {
+    long min = 0, median = 0, p99 = 0, max = 0;
+    if (samples->count > 0) {
+      min = lround(latency[0] * 1e6);
+      median = lround(latency[samples->count / 2] * 1e6);
+      p99 = lround(latency[(samples->count * 99) / 100] * 1e6);
+      max = lround(latency[samples->count - 1] * 1e6);
+    }
+    xdotool_record_begin(context);
+    xdotool_record_string(context, "kind", samples->name,
+                          strlen(samples->name));
+    xdotool_record_int(context, "events", samples->count);
+    xdotool_record_int(context, "lost", samples->lost);
+    xdotool_record_int(context, "min_us", min);
+    xdotool_record_int(context, "median_us", median);
+    xdotool_record_int(context, "p99_us", p99);
+    xdotool_record_int(context, "max_us", max);
+    xdotool_record_end(context);
+    return;
+  }
+
+  if (samples->count == 0) {
+    xdotool_output(context, "%s: no events arrived, %u lost", samples->name,
+                   samples->lost);
+    return;
+  }
+
+  xdotool_output(context, "%s: %u events, %u lost, min %.3f ms, "
+                 "median %.3f ms, p99 %.3f ms, max %.3f ms",
+                 samples->name, samples->count, samples->lost,
+                 latency[0] * 1000, latency[samples->count / 2] * 1000,
+                 latency[(samples->count * 99) / 100] * 1000,
+                 latency[samples->count - 1] * 1000);
+
+  /* Bucket i holds latencies below 2^i microseconds */
+  for (i = 0; i < samples->count; i++) {
+    unsigned int b = PROBE_BUCKET_MIN;
+    while (b <= PROBE_BUCKET_MAX && latency[i] * 1e6 >= (1 << b)) {
+      b++;
+    }
+    buckets[b]++;
+  }
+  for (first = PROBE_BUCKET_MIN; buckets[first] == 0; first++);
+  for (last = PROBE_BUCKET_MAX + 1; buckets[last] == 0; last--);
+  for (i = first; i <= last; i++) {
+    if (buckets[i] > most) {
+      most = buckets[i];
+    }
+  }
+  for (i = first; i <= last; i++) {
+    unsigned int width = (buckets[i] * (sizeof(bar) - 1) + most - 1) / most;
+    memset(bar, '#', width);
+    bar[width] = '\0';
+    if (i > PROBE_BUCKET_MAX) {
+      xdotool_output(context, "  >= %9.3f ms | %-40s %u",
+                     (1 << PROBE_BUCKET_MAX) / 1000.0, bar, buckets[i]);
+    } else {
+      xdotool_output(context, "   < %9.3f ms | %-40s %u",
+                     (1 << i) / 1000.0, bar, buckets[i]);
+    }
+  }
+} /* void probe_report */
+
+int cmd_latencyprobe(context_t *context) {
+  char *cmd = *context->argv;
+  int ret = EXIT_SUCCESS;
+  int c, i;
+  int count = 100;
+  int use_sendevent = False;
+  useconds_t delay = 10000;
+  int x, y, screen;
+  Window focus = 0, target;
+  int events_pipe[2], control_pipe[2];
+  struct probe_event ready;
+  struct probe_samples key = { "key", NULL, 0, 0 };
+  struct probe_samples button = { "button", NULL, 0, 0 };
+  struct probe_samples motion = { "motion", NULL, 0, 0 };
+  struct timespec sent;
+  pid_t pid;
+
+  enum { opt_unused, opt_help, opt_count, opt_delay, opt_sendevent };
+  static struct option longopts[] = {
+    { "help", no_argument, NULL, opt_help },
+    { "count", required_argument, NULL, opt_count },
+    { "delay", required_argument, NULL, opt_delay },
+    { "sendevent", no_argument, NULL, opt_sendevent },
+    { 0, 0, 0, 0 },
+  };
+  static const char *usage =
+    "Usage: %s [options]\n"
+    "Measure how long injected input takes to reach a window.\n"
+    "--count N    - inject N key presses, clicks and motions (default 100)\n"
+    "--delay MS   - milliseconds between probes (default 10)\n"
+    "--sendevent  - send key and button events to the probe window with\n"
+    "               XSendEvent instead of XTEST\n";
+
+  int option_index;
+  while ((c = getopt_long_only(context->argc, context->argv, "+h",
+                               longopts, &option_index)) != -1) {
+    switch (c) {
+      case 'h':
+      case opt_help:
+        printf(usage, cmd);
+        consume_args(context, context->argc);
+        return EXIT_SUCCESS;
+        break;
+      case opt_count:
+        count = atoi(optarg);
+        break;
+      case opt_delay:
+        delay = strtoul(optarg, NULL, 0) * 1000;
+        break;
+      case opt_sendevent:
+        use_sendevent = True;
+        break;
+      default:
+        fprintf(stderr, usage, cmd);
+        return EXIT_FAILURE;
+    }
+  }
+
+  consume_args(context, optind);
+
+  if (count <= 0) {
+    fprintf(stderr, "%s: --count must be positive\n", cmd);
+    return EXIT_FAILURE;
+  }
+
+  xdo_get_mouse_location(context->xdo, &x, &y, &screen);
+  xdo_get_focused_window(context->xdo, &focus);
+
+  if (pipe(events_pipe) != 0 || pipe(control_pipe) != 0) {
+    fprintf(stderr, "%s: pipe failed: %s\n", cmd, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "%s: fork failed: %s\n", cmd, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  if (pid == 0) {
+    close(events_pipe[0]);
+    close(control_pipe[1]);
+    probe_receive(DisplayString(context->xdo->xdpy), screen, x, y,
+                  events_pipe[1], control_pipe[0]);
+    _exit(EXIT_SUCCESS);
+  }
+  close(events_pipe[1]);
+  close(control_pipe[0]);
+
+  if (!probe_wait(events_pipe[0], MapNotify, False, &ready)) {
+    fprintf(stderr, "%s: the probe window did not appear\n", cmd);
+    ret = EXIT_FAILURE;
+    goto done;
+  }
+
+  /* XTEST key events go to the focused window; libxdo sends them with
+   * XSendEvent to any other window. */
+  if (use_sendevent) {
+    target = ready.window;
+  } else {
+    target = CURRENTWINDOW;
+    xdo_focus_window(context->xdo, ready.window);
+    xdo_wait_for_window_focus(context->xdo, ready.window, True);
+  }
+
+  key.latency = calloc(count * 2, sizeof(double));
+  button.latency = calloc(count * 2, sizeof(double));
+  motion.latency = calloc(count, sizeof(double));
+
+  for (i = 0; i < count; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+    xdo_send_keysequence_window_down(context->xdo, target, "shift", 0);
+    probe_record(&key, events_pipe[0], KeyPress, use_sendevent, &sent);
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+    xdo_send_keysequence_window_up(context->xdo, target, "shift", 0);
+    probe_record(&key, events_pipe[0], KeyRelease, use_sendevent, &sent);
+
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+    xdo_mouse_down(context->xdo, target, Button1);
+    probe_record(&button, events_pipe[0], ButtonPress, use_sendevent, &sent);
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+    xdo_mouse_up(context->xdo, target, Button1);
+    probe_record(&button, events_pipe[0], ButtonRelease, use_sendevent, &sent);
+
+    /* libxdo moves the pointer itself in either mode, so motion always
+     * arrives as a real event */
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+    xdo_move_mouse(context->xdo, x + (i % 2 == 0 ? 1 : 0), y, screen);
+    probe_record(&motion, events_pipe[0], MotionNotify, False, &sent);
+
+    if (delay > 0) {
+      xdotool_usleep(delay);
+    }
+  }
+
+  probe_report(context, &key);
+  probe_report(context, &button);
+  probe_report(context, &motion);
+  free(key.latency);
+  free(button.latency);
+  free(motion.latency);
+
+done:
+  close(control_pipe[1]);
+  close(events_pipe[0]);
+  waitpid(pid, NULL, 0);
+
+  /* Put things back the way they were */
+  xdo_move_mouse(context->xdo, x, y, screen);
+  if (!use_sendevent && focus != 0) {
+    xdo_focus_window(context->xdo, focus);
+  }
+  return ret;
+} /* int cmd_latencyprobe */
@@ -1,6 +1,7 @@
 #include "xdo_cmd.h"
 #include <math.h>
 #include <string.h>
+#include <strings.h>
 
 struct mousemove {
   Window window;
@@ -10,8 +11,9 @@ struct mousemove {
   int x;
   int y;
   int screen;
-  useconds_t delay;
+  unsigned long delay; /* nanoseconds between steps */
   int step;
+  int path;
 };
 
 static int _mousemove(context_t *context, struct mousemove *mousemove);
@@ -20,6 +22,7 @@ int cmd_mousemove(context_t *context) {
   int ret = 0;
   char *cmd = *context->argv;
   char *window_arg = NULL;
+  double delay;
 
   struct mousemove mousemove;
   mousemove.clear_modifiers = 0;
@@ -29,28 +32,33 @@ int cmd_mousemove(context_t *context) {
   mousemove.x = 0;
   mousemove.y = 0;
   mousemove.step = 0;
+  mousemove.delay = 0;
+  mousemove.path = -1;
 
   int c;
   enum {
     opt_unused, opt_help, opt_sync, opt_clearmodifiers, opt_polar,
-    opt_screen, opt_step, opt_delay, opt_window
+    opt_screen, opt_step, opt_delay, opt_window, opt_path
   };
   static struct option longopts[] = {
     { "clearmodifiers", no_argument, NULL, opt_clearmodifiers },
     { "help", no_argument, NULL, opt_help},
     { "polar", no_argument, NULL, opt_polar },
     { "screen", required_argument, NULL, opt_screen },
-    //{ "step", required_argument, NULL, opt_step },
+    { "step", required_argument, NULL, opt_step },
     { "sync", no_argument, NULL, opt_sync },
-    //{ "delay", required_argument, NULL, opt_delay },
+    { "delay", required_argument, NULL, opt_delay },
+    { "path", required_argument, NULL, opt_path },
     { "window", required_argument, NULL, opt_window },
     { 0, 0, 0, 0 },
   };
   static const char *usage = 
       "Usage: %s [options] <x> <y>\n"
       "-c, --clearmodifiers      - reset active modifiers (alt, etc) while typing\n"
-      //"-d, --delay <MS>          - sleeptime in milliseconds between steps.\n"
-      //"--step <STEP>             - pixels to move each time along path to x,y.\n" "-p, --polar               - Use polar coordinates. X as an angle, Y as distance\n"
+      "-d, --delay <MS>          - sleeptime in milliseconds between steps.\n"
+      "--step <STEP>             - pixels to move each time along path to x,y.\n"
+      "--path line|ease|curve    - the path to move along in steps.\n"
+      "-p, --polar               - Use polar coordinates. X as an angle, Y as distance\n"
       "--screen SCREEN           - which screen to move on, default is current screen\n"
       "--sync                    - only exit once the mouse has moved\n"
       "-w, --window <windowid>   - specify a window to move relative to.\n";
@@ -85,7 +93,25 @@ int cmd_mousemove(context_t *context) {
         break;
       case 'd':
       case opt_delay:
-        mousemove.delay = strtoul(optarg, NULL, 0) * 1000;
+        delay = atof(optarg);
+        if (delay < 0) {
+          fprintf(stderr, "Invalid --delay '%s' (must be >= 0)\n", optarg);
+          return EXIT_FAILURE;
+        }
+        mousemove.delay = delay * 1000000;
+        break;
+      case opt_path:
+        if (!strcasecmp(optarg, "line")) {
+          mousemove.path = XDO_MOUSE_PATH_LINE;
+        } else if (!strcasecmp(optarg, "ease")) {
+          mousemove.path = XDO_MOUSE_PATH_EASE;
+        } else if (!strcasecmp(optarg, "curve")) {
+          mousemove.path = XDO_MOUSE_PATH_CURVE;
+        } else {
+          fprintf(stderr, "Invalid --path '%s', expected line, ease or "
+                  "curve\n", optarg);
+          return EXIT_FAILURE;
+        }
         break;
       case opt_sync:
         mousemove.opsync = 1;
@@ -193,25 +219,35 @@ static int _mousemove(context_t *context, struct mousemove *mousemove) {
     xdo_clear_active_modifiers(context->xdo, window, active_mods, active_mods_n);
   }
 
-  if (mousemove->step == 0) {
+  if (mousemove->step == 0 && mousemove->delay == 0 && mousemove->path < 0) {
     if (window != CURRENTWINDOW && !mousemove->polar_coordinates) {
       ret = xdo_move_mouse_relative_to_window(context->xdo, window, x, y);
     } else {
       ret = xdo_move_mouse(context->xdo, x, y, screen);
     }
   } else {
+    int step = (mousemove->step > 0 ? mousemove->step : 10);
+    unsigned long delay = (mousemove->delay > 0 ? mousemove->delay : 10000000);
+    int path = (mousemove->path >= 0 ? mousemove->path : XDO_MOUSE_PATH_LINE);
+    unsigned int steps;
+
+    if (window != CURRENTWINDOW && !mousemove->polar_coordinates) {
+      int win_x, win_y;
+      Screen *win_screen;
+      xdo_get_window_location(context->xdo, window, &win_x, &win_y,
+                              &win_screen);
+      x += win_x;
+      y += win_y;
+      screen = XScreenNumberOfScreen(win_screen);
+    }
+
     if (mx == x && my == y && mscreen == screen) {
       /* Nothing to move. Quit now. */
       return 0;
     }
-    
-    fprintf(stderr, "--step support not yet implemented\n");
 
-    if (window > 0) {
-      ret = xdo_move_mouse_relative_to_window(context->xdo, window, x, y);
-    } else {
-      ret = xdo_move_mouse(context->xdo, x, y, screen);
-    }
+    steps = ceil(hypot(x - mx, y - my) / step);
+    ret = xdo_move_mouse_path(context->xdo, x, y, screen, path, steps, delay);
   }
 
   if (ret) {
@@ -0,0 +1,273 @@
+#include "xdo_cmd.h"
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+/* A recording is a header followed by one fixed-size record per event, all
+ * little-endian:
+ *   "xdorec2\n"
+ *   u32 milliseconds since the first event, u8 event type, u8 keycode or
+ *   button, s16 root x, s16 root y, u8 screen
+ */
+#define RECORDING_MAGIC "xdorec2\n"
+#define RECORDING_MAGIC_SIZE 8
+#define RECORDING_EVENT_SIZE 11
+/* Key presses held back at most, see record_event */
+#define RECORDING_PENDING_MAX 64
+
+struct recording {
+  FILE *file;
+  unsigned long first;
+  unsigned long count;
+  int failed;
+  unsigned char pending[RECORDING_PENDING_MAX][RECORDING_EVENT_SIZE];
+  unsigned int npending;
+};
+
+static void recording_pack(unsigned char *buf, unsigned long time,
+                           const xdo_input_event_t *event) {
+  buf[0] = time & 0xff;
+  buf[1] = (time >> 8) & 0xff;
+  buf[2] = (time >> 16) & 0xff;
+  buf[3] = (time >> 24) & 0xff;
+  buf[4] = event->type;
+  buf[5] = event->detail;
+  buf[6] = event->x & 0xff;
+  buf[7] = (event->x >> 8) & 0xff;
+  buf[8] = event->y & 0xff;
+  buf[9] = (event->y >> 8) & 0xff;
+  buf[10] = event->screen;
+}
+
+static void recording_unpack(const unsigned char *buf,
+                             xdo_input_event_t *event) {
+  event->time = buf[0] | (buf[1] << 8) | ((unsigned long)buf[2] << 16)
+                | ((unsigned long)buf[3] << 24);
+  event->type = buf[4];
+  event->detail = buf[5];
+  event->x = (short)(buf[6] | (buf[7] << 8));
+  event->y = (short)(buf[8] | (buf[9] << 8));
+  event->screen = buf[10];
+}
+
+static void recording_write(struct recording *recording,
+                            const unsigned char *buf) {
+  if (fwrite(buf, RECORDING_EVENT_SIZE, 1, recording->file) != 1) {
+    recording->failed = True;
+  }
+  recording->count++;
+}
+
+static void recording_flush_pending(struct recording *recording) {
+  unsigned int i;
+
+  for (i = 0; i < recording->npending; i++) {
+    recording_write(recording, recording->pending[i]);
+  }
+  recording->npending = 0;
+}
+
+/* Key presses are held back until some other event follows them. Those
+ * still held back at the end are the ones that stopped the recording, such
+ * as ctrl+c, and are dropped so a replay doesn't repeat them. */
+static int record_event(const xdo_t *xdo, const xdo_input_event_t *event,
+                        void *userdata) {
+  struct recording *recording = userdata;
+  unsigned char buf[RECORDING_EVENT_SIZE];
+  (void)xdo;
+
+  if (recording->count == 0 && recording->npending == 0) {
+    recording->first = event->time;
+  }
+  recording_pack(buf, (event->time - recording->first) & 0xffffffffUL, event);
+
+  if (event->type == KeyPress) {
+    if (recording->npending == RECORDING_PENDING_MAX) {
+      recording_flush_pending(recording);
+    }
+    memcpy(recording->pending[recording->npending++], buf, sizeof(buf));
+  } else {
+    recording_flush_pending(recording);
+    recording_write(recording, buf);
+  }
+  return recording->failed ? XDO_RECORD_STOP : XDO_RECORD_CONTINUE;
+}
+
+static int replay_event(const xdo_t *xdo, xdo_input_event_t *event_ret,
+                        void *userdata) {
+  unsigned char buf[RECORDING_EVENT_SIZE];
+  (void)xdo;
+
+  if (fread(buf, sizeof(buf), 1, (FILE *)userdata) != 1) {
+    return False;
+  }
+  recording_unpack(buf, event_ret);
+  return True;
+}
+
+/* Interrupting the wait for input is all a signal needs to do */
+static void record_interrupt(int signum) {
+  (void)signum;
+}
+
+int cmd_record(context_t *context) {
+  char *cmd = *context->argv;
+  int ret = EXIT_SUCCESS;
+  int c;
+  unsigned int duration = 0;
+  struct recording *recording;
+  struct sigaction action, old_int, old_term, old_alrm;
+
+  enum { opt_unused, opt_help, opt_duration };
+  static struct option longopts[] = {
+    { "help", no_argument, NULL, opt_help },
+    { "duration", required_argument, NULL, opt_duration },
+    { 0, 0, 0, 0 },
+  };
+  static const char *usage =
+    "Usage: %s [--duration SECONDS] FILE\n"
+    "Record keyboard and mouse input to FILE, or to stdout if FILE is '-',\n"
+    "until interrupted (ctrl+c) or for SECONDS. Play it back with 'replay'.\n";
+
+  int option_index;
+  while ((c = getopt_long_only(context->argc, context->argv, "+h",
+                               longopts, &option_index)) != -1) {
+    switch (c) {
+      case 'h':
+      case opt_help:
+        printf(usage, cmd);
+        consume_args(context, context->argc);
+        return EXIT_SUCCESS;
+        break;
+      case opt_duration:
+        duration = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, usage, cmd);
+        return EXIT_FAILURE;
+    }
+  }
+
+  consume_args(context, optind);
+
+  if (context->argc == 0) {
+    fprintf(stderr, "No file given.\n");
+    fprintf(stderr, usage, cmd);
+    return EXIT_FAILURE;
+  }
+
+  recording = calloc(1, sizeof(struct recording));
+  if (!strcmp(context->argv[0], "-")) {
+    recording->file = stdout;
+  } else {
+    recording->file = fopen(context->argv[0], "wb");
+    if (recording->file == NULL) {
+      fprintf(stderr, "Failure opening '%s': %s\n", context->argv[0],
+              strerror(errno));
+      free(recording);
+      return EXIT_FAILURE;
+    }
+  }
+  fwrite(RECORDING_MAGIC, RECORDING_MAGIC_SIZE, 1, recording->file);
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = record_interrupt;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, &old_int);
+  sigaction(SIGTERM, &action, &old_term);
+  sigaction(SIGALRM, &action, &old_alrm);
+  if (duration > 0) {
+    alarm(duration);
+  }
+
+  if (xdo_record_input(context->xdo, record_event, recording) != XDO_SUCCESS) {
+    ret = EXIT_FAILURE;
+  }
+
+  alarm(0);
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+  sigaction(SIGALRM, &old_alrm, NULL);
+
+  if (fflush(recording->file) != 0 || recording->failed) {
+    fprintf(stderr, "Failure writing '%s': %s\n", context->argv[0],
+            strerror(errno));
+    ret = EXIT_FAILURE;
+  }
+  xdotool_debug(context, "Recorded %lu events\n", recording->count);
+  if (recording->file != stdout) {
+    fclose(recording->file);
+  }
+  free(recording);
+  consume_args(context, 1);
+  return ret;
+} /* int cmd_record */
+
+int cmd_replay(context_t *context) {
+  char *cmd = *context->argv;
+  int ret = EXIT_SUCCESS;
+  int c;
+  FILE *file;
+  char magic[RECORDING_MAGIC_SIZE];
+
+  enum { opt_unused, opt_help };
+  static struct option longopts[] = {
+    { "help", no_argument, NULL, opt_help },
+    { 0, 0, 0, 0 },
+  };
+  static const char *usage =
+    "Usage: %s FILE\n"
+    "Play back keyboard and mouse input recorded with 'record' from FILE,\n"
+    "or from stdin if FILE is '-', with the same timing.\n";
+
+  int option_index;
+  while ((c = getopt_long_only(context->argc, context->argv, "+h",
+                               longopts, &option_index)) != -1) {
+    switch (c) {
+      case 'h':
+      case opt_help:
+        printf(usage, cmd);
+        consume_args(context, context->argc);
+        return EXIT_SUCCESS;
+        break;
+      default:
+        fprintf(stderr, usage, cmd);
+        return EXIT_FAILURE;
+    }
+  }
+
+  consume_args(context, optind);
+
+  if (context->argc == 0) {
+    fprintf(stderr, "No file given.\n");
+    fprintf(stderr, usage, cmd);
+    return EXIT_FAILURE;
+  }
+
+  if (!strcmp(context->argv[0], "-")) {
+    file = stdin;
+  } else {
+    file = fopen(context->argv[0], "rb");
+    if (file == NULL) {
+      fprintf(stderr, "Failure opening '%s': %s\n", context->argv[0],
+              strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (fread(magic, sizeof(magic), 1, file) != 1
+      || memcmp(magic, RECORDING_MAGIC, sizeof(magic))) {
+    fprintf(stderr, "'%s' is not an xdotool recording\n", context->argv[0]);
+    ret = EXIT_FAILURE;
+  } else if (xdo_replay_input(context->xdo, replay_event, file)
+             != XDO_SUCCESS) {
+    ret = EXIT_FAILURE;
+  }
+
+  if (file != stdin) {
+    fclose(file);
+  }
+  consume_args(context, 1);
+  return ret;
+} /* int cmd_replay */
@@ -1,13 +1,170 @@
 #include "xdo_cmd.h"
 #include <string.h>
 
+/* Matches collected by search --multi */
+typedef struct multi_results {
+  Window *windows;
+  unsigned int *indexes;
+  unsigned int nmatches;
+  unsigned int size;
+  char *matched; /* per pattern */
+} multi_results_t;
+
+static int multi_add(const xdo_t *xdo, Window window, unsigned int index,
+                     void *data) {
+  multi_results_t *results = data;
+
+  (void)xdo;
+  if (results->nmatches == results->size) {
+    results->size = results->size ? results->size * 2 : 32;
+    results->windows = realloc(results->windows,
+                               results->size * sizeof(Window));
+    results->indexes = realloc(results->indexes,
+                               results->size * sizeof(unsigned int));
+  }
+  results->windows[results->nmatches] = window;
+  results->indexes[results->nmatches] = index;
+  results->nmatches++;
+  results->matched[index] = True;
+  return XDO_SEARCH_CONTINUE;
+} /* int multi_add */
+
+static int search_multi(context_t *context, xdo_search_t *search,
+                        int op_sync, int out_shell, const char *out_prefix) {
+  multi_results_t results;
+  const char **patterns;
+  unsigned int npatterns = 0;
+  unsigned int i;
+  int all_matched;
+
+  /* Patterns run up to the next command in the chain */
+  while (npatterns < (unsigned int)context->argc
+         && !is_command(context->argv[npatterns])) {
+    npatterns++;
+  }
+  if (npatterns == 0) {
+    fprintf(stderr, "--multi requires at least one pattern\n");
+    return EXIT_FAILURE;
+  }
+  patterns = (const char **)context->argv;
+
+  memset(&results, 0, sizeof(results));
+  results.matched = calloc(npatterns, sizeof(char));
+
+  /* With --sync, wait until every pattern has found something */
+  do {
+    results.nmatches = 0;
+    memset(results.matched, 0, npatterns);
+    /* libxdo has said which pattern is bad */
+    if (xdo_search_windows_multi(context->xdo, search, patterns, npatterns,
+                                 multi_add, &results) != XDO_SUCCESS) {
+      free(results.windows);
+      free(results.indexes);
+      free(results.matched);
+      return EXIT_FAILURE;
+    }
+
+    all_matched = True;
+    for (i = 0; i < npatterns; i++) {
+      if (!results.matched[i]) {
+        all_matched = False;
+      }
+    }
+
+    if (op_sync && !all_matched) {
+      xdotool_debug(context, "Not all patterns matched, still waiting...");
+      xdotool_usleep(500000);
+    }
+  } while (op_sync && !all_matched);
+
+  consume_args(context, npatterns);
+
+  if ((context->argc == 0) || out_shell) {
+    if (out_shell) printf("%s%s", out_prefix, "WINDOWS=(");
+    for (i = 0; i < results.nmatches; i++) {
+      if (out_shell) {
+        window_print(results.windows[i]);
+      } else if (context->output == OUTPUT_TEXT) {
+        printf("%u %ld\n", results.indexes[i], results.windows[i]);
+      } else {
+        xdotool_record_begin(context);
+        xdotool_record_int(context, "pattern", results.indexes[i]);
+        xdotool_record_int(context, "window", results.windows[i]);
+        xdotool_record_end(context);
+      }
+    }
+    if (out_shell) printf("%s",")\n");
+  }
+
+  /* Every match goes on the window stack, in the order found */
+  free(context->windows);
+  context->windows = results.windows;
+  context->nwindows = results.nmatches;
+  free(results.indexes);
+  free(results.matched);
+
+  return (context->nwindows || out_shell ? EXIT_SUCCESS : EXIT_FAILURE);
+} /* int search_multi */
+
+static int watch_print(const xdo_t *xdo, Window window, int matched,
+                       void *data) {
+  context_t *context = data;
+
+  (void)xdo;
+  if (context->output == OUTPUT_TEXT) {
+    printf("%c%ld\n", matched ? '+' : '-', window);
+  } else {
+    xdotool_record_begin(context);
+    xdotool_record_int(context, "window", window);
+    xdotool_record_int(context, "matched", matched);
+    xdotool_record_end(context);
+  }
+  /* Whoever reads this wants to know right away */
+  fflush(stdout);
+  return XDO_SEARCH_CONTINUE;
+} /* int watch_print */
+
+/* Windows found by a plain search, printed as they arrive */
+typedef struct search_results {
+  context_t *context;
+  Window *windows;
+  unsigned int nwindows;
+  unsigned int size;
+  int print;
+  int shell;
+} search_results_t;
+
+static int search_add(const xdo_t *xdo, Window window, void *data) {
+  search_results_t *results = data;
+  context_t *context = results->context;
+
+  (void)xdo;
+  if (results->nwindows == results->size) {
+    results->size = results->size ? results->size * 2 : 32;
+    results->windows = realloc(results->windows,
+                               results->size * sizeof(Window));
+  }
+  results->windows[results->nwindows++] = window;
+
+  if (results->print) {
+    if (context->output == OUTPUT_TEXT || results->shell) {
+      window_print(window);
+    } else {
+      xdotool_record_begin(context);
+      xdotool_record_int(context, "window", window);
+      xdotool_record_end(context);
+    }
+  }
+  return XDO_SEARCH_CONTINUE;
+} /* int search_add */
+
 int cmd_search(context_t *context) {
-  Window *list = NULL;
+  search_results_t results;
   xdo_search_t search;
-  unsigned int nwindows;
-  unsigned int i;
   int c;
   int op_sync = False;
+  int op_multi = False;
+  int op_watch = False;
 
   int search_title = 0;
   int search_name = 0;
@@ -19,26 +176,35 @@ int cmd_search(context_t *context) {
   enum {
     opt_unused, opt_title, opt_onlyvisible, opt_name, opt_shell, opt_prefix, opt_class, opt_maxdepth,
     opt_pid, opt_help, opt_any, opt_all, opt_screen, opt_classname, opt_desktop,
-    opt_limit, opt_sync, opt_role
+    opt_limit, opt_sync, opt_role, opt_clients, opt_toplevel, opt_parallel,
+    opt_fixed, opt_glob, opt_multi, opt_watch, opt_pidtree
   };
   struct option longopts[] = {
     { "all", no_argument, NULL, opt_all },
     { "any", no_argument, NULL, opt_any },
     { "class", no_argument, NULL, opt_class },
     { "classname", no_argument, NULL, opt_classname },
+    { "clients", no_argument, NULL, opt_clients },
     { "help", no_argument, NULL, opt_help },
     { "maxdepth", required_argument, NULL, opt_maxdepth },
+    { "multi", no_argument, NULL, opt_multi },
     { "name", no_argument, NULL, opt_name },
     { "shell", no_argument, NULL, opt_shell },
     { "prefix", required_argument, NULL, opt_prefix },
     { "onlyvisible", 0, NULL, opt_onlyvisible },
+    { "parallel", no_argument, NULL, opt_parallel },
     { "pid", required_argument, NULL, opt_pid },
+    { "pid-tree", required_argument, NULL, opt_pidtree },
     { "screen", required_argument, NULL, opt_screen },
     { "title", no_argument, NULL, opt_title },
+    { "toplevel", no_argument, NULL, opt_toplevel },
     { "desktop", required_argument, NULL, opt_desktop },
+    { "fixed", no_argument, NULL, opt_fixed },
+    { "glob", no_argument, NULL, opt_glob },
     { "limit", required_argument, NULL, opt_limit },
     { "sync", no_argument, NULL, opt_sync },
     { "role", no_argument, NULL, opt_role },
+    { "watch", no_argument, NULL, opt_watch },
     { 0, 0, 0, 0 },
   };
   static const char *usage =
@@ -47,21 +213,34 @@ int cmd_search(context_t *context) {
       "--class         check regexp_pattern against the window class\n"
       "--classname     check regexp_pattern against the window classname\n"
       "--role          check regexp_pattern against the window role\n"
+      "--clients       only search windows managed by the window manager\n"
+      "--fixed         pattern is plain text instead of a regexp\n"
+      "--glob          pattern is a shell glob such as '*term*'\n"
       "--maxdepth N    set search depth to N. Default is infinite.\n"
       "                -1 also means infinite.\n"
       "--onlyvisible   matches only windows currently visible\n"
+      "--toplevel      don't search below client windows\n"
       "--pid PID       only show windows belonging to specific process\n"
       "                Not supported by all X11 applications\n"
+      "--pid-tree PID  like --pid, but also match windows of any process\n"
+      "                started by PID, directly or not\n"
       "--screen N      only search a specific screen. Default is all screens\n"
+      "--parallel      search all screens at the same time\n"
       "--desktop N     only search a specific desktop number\n"
       "--limit N       break search after N results\n"
+      "                (per pattern with --multi)\n"
+      "--multi         search for every pattern up to the next command in\n"
+      "                one pass; prints 'INDEX WINDOW' for each match\n"
       "--name          check regexp_pattern against the window name\n"
       "--shell         print results as shell array WINDOWS=( ... )\n"
       "--prefix STR    use prefix (max 16 chars) for array name STRWINDOWS\n"
       "--title         DEPRECATED. Same as --name.\n"
       "--all           Require all conditions match a window. Default is --any\n"
       "--any           Windows matching any condition will be reported\n"
+      "--watch         keep running and print +WINDOW or -WINDOW each time\n"
+      "                a window starts or stops matching\n"
       "--sync          Wait until a search result is found.\n"
+      "                With --multi, wait until every pattern matches.\n"
       "-h, --help      show this help output\n"
       "\n"
       "If none of --name, --classname, --class, or --role are specified, the \n"
@@ -89,8 +268,13 @@ int cmd_search(context_t *context) {
         break;
       case opt_pid:
         search.pid = atoi(optarg);
+        search.searchmask &= ~SEARCH_PIDTREE;
         search.searchmask |= SEARCH_PID;
         break;
+      case opt_pidtree:
+        search.pid = atoi(optarg);
+        search.searchmask |= SEARCH_PID | SEARCH_PIDTREE;
+        break;
       case opt_any:
         search.require = SEARCH_ANY;
         break;
@@ -114,6 +298,23 @@ int cmd_search(context_t *context) {
       case opt_role:
         search_role = True;
         break;
+      case opt_clients:
+        search.searchmask |= SEARCH_CLIENTS;
+        break;
+      case opt_toplevel:
+        search.searchmask |= SEARCH_TOPLEVEL;
+        break;
+      case opt_parallel:
+        search.searchmask |= SEARCH_PARALLEL;
+        break;
+      case opt_fixed:
+        search.searchmask &= ~SEARCH_GLOB;
+        search.searchmask |= SEARCH_FIXED;
+        break;
+      case opt_glob:
+        search.searchmask &= ~SEARCH_FIXED;
+        search.searchmask |= SEARCH_GLOB;
+        break;
       case opt_title:
         fprintf(stderr, "This flag is deprecated. Assuming you mean --name (the"
                 " window name).\n");
@@ -138,6 +339,12 @@ int cmd_search(context_t *context) {
       case opt_sync:
         op_sync = True;
         break;
+      case opt_multi:
+        op_multi = True;
+        break;
+      case opt_watch:
+        op_watch = True;
+        break;
       default:
         fprintf(stderr, "Invalid usage\n");
         fprintf(stderr, usage, cmd);
@@ -147,8 +354,13 @@ int cmd_search(context_t *context) {
 
   consume_args(context, optind);
 
+  if (op_watch && (op_multi || op_sync || out_shell)) {
+    fprintf(stderr, "--watch can't be used with --multi, --sync or --shell\n");
+    return EXIT_FAILURE;
+  }
+
   /* We require a pattern or a pid to search for */
-  if (context->argc < 1 && search.pid == 0) {
+  if (context->argc < 1 && (search.pid == 0 || op_multi)) {
     fprintf(stderr, usage, cmd);
     return EXIT_FAILURE;
   }
@@ -166,6 +378,19 @@ int cmd_search(context_t *context) {
       search_role = 1;
     }
 
+    if (op_multi) {
+      /* xdo_search_windows_multi fills in the patterns */
+      if (search_title || search_name)
+        search.searchmask |= SEARCH_NAME;
+      if (search_class)
+        search.searchmask |= SEARCH_CLASS;
+      if (search_classname)
+        search.searchmask |= SEARCH_CLASSNAME;
+      if (search_role)
+        search.searchmask |= SEARCH_ROLE;
+      return search_multi(context, &search, op_sync, out_shell, out_prefix);
+    }
+
     if (search_title) {
       search.searchmask |= SEARCH_NAME;
       search.winname = context->argv[0];
@@ -189,34 +414,42 @@ int cmd_search(context_t *context) {
     consume_args(context, 1);
   }
 
-  do {
-    free(list);
+  if (op_watch) {
+    /* Only returns if a pattern is invalid, which libxdo has reported */
+    if (xdo_search_windows_watch(context->xdo, &search, watch_print,
+                                 context) != XDO_SUCCESS) {
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
 
-    xdo_search_windows(context->xdo, &search, &list, &nwindows);
+  memset(&results, 0, sizeof(results));
+  results.context = context;
+  /* only print if we're the last command or printing to shell */
+  results.print = (context->argc == 0) || out_shell;
+  results.shell = out_shell;
 
-    if ( (context->argc == 0) || out_shell ) {
-      /* only print if we're the last command or printing to shell*/
-      if (out_shell) printf("%s%s", out_prefix, "WINDOWS=(");
-      for (i = 0; i < nwindows; i++) {
-        window_print(list[i]);
-      }
-      if (out_shell) printf("%s",")\n");
-    }
+  do {
+    results.nwindows = 0;
+
+    if (out_shell) printf("%s%s", out_prefix, "WINDOWS=(");
+    xdo_search_windows_cb(context->xdo, &search, search_add, &results);
+    if (out_shell) printf("%s",")\n");
 
-    if (op_sync && nwindows == 0) {
+    if (op_sync && results.nwindows == 0) {
       xdotool_debug(context, "No search results, still waiting...");
 
       /* TODO(sissel): Make this tunable */
-      usleep(500000);
+      xdotool_usleep(500000);
     }
-  } while (op_sync && nwindows == 0);
+  } while (op_sync && results.nwindows == 0);
 
-  /* Free old list as it's malloc'd by xdo_search_windows */
+  /* Free old list as it's malloc'd by search_add */
   free(context->windows);
-  context->windows = list;
-  context->nwindows = nwindows;
+  context->windows = results.windows;
+  context->nwindows = results.nwindows;
 
   /* error if number of windows found is zero (behave like grep) 
   but return success when being used inside eval (--shell option)*/
-  return (nwindows || out_shell ? EXIT_SUCCESS : EXIT_FAILURE);
+  return (results.nwindows || out_shell ? EXIT_SUCCESS : EXIT_FAILURE);
 }
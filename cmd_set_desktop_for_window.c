@@ -40,15 +40,20 @@ int cmd_set_desktop_for_window(context_t *context) {
   desktop = strtol(context->argv[0], NULL, 0);
   consume_args(context, 1);
 
+  /* Queue the requests for all windows and flush once. */
+  xdo_batch_begin(context->xdo);
   window_each(context, window_arg, {
-    ret = xdo_set_desktop_for_window(context->xdo, window, desktop);
-    if (ret != XDO_SUCCESS) {
+    if (xdo_set_desktop_for_window(context->xdo, window, desktop)
+        != XDO_SUCCESS) {
       fprintf(stderr, 
               "xdo_set_desktop_for_window on window %ld, desktop %ld failed\n", 
               window, desktop);
-      return ret;
+      ret = EXIT_FAILURE;
     }
   }); /* window_each(...) */
 
+  if (window_batch_end(context, cmd) != XDO_SUCCESS) {
+    ret = EXIT_FAILURE;
+  }
   return ret;
 }
@@ -44,7 +44,7 @@ int cmd_sleep(context_t *context) {
   }
 
   duration_usec = atof(context->argv[0]) * (1000000);
-  usleep(duration_usec);
+  xdotool_usleep(duration_usec);
   consume_args(context, 1);
   return ret;
 }
@@ -45,10 +45,14 @@ int cmd_windowminimize(context_t *context) {
     return EXIT_FAILURE;
   }
 
+  if (!opsync) {
+    xdo_batch_begin(context->xdo);
+  }
+
   window_each(context, window_arg, {
-    ret = xdo_minimize_window(context->xdo, window);
-    if (ret) {
+    if (xdo_minimize_window(context->xdo, window) != XDO_SUCCESS) {
       fprintf(stderr, "xdo_minimize_window reported an error\n");
+      ret = EXIT_FAILURE;
     } else {
       if (opsync) {
         xdo_wait_for_window_map_state(context->xdo, window, IsUnmapped);
@@ -56,5 +60,8 @@ int cmd_windowminimize(context_t *context) {
     }
   }); /* window_each(...) */
 
+  if (!opsync && window_batch_end(context, cmd) != XDO_SUCCESS) {
+    ret = EXIT_FAILURE;
+  }
   return ret;
 }
@@ -14,7 +14,8 @@ struct windowmove {
 
 /* This function exists because at one time I had problems embedding certain
  * blocks of code within macros (window_each). */
-static int _windowmove(context_t *context, struct windowmove *windowmove);
+static int _windowmove(context_t *context, struct windowmove *windowmove,
+                       const xdo_window_geometry_t *geometry);
 
 int cmd_windowmove(context_t *context) {
   int ret = 0;
@@ -103,31 +104,55 @@ int cmd_windowmove(context_t *context) {
   height = (unsigned int)strtoul(context->argv[1], NULL, 0);
   consume_args(context, 2);
 
-  XWindowAttributes wattr;
-  unsigned int root_w, root_h; /* for percent */
+  Window *windows;
+  int nwindows, i;
+  xdo_window_geometry_t *geometry = NULL;
+  unsigned int *root_w = NULL, *root_h = NULL; /* per screen, for percent */
+
+  /* The position of each window is only needed when the moves depend on it */
+  window_list(context, window_arg, &windows, &nwindows, False);
+  if (is_width_percent || is_height_percent) {
+    window_list_geometry(context, windows, nwindows, &geometry,
+                         &root_w, &root_h);
+  } else if (windowmove.flags != 0) {
+    window_list_geometry(context, windows, nwindows, &geometry, NULL, NULL);
+  }
 
-  window_each(context, window_arg, {
-      if (is_width_percent || is_height_percent) {
-        Window root = 0;
-        XGetWindowAttributes(context->xdo->xdpy, window, &wattr);
-        root = wattr.root;
-        xdo_get_window_size(context->xdo, root, &root_w, &root_h);
+  if (!windowmove.opsync) {
+    xdo_batch_begin(context->xdo);
+  }
 
-        if (is_width_percent) {
-          windowmove.x = (root_w * width / 100);
-        }
+  for (i = 0; i < nwindows; i++) {
+    if (geometry != NULL && geometry[i].status != XDO_SUCCESS) {
+      fprintf(stderr, "window %ld - failed to get geometry\n", windows[i]);
+      ret = EXIT_FAILURE;
+      continue;
+    }
+    if (is_width_percent) {
+      windowmove.x = (root_w[geometry[i].screen] * width / 100);
+    }
+    if (is_height_percent) {
+      windowmove.y = (root_h[geometry[i].screen] * height / 100);
+    }
+    windowmove.window = windows[i];
+    if (_windowmove(context, &windowmove,
+                    geometry != NULL ? &geometry[i] : NULL) != 0) {
+      ret = EXIT_FAILURE;
+    }
+  }
 
-        if (is_height_percent) {
-          windowmove.y = (root_h * height / 100);
-        }
-      }
-      windowmove.window = window;
-      _windowmove(context, &windowmove);
-    }); /* window_each(...) */
+  if (!windowmove.opsync && window_batch_end(context, cmd) != XDO_SUCCESS) {
+    ret = EXIT_FAILURE;
+  }
+  free(geometry);
+  free(root_w);
+  free(root_h);
   return ret;
 }
 
-static int _windowmove(context_t *context, struct windowmove *windowmove) {
+/* 'geometry' is the window's geometry if it was read beforehand, else NULL */
+static int _windowmove(context_t *context, struct windowmove *windowmove,
+                       const xdo_window_geometry_t *geometry) {
   int orig_win_x = 0;
   int orig_win_y = 0;
   int ret;
@@ -136,9 +161,14 @@ static int _windowmove(context_t *context, struct windowmove *windowmove) {
    * or if we are moving along an axis.
    * That is, with --sync or x or y in args were literally 'x' or 'y'
    * or if --relative is given*/
-  if (windowmove->opsync || windowmove->flags != 0) {
+  if (geometry != NULL) {
+    orig_win_x = geometry->x;
+    orig_win_y = geometry->y;
+  } else if (windowmove->opsync || windowmove->flags != 0) {
     xdo_get_window_location(context->xdo, windowmove->window,
                             &orig_win_x, &orig_win_y, NULL);
+  }
+  if (windowmove->opsync || windowmove->flags != 0) {
     /* Break early if we don't need to move the window */
     if (orig_win_x == windowmove->x && orig_win_y == windowmove->y) {
       return 0;
@@ -186,7 +216,7 @@ static int _windowmove(context_t *context, struct windowmove *windowmove) {
              && abs(windowmove->y - win_y) > 50) {
         xdo_get_window_location(context->xdo, windowmove->window,
                                 &win_x, &win_y, NULL);
-        usleep(30000);
+        xdotool_usleep(30000);
       }
     }
   }
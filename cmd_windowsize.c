@@ -81,48 +81,70 @@ int cmd_windowsize(context_t *context) {
   height = (unsigned int)strtoul(context->argv[1], NULL, 0);
   consume_args(context, 2);
 
-  XWindowAttributes wattr;
   unsigned int original_w, original_h;
-  unsigned int root_w, root_h; /* for percent */
+  unsigned int *root_w = NULL, *root_h = NULL; /* per screen, for percent */
+  Window *windows;
+  int nwindows, i;
+  xdo_window_geometry_t *geometry = NULL;
+
+  /* Percentages are of the screen each window is on */
+  window_list(context, window_arg, &windows, &nwindows, False);
+  if (is_width_percent || is_height_percent) {
+    window_list_geometry(context, windows, nwindows, &geometry,
+                         &root_w, &root_h);
+  }
+
+  if (!opsync) {
+    xdo_batch_begin(context->xdo);
+  }
 
-  window_each(context, window_arg, {
-    if (is_width_percent || is_height_percent) {
-      Window root = 0;
-      XGetWindowAttributes(context->xdo->xdpy, window, &wattr);
-      root = wattr.root;
-      xdo_get_window_size(context->xdo, root, &root_w, &root_h);
+  for (i = 0; i < nwindows; i++) {
+    Window window = windows[i];
+    unsigned int window_w = width;
+    unsigned int window_h = height;
 
+    if (geometry != NULL) {
+      if (geometry[i].status != XDO_SUCCESS) {
+        fprintf(stderr, "window %ld - failed to get geometry\n", window);
+        ret = EXIT_FAILURE;
+        continue;
+      }
       if (is_width_percent) {
-        width = (root_w * width / 100);
+        window_w = (root_w[geometry[i].screen] * width / 100);
       }
-
       if (is_height_percent) {
-        height = (root_h * height / 100);
+        window_h = (root_h[geometry[i].screen] * height / 100);
       }
     }
 
     if (opsync) {
-      unsigned int w = width;
-      unsigned int h = height;
+      unsigned int w = window_w;
+      unsigned int h = window_h;
       xdo_get_window_size(context->xdo, window, &original_w, &original_h);
-      if (size_flags & SIZE_USEHINTS_X) {
-        xdo_translate_window_with_sizehint(context->xdo, window, w, h, &w, NULL);
-      }
-      if (size_flags & SIZE_USEHINTS_Y) {
-        xdo_translate_window_with_sizehint(context->xdo, window, w, h, NULL, &h);
+      if (size_flags & (SIZE_USEHINTS_X | SIZE_USEHINTS_Y)) {
+        unsigned int hinted_w, hinted_h;
+        xdo_translate_window_with_sizehint(context->xdo, window, w, h,
+                                           &hinted_w, &hinted_h);
+        if (size_flags & SIZE_USEHINTS_X) {
+          w = hinted_w;
+        }
+        if (size_flags & SIZE_USEHINTS_Y) {
+          h = hinted_h;
+        }
       }
 
       if (original_w == w && original_h == h) {
         /* Skip, this window doesn't need to move. */
-        break;
+        continue;
       }
     }
 
-    ret = xdo_set_window_size(context->xdo, window, width, height, size_flags);
-    if (ret) {
+    if (xdo_set_window_size(context->xdo, window, window_w, window_h,
+                            size_flags) != XDO_SUCCESS) {
       fprintf(stderr, "xdo_set_window_size on window:%ld reported an error\n",
               window);
-      return ret;
+      ret = EXIT_FAILURE;
+      continue;
     }
     if (opsync) {
       //xdo_wait_for_window_size(context->xdo, window, width, height, 0,
@@ -130,8 +152,14 @@ int cmd_windowsize(context_t *context) {
       xdo_wait_for_window_size(context->xdo, window, original_w, original_h, 0,
                                SIZE_FROM);
     }
-  }); /* window_each(...) */
+  }
 
+  if (!opsync && window_batch_end(context, cmd) != XDO_SUCCESS) {
+    ret = EXIT_FAILURE;
+  }
+  free(geometry);
+  free(root_w);
+  free(root_h);
   return ret;
 }
 
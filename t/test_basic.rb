@@ -1,6 +1,7 @@
 #!/usr/bin/env ruby
 #
 
+require "json"
 require "minitest"
 require "./xdo_test_helper"
 
@@ -187,6 +188,86 @@ class XdotoolBasicTests < Minitest::Test
     end
   end
 
+  def test_display_list_runs_chain_on_each_display
+    display = ENV["DISPLAY"]
+    status, lines = xdotool_ok "--display #{display},#{display} --output tsv getwindowname #{@wid}"
+    assert_equal(2, lines.length, "Expected one record per display")
+    lines.each do |line|
+      assert_equal([display, @wid.to_s, @title], line.split("\t"))
+    end
+  end # def test_display_list_runs_chain_on_each_display
+
+  def test_display_list_drives_each_server
+    xvfbs = []
+    2.times { xvfbs << start_xvfb("-screen", "0", "640x480x24") }
+    displays = xvfbs.collect { |pid, display| display }
+    xdotool_ok "--display #{displays.join(",")} mousemove --sync 11 22"
+    displays.each do |display|
+      status, lines = xdotool_ok "--display #{display} getmouselocation --shell"
+      assert_equal(["X=11", "Y=22"], lines[0, 2],
+                   "Expected the pointer moved on #{display}")
+    end
+
+    # Only the first display listed
+    xdotool_ok "--display #{displays[0]} mousemove --sync 33 44"
+    status, lines = xdotool_ok "--display #{displays[1]} getmouselocation --shell"
+    assert_equal(["X=11", "Y=22"], lines[0, 2],
+                 "Expected #{displays[1]} left alone")
+
+    status, lines = xdotool "--display #{displays[0]},:999 mousemove 0 0"
+    assert_not_equal(0, status, "Expected failure if any display is missing")
+  ensure
+    xvfbs.each { |pid, display| stop_xvfb(pid) }
+  end # def test_display_list_drives_each_server
+
+  def test_stats_summary_lists_commands_run
+    io = IO.popen({ "XDO_STATS" => "1" },
+                  [@xdotool, "getwindowname", @wid.to_s, "getwindowpid", @wid.to_s],
+                  :err => [:child, :out])
+    lines = io.readlines.collect { |i| i.chomp }
+    io.close
+    assert_equal(0, $?.exitstatus)
+    assert(lines.any? { |l| l =~ /^getwindowname +1 / },
+           "Expected a stats line for getwindowname in #{lines.inspect}")
+    assert(lines.any? { |l| l =~ /^getwindowpid +1 / },
+           "Expected a stats line for getwindowpid in #{lines.inspect}")
+    # One libxdo call each; the property reads inside xdo_get_window_name
+    # are part of its cost, not lines of their own.
+    assert(lines.any? { |l| l =~ /^xdo_get_window_name +1 / },
+           "Expected a stats line for xdo_get_window_name in #{lines.inspect}")
+    assert(lines.any? { |l| l =~ /^xdo_get_pid_window +1 / },
+           "Expected a stats line for xdo_get_pid_window in #{lines.inspect}")
+    assert(lines.none? { |l| l =~ /^xdo_get_window_property_by_atom / },
+           "Expected nested calls to count toward their caller in #{lines.inspect}")
+    total = lines.find { |l| l =~ /^total / }
+    assert_not_nil(total, "Expected a total line in #{lines.inspect}")
+    requests, round_trips, sent, received = total.split[1..4].collect { |i| i.to_i }
+    assert(requests > 0, "Expected requests in #{total}")
+    assert(round_trips > 0, "Expected round trips in #{total}")
+    assert(sent > 0 && received > 0, "Expected byte counts in #{total}")
+  end # def test_stats_summary_lists_commands_run
+
+  def test_latencyprobe_reports_each_kind_of_event
+    status, lines = xdotool_ok "latencyprobe --count 5 --delay 0"
+    %w{key button motion}.each do |kind|
+      assert(lines.any? { |l| l =~ /^#{kind}: \d+ events, \d+ lost/ },
+             "Expected a summary for #{kind} in #{lines.inspect}")
+    end
+  end # def test_latencyprobe_reports_each_kind_of_event
+
+  def test_latencyprobe_output_json
+    status, lines = xdotool_ok "--output=json latencyprobe --count 5 --delay 0"
+    records = lines.collect { |l| JSON.parse(l) }
+    assert_equal(%w{key button motion}, records.collect { |r| r["kind"] })
+    # Keys and buttons are probed with a press and a release each
+    expected = { "key" => 10, "button" => 10, "motion" => 5 }
+    records.each do |r|
+      assert_equal(expected[r["kind"]], r["events"] + r["lost"],
+                   "Unexpected number of probes in #{r.inspect}")
+      assert_operator(r["min_us"], :<=, r["max_us"])
+    end
+  end # def test_latencyprobe_output_json
+
   def test_xdotool_exits_failure_with_bad_flags
     commands = %w{getactivewindow getwindowfocus getwindowpid search click
                   getmouselocation key keydown keyup mousedown mousemove
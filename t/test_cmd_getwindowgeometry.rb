@@ -0,0 +1,41 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolCommandGetWindowGeometryTests < Minitest::Test
+  include XdoTestHelper
+
+  def test_succeeds_with_valid_window
+    status, lines = xdotool_ok "getwindowgeometry --shell #{@wid}"
+    assert_equal(6, lines.length, "Expected six shell variables")
+    assert_equal("WINDOW=#{@wid}", lines[0])
+  end # def test_succeeds_with_valid_window
+
+  def test_fails_without_a_window
+    xdotool_fail "getwindowgeometry"
+    xdotool_fail "getwindowgeometry %1"
+    xdotool_fail "getwindowgeometry %@"
+  end # def test_fails_without_a_window
+
+  def test_format_tsv_matches_shell
+    xdotool_ok "windowmove --sync #{@wid} 50 60"
+    status, shell = xdotool_ok "getwindowgeometry --shell #{@wid}"
+    status, lines = xdotool_ok "getwindowgeometry --format tsv #{@wid}"
+    assert_equal(1, lines.length, "Expected one line per window")
+    values = shell.collect { |l| l.split("=", 2)[1] }
+    assert_equal(values, lines[0].split("\t"))
+  end # def test_format_tsv_matches_shell
+
+  def test_format_json_window_stack
+    status, lines = xdotool_ok "search --name #{@title} getwindowgeometry --format json %@"
+    assert_equal(1, lines.length, "Expected one line per window")
+    assert_match(/^\{"window":#{@wid},"x":-?\d+,"y":-?\d+,"width":\d+,"height":\d+,"screen":\d+\}$/,
+                 lines[0])
+  end # def test_format_json_window_stack
+
+  def test_invalid_format
+    xdotool_fail "getwindowgeometry --format yaml #{@wid}"
+  end # def test_invalid_format
+end # class XdotoolCommandGetWindowGeometryTests
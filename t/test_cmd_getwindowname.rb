@@ -2,6 +2,7 @@
 #
 
 require "minitest"
+require "json"
 require "./xdo_test_helper"
 
 class XdotoolCommandGetWindowPidTests < Minitest::Test
@@ -34,4 +35,23 @@ class XdotoolCommandGetWindowPidTests < Minitest::Test
     status, lines = xdotool_ok "getwindowfocus -f getwindowname %@"
     assert_is_title(lines);
   end # def test_chaining
+
+  def test_output_tsv
+    status, lines = xdotool_ok "--output=tsv getwindowname #{@wid}"
+    assert_equal(["#{@wid}\t#{@title}"], lines)
+  end # def test_output_tsv
+
+  def test_output_json
+    status, lines = xdotool_ok "--output=json getwindowname #{@wid}"
+    assert_equal(["{\"window\":#{@wid},\"name\":\"#{@title}\"}"], lines)
+  end # def test_output_json
+
+  def test_output_json_latin1_name
+    # set_window sets the name as type STRING, which is Latin-1
+    status, lines = xdotool("set_window", "--name", "caf\xE9".b, @wid.to_s)
+    assert_equal(0, status)
+    status, lines = xdotool_ok "--output=json getwindowname #{@wid}"
+    assert_equal(1, lines.length)
+    assert_equal("café", JSON.parse(lines[0])["name"])
+  end # def test_output_json_latin1_name
 end # class XdotoolCommandGetWindowPidTests
@@ -11,6 +11,19 @@ class XdotoolCommandGetWindowPidTests < Minitest::Test
     xdotool_ok "getwindowpid #{@wid}"
   end # def test_succeeds_with_valid_window
 
+  def test_prefers_net_wm_pid
+    runcmd("xprop -id #{@wid} -f _NET_WM_PID 32c -set _NET_WM_PID #{@shellpid}")
+    status, lines = xdotool_ok "getwindowpid #{@wid}"
+    assert_equal([@shellpid.to_s], lines)
+  end # def test_prefers_net_wm_pid
+
+  def test_falls_back_to_connection_owner
+    # Without _NET_WM_PID, X-Resource knows which process created the window
+    runcmd("xprop -id #{@wid} -remove _NET_WM_PID")
+    status, lines = xdotool_ok "getwindowpid #{@wid}"
+    assert_equal([@windowpid.to_s], lines)
+  end # def test_falls_back_to_connection_owner
+
   def test_fails_without_a_window
     xdotool_fail "getwindowpid"
     xdotool_fail "getwindowpid %1"
@@ -0,0 +1,80 @@
+#!/usr/bin/env ruby
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolCommandRecordTests < Minitest::Test
+  include XdoTestHelper
+
+  def setup
+    super
+    @recording = "/tmp/xdotool-test-record-#{Process.pid}.rec"
+  end # def setup
+
+  def teardown
+    File.unlink(@recording) if File.exist?(@recording)
+    super
+  end # def teardown
+
+  # Record for a second while the block makes some input
+  def record
+    recorder = Process.spawn(@xdotool, "record", "--duration", "1", @recording)
+    sleep 0.2
+    yield
+    Process.wait(recorder)
+    assert_equal(0, $?.exitstatus)
+    assert_equal("xdorec2\n", File.binread(@recording, 8))
+  end # def record
+
+  def test_record_and_replay_mouse_motion
+    xdotool_ok "mousemove --sync 0 0"
+    record do
+      xdotool_ok "mousemove --sync 100 100"
+      xdotool_ok "mousemove --sync 250 150"
+    end
+
+    xdotool_ok "mousemove --sync 0 0"
+    xdotool_ok "replay #{@recording}"
+    try do
+      assert_mouse_position(250, 150)
+    end
+  end # def test_record_and_replay_mouse_motion
+
+  # Write a recording of pointer motions, given as [x, y, screen]
+  def write_motions(*motions)
+    motion_notify = 6
+    data = "xdorec2\n"
+    motions.each_with_index do |(x, y, screen), i|
+      data += [i * 10, motion_notify, 0, x, y, screen].pack("VCCvvC")
+    end
+    File.binwrite(@recording, data)
+  end # def write_motions
+
+  def test_replay_moves_on_the_recorded_screen
+    xvfb, display = start_xvfb("-screen", "0", "640x480x24",
+                               "-screen", "1", "640x480x24")
+    xdotool_ok "--display #{display} mousemove --sync --screen 0 0 0"
+    write_motions([50, 60, 0], [120, 80, 1])
+    xdotool_ok "--display #{display} replay #{@recording}"
+    try do
+      status, lines = xdotool_ok "--display #{display} getmouselocation --shell"
+      assert_equal(["X=120", "Y=80", "SCREEN=1"], lines[0, 3])
+    end
+  ensure
+    stop_xvfb(xvfb) if xvfb
+  end # def test_replay_moves_on_the_recorded_screen
+
+  def test_replay_skips_motion_on_missing_screens
+    xdotool_ok "mousemove --sync 10 20"
+    write_motions([30, 40, 0], [200, 200, 7])
+    xdotool_ok "replay #{@recording}"
+    try do
+      assert_mouse_position(30, 40)
+    end
+  end # def test_replay_skips_motion_on_missing_screens
+
+  def test_replay_rejects_other_files
+    File.binwrite(@recording, "not a recording")
+    xdotool_fail "replay #{@recording}"
+  end # def test_replay_rejects_other_files
+end # class XdotoolCommandRecordTests
@@ -20,6 +20,39 @@ class XdotoolCommandWindowMoveTests < Minitest::Test
     xdotool_fail "windowmove 1 1 1" # test invalid window
   end # def test_fails_without_a_window
 
+  def test_moves_every_window_on_the_stack
+    second_wid = setup_launch_second_xterm
+    xdotool_ok "search --name #{@title} windowmove %@ 120 140"
+    [@wid, second_wid].each do |wid|
+      try do
+        geometry = get_window_geometry(wid)
+        assert_in_delta(120, geometry["X"], 10, "Window #{wid} X")
+        assert_in_delta(140, geometry["Y"], 50, "Window #{wid} Y")
+      end
+    end
+  end # def test_moves_every_window_on_the_stack
+
+  def test_destroyed_window_does_not_stop_the_others
+    second_wid = setup_launch_second_xterm
+    # Destroy the second window while the stack still holds it
+    io = IO.popen([@xdotool, "search", "--name", @title, "sleep", "1",
+                   "windowmove", "%@", "120", "140"], :err => [:child, :out])
+    sleep 0.3
+    Process.kill("TERM", @launchpid)
+    Process.wait(@launchpid)
+    @launchpid = nil
+    output = io.readlines.collect { |line| line.chomp }
+    io.close
+    assert_not_equal(0, $?.exitstatus, "Expected the destroyed window to fail")
+    assert_equal(1, output.grep(/window #{second_wid} failed/).length,
+                 "Expected the destroyed window to be reported, got #{output}")
+    try do
+      geometry = get_window_geometry(@wid)
+      assert_in_delta(120, geometry["X"], 10, "The other window should move")
+      assert_in_delta(140, geometry["Y"], 50, "The other window should move")
+    end
+  end # def test_destroyed_window_does_not_stop_the_others
+
   def test_chaining
     xdotool_ok "windowfocus --sync #{@wid}"
     xdotool_ok "getwindowfocus -f windowmove 20 20"
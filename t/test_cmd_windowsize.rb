@@ -20,6 +20,51 @@ class XdotoolCommandWindowSizeTests < Minitest::Test
     xdotool_fail "windowsize 1 1"
   end # def test_fails_without_a_window
 
+  def test_resizes_every_window_on_the_stack
+    second_wid = setup_launch_second_xterm
+    xdotool_ok "search --name #{@title} windowsize %@ 300 200"
+    [@wid, second_wid].each do |wid|
+      try do
+        geometry = get_window_geometry(wid)
+        assert_in_delta(300, geometry["WIDTH"], 20, "Window #{wid} width")
+        assert_in_delta(200, geometry["HEIGHT"], 20, "Window #{wid} height")
+      end
+    end
+
+    # Percentages are of the screen each window is on
+    dimensions = %x{xdpyinfo}.split("\n").grep(/dimensions:/).first.split[1]
+    w, h = dimensions.split("x").collect { |v| v.to_i }
+    xdotool_ok "search --name #{@title} windowsize %@ 50% 50%"
+    [@wid, second_wid].each do |wid|
+      try do
+        geometry = get_window_geometry(wid)
+        assert_in_delta(w / 2, geometry["WIDTH"], 20, "Window #{wid} width")
+        assert_in_delta(h / 2, geometry["HEIGHT"], 20, "Window #{wid} height")
+      end
+    end
+  end # def test_resizes_every_window_on_the_stack
+
+  def test_destroyed_window_does_not_stop_the_others
+    second_wid = setup_launch_second_xterm
+    # Destroy the second window while the stack still holds it
+    io = IO.popen([@xdotool, "search", "--name", @title, "sleep", "1",
+                   "windowsize", "%@", "300", "200"], :err => [:child, :out])
+    sleep 0.3
+    Process.kill("TERM", @launchpid)
+    Process.wait(@launchpid)
+    @launchpid = nil
+    output = io.readlines.collect { |line| line.chomp }
+    io.close
+    assert_not_equal(0, $?.exitstatus, "Expected the destroyed window to fail")
+    assert_equal(1, output.grep(/window #{second_wid} failed/).length,
+                 "Expected the destroyed window to be reported, got #{output}")
+    try do
+      geometry = get_window_geometry(@wid)
+      assert_in_delta(300, geometry["WIDTH"], 20, "The other window should resize")
+      assert_in_delta(200, geometry["HEIGHT"], 20, "The other window should resize")
+    end
+  end # def test_destroyed_window_does_not_stop_the_others
+
   def test_chaining
     #if detect_window_manager == :none
       #print "Skipping windowfocus tests. No WM present."
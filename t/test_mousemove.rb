@@ -48,6 +48,25 @@ class XdotoolMouseMoveTests < Minitest::Test
     end # y_list.each 
   end # def test_mousemove
 
+  def test_mousemove_in_steps
+    %w{line ease curve}.each do |path|
+      xdotool_ok "mousemove --sync 0 0"
+      # hypot(300, 200) is 360.6 pixels, 19 steps of 20 pixels, 18 delays apart
+      start = Time.now
+      xdotool_ok "mousemove --path #{path} --step 20 --delay 2 300 200"
+      assert_operator(Time.now - start, :>=, 0.036,
+                      "Expected #{path} steps to be 2ms apart")
+      try do
+        assert_mouse_position(300, 200)
+      end
+    end
+  end # def test_mousemove_in_steps
+
+  def test_mousemove_rejects_negative_delay
+    xdotool_fail "mousemove --delay -1 10 10"
+    xdotool_fail "mousemove --step 20 --delay -0.5 10 10"
+  end # def test_mousemove_rejects_negative_delay
+
   def test_mousemove_polar
     dimensions = %x{xdpyinfo}.split("\n").grep(/dimensions:/).first.split[1]
     w, h = dimensions.split("x").collect { |v| v.to_i }
@@ -16,6 +16,36 @@ class XdotoolSearchTests < Minitest::Test
     end
   end
 
+  def test_search_pid_prefers_net_wm_pid
+    # A forwarded (ssh -X) or namespaced client says a pid in _NET_WM_PID
+    # that is not the one owning its connection
+    runcmd("xprop -id #{@wid} -f _NET_WM_PID 32c -set _NET_WM_PID #{@shellpid}")
+    try do
+      status, lines = xdotool "search --pid #{@shellpid}"
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal([@wid.to_s], lines,
+                   "Expected the window whose _NET_WM_PID is the shell's")
+    end
+
+    status, lines = xdotool "search --pid #{@windowpid}"
+    assert_equal(1, status,
+                 "The connection owner should not match over _NET_WM_PID")
+  end # def test_search_pid_prefers_net_wm_pid
+
+  def test_search_pid_without_net_wm_pid
+    runcmd("xprop -id #{@wid} -remove _NET_WM_PID")
+    if detect_window_manager == :none
+      # Only windows managed by a window manager are matched by owner
+      runcmd("xprop -id #{@wid} -f WM_STATE 32c -set WM_STATE 1")
+    end
+    try do
+      status, lines = xdotool "search --pid #{@windowpid}"
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal([@wid.to_s], lines,
+                   "Expected the window of the process owning its connection")
+    end
+  end # def test_search_pid_without_net_wm_pid
+
   def test_search_title
     status, lines = xdotool "search --name #{@title}"
     try do
@@ -28,6 +58,32 @@ class XdotoolSearchTests < Minitest::Test
     end
   end
 
+  def test_search_pid_tree
+    # The test process started xterm, so xterm's window is in its tree
+    try do
+      status, lines = xdotool "search --pid-tree #{Process.pid}"
+      assert_equal(0, status, "Exit status should have been 0")
+      assert(lines.include?(@wid.to_s),
+             "Expected the xterm window when searching our own process tree")
+    end
+
+    status, lines = xdotool "search --pid-tree #{@shellpid}"
+    assert_equal(1, status, "xterm is the parent of the shell, not a child")
+  end
+
+  def test_search_xlib_backend_agrees
+    # Pipelined XCB requests and plain Xlib must find the same windows
+    ["--name #{@title}", "--onlyvisible --class xterm", "--pid #{@windowpid}",
+     "--onlyvisible --maxdepth 2 ."].each do |query|
+      status, lines = xdotool "search #{query}"
+      assert_equal(0, status, "Exit status should have been 0 for #{query}")
+      status, xlib_lines = runcmd("env", "XDO_BACKEND=xlib", @xdotool,
+                                  "search", *Shellwords.split(query))
+      assert_equal(0, status, "Exit status should have been 0 for #{query}")
+      assert_equal(lines, xlib_lines, "Both backends should agree on #{query}")
+    end
+  end # def test_search_xlib_backend_agrees
+
   def test_search_onlyvisible_with_pid
     try do
       status, lines = xdotool "search --onlyvisible --pid #{@windowpid}"
@@ -70,6 +126,55 @@ class XdotoolSearchTests < Minitest::Test
     assert_equal(0, lines.length, "Search with --maxdepth 0 should return no results");
   end
 
+  def test_search_limit_returns_shallowest_match
+    # The root's children are all at depth 1, so a breadth-first search with
+    # --limit 1 must return one of them.
+    toplevel = %x{xwininfo -children -root}.split("\n") \
+      .grep(/^ +0x/) \
+      .collect { |l| l[/0x[0-9A-Fa-f]+/].to_i(16) }
+    status, lines = xdotool "search --limit 1 '^'"
+    assert_equal(0, status, "Exit status should have been 0")
+    assert_equal(1, lines.length, "Expected exactly one result with --limit 1")
+    assert(toplevel.include?(lines[0].to_i),
+           "Expected a child of the root window, got #{lines[0]}")
+  end
+
+  def test_search_streams_results
+    # search prints each window as xdo_search_windows_cb reports it, once
+    io = IO.popen({ "XDO_STATS" => "1" },
+                  [@xdotool, "search", "--name", @title],
+                  :err => [:child, :out])
+    lines = io.readlines.collect { |i| i.chomp }
+    io.close
+    assert_equal(0, $?.exitstatus)
+    assert_equal([@wid.to_s], lines.grep(/^\d+$/))
+    assert(lines.any? { |l| l =~ /^xdo_search_windows_cb +1 / },
+           "Expected a stats line for xdo_search_windows_cb in #{lines.inspect}")
+  end # def test_search_streams_results
+
+  def test_search_streamed_limit_and_chain
+    second = setup_launch_second_xterm
+    try do
+      status, lines = xdotool "search --name #{@title}"
+      assert_equal([@wid, second].sort, lines.collect { |l| l.to_i }.sort)
+    end
+
+    # The callback stops being called at the limit
+    status, lines = xdotool_ok "search --limit 1 --name #{@title}"
+    assert_equal(1, lines.length, "Expected exactly one result with --limit 1")
+    assert([@wid, second].include?(lines[0].to_i))
+
+    # Chained, nothing is printed but every window is kept for the next command
+    status, lines = xdotool_ok "search --name #{@title} getwindowname %@"
+    assert_equal(["#{@title}", "#{@title}_second"].sort, lines.sort)
+
+    status, lines = xdotool_ok "search --shell --name #{@title}"
+    assert_equal("WINDOWS=(", lines[0][/^WINDOWS=\(/])
+    assert_equal(")", lines[-1])
+    assert_equal([@wid, second].sort,
+                 [lines[0].sub("WINDOWS=(", ""), lines[1]].collect { |l| l.to_i }.sort)
+  end # def test_search_streamed_limit_and_chain
+
   def test_search_by_name
     name = "name#{rand}"
     status, lines = xdotool "search --name '#{name}'"
@@ -135,6 +240,21 @@ class XdotoolSearchTests < Minitest::Test
     end
   end
   
+  def test_search_all_class_and_classname
+    name = "both#{rand}"
+    xdotool "set_window --class '#{name}' --classname '#{name}' #{@wid}"
+
+    try do
+      status, lines = xdotool "search --all --class --classname '#{name}'"
+      assert_equal(0, status, "Search for class and classname should exit zero")
+      assert_equal([@wid], lines.collect { |l| l.to_i })
+    end
+
+    status, lines = xdotool "search --all --pid #{@windowpid} --name 'nomatch#{rand}'"
+    assert_equal(1, status, "Search with --all should fail if any condition fails")
+    assert_equal(0, lines.length)
+  end
+
   def test_search_can_find_all_windows
     name = "searchall#{rand}"
     windowdata = %x{xwininfo -tree -root}.split("\n") \
@@ -152,6 +272,200 @@ class XdotoolSearchTests < Minitest::Test
                    "Expected same window list from xwininfo and xdotool")
     end # ["name" ... ].each 
   end # def test_search_can_find_all_windows
+
+  def test_search_fixed_and_glob
+    name = "a.b#{rand}"
+    xdotool "set_window --name '#{name}' #{@wid}"
+
+    try do
+      status, lines = xdotool "search --fixed --name '#{name}'"
+      assert_equal(0, status, "Search with --fixed should exit zero")
+      assert_equal([@wid], lines.collect { |l| l.to_i })
+    end
+
+    status, lines = xdotool "search --fixed --name 'a?b'"
+    assert_equal(1, status, "--fixed must not treat '?' specially")
+
+    status, lines = xdotool "search --glob --name 'A?B*'"
+    assert_equal(0, status, "Search with --glob should exit zero")
+    assert(lines.include?(@wid.to_s), "Expected our window from the glob")
+
+    status, lines = xdotool "search --glob --name 'b*'"
+    assert(!lines.include?(@wid.to_s), "Globs match the whole name")
+  end
+
+  def test_search_multi
+    missing = "nonexistent#{rand}"
+    status, lines = xdotool "search --multi --name #{missing} #{@title}"
+    try do
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal(["1 #{@wid}"], lines)
+    end
+
+    status, lines = xdotool "search --multi --name #{missing} #{missing}x"
+    assert_equal(1, status, "Exit status should be 1 when nothing matches")
+    assert_equal(0, lines.length, "Expected no results")
+  end
+
+  def test_search_multi_chained
+    status, lines = xdotool "search --multi --name #{@title} #{@title} getwindowname %@"
+    assert_equal(0, status, "Exit status should have been 0")
+    assert_equal(2, lines.length, "Expected one window per pattern on the stack")
+  end
+
+  def test_search_watch
+    require "timeout"
+    IO.popen([@xdotool, "search", "--watch", "--name", @title]) do |io|
+      Timeout.timeout(10) do
+        assert_equal("+#{@wid}", io.readline.chomp,
+                     "Expected the current match first")
+        xdotool "set_window --name renamed#{rand} #{@wid}"
+        assert_equal("-#{@wid}", io.readline.chomp,
+                     "Expected the window to stop matching after a rename")
+        xdotool "set_window --name #{@title} #{@wid}"
+        assert_equal("+#{@wid}", io.readline.chomp,
+                     "Expected the window to match again")
+      end
+      Process.kill("TERM", io.pid)
+    end
+  end
+
+  def test_search_watch_onlyvisible
+    require "timeout"
+    IO.popen([@xdotool, "search", "--watch", "--onlyvisible",
+              "--name", @title]) do |io|
+      Timeout.timeout(10) do
+        assert_equal("+#{@wid}", io.readline.chomp,
+                     "Expected the current match first")
+        xdotool "windowunmap #{@wid}"
+        assert_equal("-#{@wid}", io.readline.chomp,
+                     "Expected the window to stop matching once unmapped")
+        xdotool "windowmap #{@wid}"
+        assert_equal("+#{@wid}", io.readline.chomp,
+                     "Expected the window to match again once mapped")
+      end
+      Process.kill("TERM", io.pid)
+    end
+  end # def test_search_watch_onlyvisible
+
+  def test_search_watch_invalid_pattern
+    io = IO.popen([@xdotool, "search", "--watch", "--name", "(unclosed"],
+                  :err => [:child, :out])
+    output = io.readlines.collect { |line| line.chomp }
+    io.close
+    assert_not_equal(0, $?.exitstatus, "An invalid regex should fail")
+    assert_equal(1, output.length, "Expected one error, got #{output}")
+    assert_match(/^Failed to compile regex '\(unclosed': /, output[0])
+  end # def test_search_watch_invalid_pattern
+
+  def test_search_toplevel
+    status, lines = xdotool "search --toplevel --name #{@title}"
+    try do
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal([@wid], lines.collect { |l| l.to_i })
+    end
+  end
+
+  def test_search_parallel
+    status, lines = xdotool "search --parallel --name #{@title}"
+    try do
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal([@wid], lines.collect { |l| l.to_i })
+    end
+  end
+
+  # Runs the block with an Xvfb of two screens and an xterm titled
+  # "#{@title}_N" on each screen N, passing the display and the xterm pids
+  def with_two_screens
+    xvfb, display = start_xvfb("-screen", "0", "640x480x24",
+                               "-screen", "1", "640x480x24")
+    xterms = [0, 1].collect do |screen|
+      Process.spawn("xterm", "-display", "#{display}.#{screen}",
+                    "-T", "#{@title}_#{screen}", "-e", "exec sleep 300",
+                    [:out, :err] => "/dev/null")
+    end
+    yield display, xterms
+  ensure
+    xterms.each { |pid| Process.kill("TERM", pid) rescue nil } if xterms
+    stop_xvfb(xvfb) if xvfb
+    xterms.each { |pid| Process.wait(pid) rescue nil } if xterms
+  end # def with_two_screens
+
+  def test_search_parallel_two_screens
+    with_two_screens do |display, xterms|
+      serial = []
+      try do
+        status, serial = xdotool "--display #{display} search --name #{@title}"
+        assert_equal(2, serial.length, "Expected an xterm on each screen")
+      end
+
+      # One thread per screen, printed in the same order as the serial search
+      status, lines = xdotool_ok "--display #{display} search --parallel --name #{@title}"
+      assert_equal(serial, lines)
+      status, lines = xdotool_ok "--display #{display} search --parallel --screen 1 --name #{@title}"
+      assert_equal([serial[1]], lines)
+    end
+  end # def test_search_parallel_two_screens
+
+  def test_search_parallel_pooled_connections
+    # Each screen is searched on a connection from an xdo_pool_t built on
+    # xdotool's own, sharing its keymap and atom tables
+    with_two_screens do |display, xterms|
+      serial = []
+      try do
+        status, serial = xdotool "--display #{display} search --name #{@title}"
+        assert_equal(2, serial.length, "Expected an xterm on each screen")
+      end
+
+      # --pid reads _NET_WM_PID on the pooled connections
+      xterms.each_with_index do |pid, screen|
+        status, lines = xdotool_ok "--display #{display} search --parallel --pid #{pid}"
+        assert_equal([serial[screen]], lines)
+      end
+
+      # Pooled connections keep their own counts, freed with the pool
+      io = IO.popen({ "XDO_STATS" => "1" },
+                    [@xdotool, "--display", display, "search", "--parallel",
+                     "--name", @title, "getwindowname", "%@"],
+                    :err => [:child, :out])
+      lines = io.readlines.collect { |i| i.chomp }
+      io.close
+      assert_equal(0, $?.exitstatus)
+      assert_equal(["#{@title}_0", "#{@title}_1"], lines.grep(/^#{@title}_/))
+      assert(lines.any? { |l| l =~ /^xdo_search_windows_cb +1 / },
+             "Expected one stats line for the search in #{lines.inspect}")
+    end
+  end # def test_search_parallel_pooled_connections
+
+  def test_search_clients
+    # Works from _NET_CLIENT_LIST with a window manager, or falls back to
+    # walking the tree without one.
+    status, lines = xdotool "search --clients --name #{@title}"
+    try do
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal([@wid], lines.collect { |l| l.to_i })
+    end
+  end
+
+  def test_search_output_json
+    status, lines = xdotool "--output=json search --name #{@title}"
+    try do
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal(["{\"window\":#{@wid}}"], lines)
+    end
+  end
+
+  def test_search_output_nul
+    status, lines = xdotool "--output=nul search --name #{@title}"
+    try do
+      assert_equal(0, status, "Exit status should have been 0")
+      assert_equal(["#{@wid}\0"], lines)
+    end
+  end
+
+  def test_search_invalid_output_mode
+    xdotool_fail "--output=yaml search --name #{@title}"
+  end
 end # XdotoolSearchTests
 
 class XdotoolRaceSearchTests < Minitest::Test
@@ -0,0 +1,68 @@
+#!/usr/bin/env ruby
+#
+
+require "json"
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolTraceTests < Minitest::Test
+  include XdoTestHelper
+
+  def setup
+    super
+    @trace = "/tmp/xdotool-test-trace-#{Process.pid}.json"
+    File.unlink(@trace) if File.exist?(@trace)
+  end # def setup
+
+  def teardown
+    File.unlink(@trace) if File.exist?(@trace)
+    super
+  end # def teardown
+
+  def trace(*args)
+    io = IO.popen({ "XDO_TRACE" => @trace }, [@xdotool, *args])
+    io.readlines
+    io.close
+    assert_equal(0, $?.exitstatus)
+  end # def trace
+
+  def trace_events
+    # Trace viewers accept the array without its closing bracket
+    return JSON.parse(File.read(@trace).sub(/,\s*\z/, "") + "]")
+  end # def trace_events
+
+  def test_trace_has_a_span_per_command
+    trace("getwindowname", @wid.to_s, "sleep", "0.01")
+    events = trace_events
+    commands = events.select { |e| e["cat"] == "command" }.map { |e| e["name"] }
+    assert_equal(["getwindowname", "sleep"], commands)
+    assert(events.any? { |e| e["cat"] == "sleep" && e["dur"] >= 10000 },
+           "Expected a span for the sleep in #{events.inspect}")
+  end # def test_trace_has_a_span_per_command
+
+  def test_trace_has_a_span_per_libxdo_call
+    trace("getwindowname", @wid.to_s, "getwindowpid", @wid.to_s)
+    calls = trace_events.select { |e| e["cat"] == "xdo" }
+    assert_equal(["xdo_get_window_name", "xdo_get_pid_window"],
+                 calls.map { |e| e["name"] })
+    calls.each do |e|
+      assert_match(/^\d+ requests, [1-9]\d* round trips$/, e["args"]["detail"])
+    end
+  end # def test_trace_has_a_span_per_libxdo_call
+
+  def test_trace_appends_to_an_existing_file
+    trace("getwindowname", @wid.to_s)
+    trace("getwindowpid", @wid.to_s)
+    events = trace_events
+    commands = events.select { |e| e["cat"] == "command" }.map { |e| e["name"] }
+    assert_equal(["getwindowname", "getwindowpid"], commands)
+    assert_equal(2, events.map { |e| e["pid"] }.uniq.length,
+                 "Expected each run as its own process in #{events.inspect}")
+  end # def test_trace_appends_to_an_existing_file
+
+  def test_trace_includes_exec_children
+    trace("exec", "--sync", @xdotool, "getwindowname", @wid.to_s)
+    commands = trace_events.select { |e| e["cat"] == "command" }.map { |e| e["name"] }
+    assert_equal(["getwindowname", "exec"], commands)
+  end # def test_trace_includes_exec_children
+end # class XdotoolTraceTests
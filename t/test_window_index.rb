@@ -0,0 +1,95 @@
+#!/usr/bin/env ruby
+
+require "minitest"
+require "./xdo_test_helper"
+
+# xdo_window_index_t has no xdotool command of its own, so these tests
+# drive it through the small program in window_index.c.
+class XdotoolWindowIndexTests < Minitest::Test
+  include XdoTestHelper
+
+  HELPER = "/tmp/xdotool-test-window-index-#{Process.pid}"
+
+  def setup
+    super
+    if !File.exist?(HELPER)
+      system("cc", "-I..", "-o", HELPER, "window_index.c", "-L..", "-lxdo",
+             "-lX11")
+      assert_equal(0, $?.exitstatus, "Expected window_index.c to build")
+    end
+    @index = IO.popen([HELPER], "r+")
+    assert_equal("ready\n", @index.gets)
+  end # def setup
+
+  def teardown
+    @index.close if @index
+    super
+  end # def teardown
+
+  Minitest.after_run { File.unlink(HELPER) if File.exist?(HELPER) }
+
+  # Send one command to the helper and return the lines it printed
+  def index(command)
+    @index.puts(command)
+    @index.flush
+    lines = []
+    while (line = @index.gets.chomp) != "."
+      lines << line
+    end
+    return lines
+  end # def index
+
+  def index_search(field, pattern)
+    return index("#{field} #{pattern}").collect { |l| l.to_i }
+  end # def index_search
+
+  # What a full search of the window tree finds
+  def tree_search(field, pattern)
+    status, lines = xdotool("search", "--#{field}", pattern)
+    assert_equal(0, status, "Expected search --#{field} #{pattern} to succeed")
+    return lines.collect { |l| l.to_i }.sort
+  end # def tree_search
+
+  def test_finds_windows_by_name_and_class
+    assert_equal([@wid], index_search("name", @title))
+    assert_equal([@wid], index_search("fixed", @title))
+    classes = index_search("class", "xterm")
+    assert_includes(classes, @wid)
+    assert_equal(tree_search("class", "xterm"), classes.sort)
+    assert_equal([], index_search("name", "#{@title}_nothing_has_this"))
+  end # def test_finds_windows_by_name_and_class
+
+  def test_folds_case_like_a_tree_search
+    assert_equal([@wid], index_search("name", @title.upcase))
+    assert_equal([@wid], index_search("fixed", @title.swapcase))
+    assert_includes(index_search("classname", "XTERM"), @wid)
+  end # def test_folds_case_like_a_tree_search
+
+  def test_short_patterns_check_every_window
+    # Under three characters there is no trigram to narrow by
+    %w{Xd xd o}.each do |pattern|
+      found = index_search("name", pattern)
+      assert_includes(found, @wid, "Expected '#{pattern}' to find #{@wid}")
+      assert_equal(tree_search("name", pattern), found.sort)
+    end
+    assert_includes(index_search("fixed", @title[0, 2]), @wid)
+  end # def test_short_patterns_check_every_window
+
+  def test_update_follows_created_and_destroyed_windows
+    assert_equal([], index_search("name", "#{@title}_second"))
+    wid = setup_launch_second_xterm
+    try do
+      assert_equal([], index("update"))
+      assert_equal([wid], index_search("name", "#{@title}_second"))
+    end
+
+    Process.kill("TERM", @launchpid)
+    Process.wait(@launchpid)
+    @launchpid = nil
+    try do
+      assert_equal([], index("update"))
+      assert_equal([], index_search("name", "#{@title}_second"))
+    end
+    assert_equal([@wid], index_search("name", @title))
+  end # def test_update_follows_created_and_destroyed_windows
+end # class XdotoolWindowIndexTests
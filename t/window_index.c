@@ -0,0 +1,84 @@
+/* Drives an xdo_window_index_t for test_window_index.rb.
+ *
+ * Build with:
+ * cc -I.. -o window_index window_index.c -L.. -lxdo -lX11
+ *
+ * Prints "ready" once the index is built, then reads one command per line
+ * from stdin:
+ *   name|class|classname|fixed PATTERN - search the index, printing each
+ *     matching window; 'fixed' is a plain-text name search
+ *   update - apply pending events with xdo_window_index_update
+ * The output for each command ends with a line holding only ".".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdo.h"
+
+static void search(xdo_window_index_t *index, const char *field,
+                   const char *pattern) {
+  xdo_search_t query;
+  Window *windows = NULL;
+  unsigned int nwindows = 0;
+  unsigned int i;
+
+  memset(&query, 0, sizeof(query));
+  query.max_depth = -1;
+  query.require = SEARCH_ANY;
+  if (!strcmp(field, "class")) {
+    query.searchmask = SEARCH_CLASS;
+    query.winclass = pattern;
+  } else if (!strcmp(field, "classname")) {
+    query.searchmask = SEARCH_CLASSNAME;
+    query.winclassname = pattern;
+  } else if (!strcmp(field, "fixed")) {
+    query.searchmask = SEARCH_NAME | SEARCH_FIXED;
+    query.winname = pattern;
+  } else {
+    query.searchmask = SEARCH_NAME;
+    query.winname = pattern;
+  }
+
+  if (xdo_window_index_search(index, &query, &windows, &nwindows)
+      != XDO_SUCCESS) {
+    printf("error\n");
+  }
+  for (i = 0; i < nwindows; i++) {
+    printf("%lu\n", windows[i]);
+  }
+  free(windows);
+}
+
+int main(void) {
+  xdo_t *xdo = xdo_new(NULL);
+  xdo_window_index_t *index;
+  char line[1024];
+
+  if (xdo == NULL) {
+    return 1;
+  }
+  index = xdo_window_index_new(xdo);
+  printf("ready\n");
+  fflush(stdout);
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    char *pattern;
+
+    line[strcspn(line, "\n")] = '\0';
+    pattern = strchr(line, ' ');
+    if (pattern != NULL) {
+      *pattern++ = '\0';
+      search(index, line, pattern);
+    } else if (!strcmp(line, "update")) {
+      xdo_window_index_update(index);
+    }
+    printf(".\n");
+    fflush(stdout);
+  }
+
+  xdo_window_index_free(index);
+  xdo_free(xdo);
+  return 0;
+}
@@ -40,7 +40,41 @@ module XdoTestHelper
       healthy = (status == 0)
     end
   end # def setup_launch_xterm
+
+  # Start another xterm whose title starts with @title, so that
+  # 'search --name @title' finds both. Returns its window id.
+  def setup_launch_second_xterm
+    setup_launch("xterm", "-T", "#{@title}_second", "-e", "exec sleep 300")
+    wids = []
+    try do
+      status, wids = runcmd(@xdotool, "search", "--name", "#{@title}_second")
+      assert_equal(1, wids.length, "Expected the second xterm to show up")
+    end
+    return wids[0].to_i
+  end # def setup_launch_second_xterm
   
+  # Start another Xvfb on a free display, for tests that need more than the
+  # X server the tests run on. Returns its pid and display name; kill it
+  # when done.
+  def start_xvfb(*args)
+    num = 50
+    num += 1 while File.exist?("/tmp/.X11-unix/X#{num}") ||
+                   File.exist?("/tmp/.X#{num}-lock")
+    display = ":#{num}"
+    pid = Process.spawn("Xvfb", display, "-ac", *args,
+                        [:out, :err] => "/dev/null")
+    try(:times => 20) do
+      system("xdpyinfo", "-display", display, [:out, :err] => "/dev/null")
+      assert_equal(0, $?.exitstatus, "Xvfb on #{display} should be up")
+    end
+    return pid, display
+  end # def start_xvfb
+
+  def stop_xvfb(pid)
+    Process.kill("TERM", pid) rescue nil
+    Process.wait(pid) rescue nil
+  end # def stop_xvfb
+
   def setup_ensure_x_is_healthy
     healthy = false
     (1 .. 10).each do
@@ -168,6 +202,16 @@ module XdoTestHelper
     return mx, my
   end # def get_mouse_position
 
+  def get_window_geometry(wid)
+    status, lines = xdotool "getwindowgeometry --shell #{wid}"
+    geometry = {}
+    lines.each do |line|
+      key, value = line.split("=", 2)
+      geometry[key] = value.to_i
+    end
+    return geometry
+  end # def get_window_geometry
+
   def assert_mouse_position(x, y)
     mx, my = get_mouse_position
     assert_equal(mx, x, "Mouse X position expected to be #{x}, was #{mx}")
@@ -11,6 +11,12 @@
 #endif /* _XOPEN_SOURCE */
 
 #include <sys/select.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -19,21 +25,31 @@
 #include <regex.h>
 #include <ctype.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdarg.h>
 
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/XKBlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xresource.h>
 #include <X11/Xutil.h>
+#include <X11/Xproto.h>
 #include <X11/extensions/XTest.h>
+#include <X11/extensions/record.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/XRes.h>
 #include <X11/keysym.h>
 #include <X11/cursorfont.h>
 
 #include <xkbcommon/xkbcommon.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 
 #include "xdo.h"
+#include "xdo_async.h"
+#include "xdo_errors.h"
+#include "xdo_stats.h"
 #include "xdo_util.h"
 #include "xdo_version.h"
 
@@ -49,7 +65,10 @@ static const char *vmodnames(Display *dpy, XkbDescPtr desc, short vmods);
 static const char *modnames(short mask);
 
 static void _xdo_populate_charcode_map(xdo_t *xdo);
+static xdo_t *_xdo_new(Display *xdpy, int close_display_when_freed,
+                       const xdo_t *shared);
 static int _xdo_has_xtest(const xdo_t *xdo);
+static int _xdo_has_xres(const xdo_t *xdo);
 
 static KeySym _xdo_keysym_from_char(const xdo_t *xdo, wchar_t key);
 static void _xdo_charcodemap_from_char(const xdo_t *xdo, charcodemap_t *key);
@@ -70,18 +89,121 @@ static int _xdo_query_keycode_to_modifier(XModifierKeymap *modmap, KeyCode keyco
 static int _xdo_mousebutton(const xdo_t *xdo, Window window, int button, int is_press);
 
 static int _is_success(const char *funcname, int code, const xdo_t *xdo);
+static void _xdo_flush(const xdo_t *xdo);
+static int _xdo_window_root(const xdo_t *xdo, Window window, Window *root_ret,
+                            int *screen_ret);
+static int _xdo_error_handler(Display *dpy, XErrorEvent *xerr);
+static int _xdo_stats_after(Display *xdpy);
+static void _xdo_trace_write(const char *category, const char *name,
+                             double start, double duration,
+                             const char *detail);
 static void _xdo_debug(const xdo_t *xdo, const char *format, ...);
 static void _xdo_eprintf(const xdo_t *xdo, int hushable, const char *format, ...);
 
 /* context-free functions */
 static wchar_t _keysym_to_char(KeySym keysym);
 
-/* Default to -1, initialize it when we need it */
-static Atom atom_NET_WM_PID = -1;
-static Atom atom_NET_WM_NAME = -1;
-static Atom atom_WM_NAME = -1;
-static Atom atom_STRING = -1;
-static Atom atom_UTF8_STRING = -1;
+/* Atoms interned once per xdo_t, when it is created. The table is never
+ * written afterwards, so connections of an xdo_pool_t share it. */
+enum {
+  XDO_ATOM_NET_WM_PID,
+  XDO_ATOM_NET_WM_NAME,
+  XDO_ATOM_WM_NAME,
+  XDO_NATOMS
+};
+static const char *atom_names[XDO_NATOMS] = {
+  "_NET_WM_PID", "_NET_WM_NAME", "WM_NAME",
+};
+
+/* A connection per thread, see xdo_pool_new */
+struct xdo_pool {
+  char *display;
+  const xdo_t *base; /* has the keymap and atoms the connections share */
+  xdo_t *owned;      /* 'base', if the pool opened it */
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  xdo_t **xdos;
+  unsigned int nxdos;
+  unsigned int size;
+};
+
+/* Errors for one connection, see xdo_errors.h. Requests are told apart by
+ * sequence number: a scope covers everything sent since it began, and a tag
+ * everything a libxdo call sent, up to the next tag. */
+typedef struct {
+  unsigned long serial; /* first request of the scope */
+  int ignore_badwindow;
+} error_scope_t;
+
+typedef struct {
+  unsigned long serial; /* first request the call sent */
+  const char *call;
+  Window window;
+} request_tag_t;
+
+struct xdo_error_log {
+  struct xdo_error_log *next; /* in error_logs while collecting */
+  Display *xdpy;
+  error_scope_t *scopes;
+  unsigned int nscopes;
+  unsigned int scopes_size;
+  request_tag_t *tags;
+  unsigned int ntags;
+  unsigned int tags_size;
+  xdo_batch_error_t *errors; /* in the order they arrived, which is by serial */
+  unsigned int nerrors;
+  unsigned int errors_size;
+};
+
+/* _NET_SUPPORTED for an open batch, see _xdo_ewmh_is_supported */
+struct xdo_ewmh_supported {
+  int fetched;
+  Atom *atoms;
+  long natoms;
+};
+
+/* Xlib error handlers are process-wide and carry no user data, so the
+ * handler finds the log for an error's Display in this list. It is
+ * installed while any log is collecting, and the program's own handler is
+ * put back when the last one stops. */
+static pthread_mutex_t error_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct xdo_error_log *error_logs = NULL;
+static unsigned int error_users = 0;
+static int error_handler_suspended = False;
+static XErrorHandler error_handler_saved = NULL;
+
+/* What one connection has cost, see xdo_stats.h */
+struct xdo_stats_log {
+  struct xdo_stats_log *next; /* in stats_logs */
+  Display *xdpy;
+  int (*after_saved)(Display *); /* the after-function replaced by ours */
+  unsigned long checked_request; /* NextRequest at the last check */
+  unsigned long checked_read;    /* LastKnownRequestProcessed then */
+  unsigned long round_trips;
+  unsigned int depth;            /* public calls in progress */
+  xdo_stat_t *calls;
+  unsigned int ncalls;
+  unsigned int calls_size;
+};
+
+/* The Xlib after-function only gets the Display, so it finds its log here.
+ * It is only installed on connections that are counting, so nothing takes
+ * the lock while XDO_STATS and XDO_TRACE are off. */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct xdo_stats_log *stats_logs = NULL;
+
+/* Whether xdo_init_threads got Xlib to lock itself. Xlib has no public
+ * way to ask, and libxdo only relies on what it was told here. */
+static pthread_once_t threads_once = PTHREAD_ONCE_INIT;
+static int threads_ok = False;
+
+/* The XDO_TRACE file, opened by the first xdo_trace_now() in the process.
+ * Processes forked after that share it, so each event is one write(2). */
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static int trace_fd = -1;
+static pthread_key_t trace_tid_key;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long trace_tids = 0;
 
 xdo_t* xdo_new(const char *display_name) {
   Display *xdpy;
@@ -110,14 +232,24 @@ xdo_t* xdo_new(const char *display_name) {
 
 xdo_t* xdo_new_with_opened_display(Display *xdpy, const char *display,
                                    int close_display_when_freed) {
-  xdo_t *xdo = NULL;
-
   if (xdpy == NULL) {
     /* Can't use _xdo_eprintf yet ... */
     fprintf(stderr, "xdo_new: xdisplay I was given is a null pointer\n");
     return NULL;
   }
 
+  (void)display;
+  return _xdo_new(xdpy, close_display_when_freed, NULL);
+}
+
+static xdo_t *_xdo_new(Display *xdpy, int close_display_when_freed,
+                       const xdo_t *shared) {
+  /* With 'shared', take the keymap, atoms and features from it rather than
+   * asking the server again; they are the same for every connection. */
+  xdo_t *xdo = NULL;
+  const char *backend;
+  const char *stats;
+
   /* XXX: Check for NULL here */
   xdo = malloc(sizeof(xdo_t));
   memset(xdo, 0, sizeof(xdo_t));
@@ -125,10 +257,6 @@ xdo_t* xdo_new_with_opened_display(Display *xdpy, const char *display,
   xdo->xdpy = xdpy;
   xdo->close_display_when_freed = close_display_when_freed;
 
-  if (display == NULL) {
-    display = "unknown";
-  }
-
   if (getenv("XDO_QUIET")) {
     xdo->quiet = True;
   }
@@ -137,6 +265,27 @@ xdo_t* xdo_new_with_opened_display(Display *xdpy, const char *display,
     xdo->debug = True;
   }
 
+  xdo->error_log = _xdo_error_log_new(xdpy);
+  xdo->threads = threads_ok;
+
+  stats = getenv("XDO_STATS");
+  if ((stats != NULL && *stats != '\0' && strcmp(stats, "0") != 0)
+      || xdo_trace_now() != 0) {
+    xdo->stats_log = _xdo_stats_log_new(xdpy);
+  }
+
+  if (shared != NULL) {
+    xdo->charcodes = shared->charcodes;
+    xdo->charcodes_len = shared->charcodes_len;
+    xdo->keycode_high = shared->keycode_high;
+    xdo->keycode_low = shared->keycode_low;
+    xdo->keysyms_per_keycode = shared->keysyms_per_keycode;
+    xdo->atoms = shared->atoms;
+    xdo->features_mask = shared->features_mask;
+    xdo->shared = True;
+    return xdo;
+  }
+
   if (_xdo_has_xtest(xdo)) {
     xdo_enable_feature(xdo, XDO_FEATURE_XTEST);
     _xdo_debug(xdo, "XTEST enabled.");
@@ -147,61 +296,183 @@ xdo_t* xdo_new_with_opened_display(Display *xdpy, const char *display,
     xdo_disable_feature(xdo, XDO_FEATURE_XTEST);
   }
 
+  backend = getenv("XDO_BACKEND");
+  if (backend != NULL && strcmp(backend, "xlib") == 0) {
+    xdo_disable_feature(xdo, XDO_FEATURE_XCB);
+    _xdo_debug(xdo, "XCB pipelining disabled, using plain Xlib.");
+  } else {
+    xdo_enable_feature(xdo, XDO_FEATURE_XCB);
+  }
+
+  /* All in one round trip */
+  xdo->atoms = calloc(XDO_NATOMS, sizeof(Atom));
+  XInternAtoms(xdpy, (char **)atom_names, XDO_NATOMS, False, xdo->atoms);
+
   _xdo_populate_charcode_map(xdo);
   return xdo;
-}
+} /* xdo_t *_xdo_new */
 
 void xdo_free(xdo_t *xdo) {
   if (xdo == NULL)
     return;
 
+  if (xdo->batch) {
+    xdo_batch_end(xdo, NULL, NULL);
+  }
+
+  /* Outstanding queries are dropped without calling back */
+  while (xdo->async_head != NULL) {
+    xdo_async_t *async = xdo->async_head;
+    xdo->async_head = async->next;
+    async->free(async);
+    free(async);
+  }
+
+  _xdo_error_log_free(xdo->error_log);
+  if (xdo->stats_log != NULL) {
+    _xdo_stats_log_free(xdo->stats_log);
+  }
   free(xdo->display_name);
-  free(xdo->charcodes);
+  if (!xdo->shared) {
+    free(xdo->charcodes);
+    free(xdo->atoms);
+  }
   if (xdo->xdpy && xdo->close_display_when_freed)
     XCloseDisplay(xdo->xdpy);
 
   free(xdo);
 }
 
+static void _xdo_init_threads_once(void) {
+  threads_ok = (XInitThreads() != 0);
+} /* void _xdo_init_threads_once */
+
+int xdo_init_threads(void) {
+  pthread_once(&threads_once, _xdo_init_threads_once);
+  return threads_ok;
+} /* int xdo_init_threads */
+
+xdo_pool_t *xdo_pool_new(const char *display) {
+  xdo_pool_t *pool;
+  xdo_t *base;
+
+  /* Must come before anything else talks to Xlib */
+  xdo_init_threads();
+
+  base = xdo_new(display);
+  if (base == NULL) {
+    return NULL;
+  }
+
+  pool = xdo_pool_new_with_xdo(base);
+  pool->owned = base;
+  return pool;
+} /* xdo_pool_t *xdo_pool_new */
+
+xdo_pool_t *xdo_pool_new_with_xdo(const xdo_t *xdo) {
+  xdo_pool_t *pool = calloc(1, sizeof(xdo_pool_t));
+
+  pool->base = xdo;
+  pool->display = strdup(DisplayString(xdo->xdpy));
+  pool->size = 8;
+  pool->xdos = calloc(pool->size, sizeof(xdo_t *));
+  pthread_key_create(&pool->key, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  return pool;
+} /* xdo_pool_t *xdo_pool_new_with_xdo */
+
+xdo_t *xdo_pool_get(xdo_pool_t *pool) {
+  xdo_t *xdo = pthread_getspecific(pool->key);
+  Display *xdpy;
+
+  if (xdo != NULL) {
+    return xdo;
+  }
+
+  /* First call on this thread: open its own connection */
+  xdpy = XOpenDisplay(pool->display);
+  if (xdpy == NULL) {
+    return NULL;
+  }
+  xdo = _xdo_new(xdpy, True, pool->base);
+  pthread_setspecific(pool->key, xdo);
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->nxdos == pool->size) {
+    pool->size *= 2;
+    pool->xdos = realloc(pool->xdos, pool->size * sizeof(xdo_t *));
+  }
+  pool->xdos[pool->nxdos++] = xdo;
+  pthread_mutex_unlock(&pool->lock);
+  return xdo;
+} /* xdo_t *xdo_pool_get */
+
+void xdo_pool_free(xdo_pool_t *pool) {
+  unsigned int i;
+
+  if (pool == NULL)
+    return;
+
+  /* The shared tables belong to 'base', so it goes last */
+  for (i = 0; i < pool->nxdos; i++) {
+    xdo_free(pool->xdos[i]);
+  }
+  xdo_free(pool->owned);
+
+  pthread_key_delete(pool->key);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->xdos);
+  free(pool->display);
+  free(pool);
+} /* void xdo_pool_free */
+
 const char *xdo_version(void) {
   return XDO_VERSION;
 }
 
 int xdo_wait_for_window_map_state(const xdo_t *xdo, Window wid, int map_state) {
+  XDO_CALL(xdo);
   int tries = MAX_TRIES;
   XWindowAttributes attr;
   attr.map_state = IsUnmapped;
   while (tries > 0 && attr.map_state != map_state) {
     XGetWindowAttributes(xdo->xdpy, wid, &attr);
-    usleep(30000); /* TODO(sissel): Use exponential backoff up to 1 second */
+    _xdo_usleep(__func__, 30000); /* TODO(sissel): Use exponential backoff up to 1 second */
     tries--;
   }
   return 0;
 }
 
 int xdo_map_window(const xdo_t *xdo, Window wid) {
+  XDO_CALL(xdo);
   int ret = 0;
+  _xdo_errors_tag(xdo, __func__, wid);
   ret = XMapWindow(xdo->xdpy, wid);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XMapWindow", ret == 0, xdo);
 }
 
 int xdo_unmap_window(const xdo_t *xdo, Window wid) {
+  XDO_CALL(xdo);
   int ret = 0;
+  _xdo_errors_tag(xdo, __func__, wid);
   ret = XUnmapWindow(xdo->xdpy, wid);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XUnmapWindow", ret == 0, xdo);
 }
 
 int xdo_reparent_window(const xdo_t *xdo, Window wid_source, Window wid_target) {
+  XDO_CALL(xdo);
   int ret = 0;
+  _xdo_errors_tag(xdo, __func__, wid_source);
   ret = XReparentWindow(xdo->xdpy, wid_source, wid_target, 0, 0);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XReparentWindow", ret == 0, xdo);
 }
 
 int xdo_get_window_location(const xdo_t *xdo, Window wid,
                             int *x_ret, int *y_ret, Screen **screen_ret) {
+  XDO_CALL(xdo);
   int ret;
   XWindowAttributes attr;
   ret = XGetWindowAttributes(xdo->xdpy, wid, &attr);
@@ -226,7 +497,7 @@ int xdo_get_window_location(const xdo_t *xdo, Window wid,
       y = attr.y;
     } else {
       XTranslateCoordinates(xdo->xdpy, wid, attr.root,
-                            0, 0, &x, &y, &unused_child);
+                0, 0, &x, &y, &unused_child);
     }
 
     if (x_ret != NULL) {
@@ -246,6 +517,7 @@ int xdo_get_window_location(const xdo_t *xdo, Window wid,
 
 int xdo_get_window_size(const xdo_t *xdo, Window wid, unsigned int *width_ret,
                         unsigned int *height_ret) {
+  XDO_CALL(xdo);
   int ret;
   XWindowAttributes attr;
   ret = XGetWindowAttributes(xdo->xdpy, wid, &attr);
@@ -261,9 +533,470 @@ int xdo_get_window_size(const xdo_t *xdo, Window wid, unsigned int *width_ret,
   return _is_success("XGetWindowAttributes", ret == 0, xdo);
 }
 
+int xdo_get_windows_geometry(const xdo_t *xdo, const Window *windows,
+                             unsigned int nwindows,
+                             xdo_window_geometry_t *geometry_ret) {
+  XDO_CALL(xdo);
+  /* Xlib only lets us wait for one reply at a time, so talk XCB on the same
+   * connection: send every request first, then collect the replies. */
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  xcb_get_geometry_cookie_t *geometry_cookies;
+  xcb_query_tree_cookie_t *tree_cookies;
+  xcb_translate_coordinates_cookie_t *translate_cookies;
+  xcb_query_tree_reply_t **trees;
+  const int screencount = ScreenCount(xdo->xdpy);
+  struct timespec start;
+  unsigned int i;
+  int s;
+  int ret = XDO_SUCCESS;
+
+  if (nwindows == 0) {
+    return XDO_SUCCESS;
+  }
+
+  geometry_cookies = calloc(nwindows, sizeof(*geometry_cookies));
+  tree_cookies = calloc(nwindows, sizeof(*tree_cookies));
+  translate_cookies = calloc(nwindows, sizeof(*translate_cookies));
+  trees = calloc(nwindows, sizeof(*trees));
+
+  /* Like xdo_get_window_location, we need the parent (XQueryTree) to decide
+   * whether the position is already root-relative. With a single screen the
+   * root is known up front, so the translation can go out right away. */
+  for (i = 0; i < nwindows; i++) {
+    geometry_cookies[i] = xcb_get_geometry(xcb, windows[i]);
+    tree_cookies[i] = xcb_query_tree(xcb, windows[i]);
+    if (screencount == 1) {
+      translate_cookies[i] = xcb_translate_coordinates(xcb, windows[i],
+          DefaultRootWindow(xdo->xdpy), 0, 0);
+    }
+  }
+
+  /* Counted as one round trip, however many replies it is */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < nwindows; i++) {
+    xdo_window_geometry_t *geometry = &geometry_ret[i];
+    xcb_get_geometry_reply_t *reply;
+    xcb_generic_error_t *error = NULL;
+
+    memset(geometry, 0, sizeof(*geometry));
+    geometry->window = windows[i];
+    geometry->status = XDO_ERROR;
+
+    reply = xcb_get_geometry_reply(xcb, geometry_cookies[i], &error);
+    trees[i] = xcb_query_tree_reply(xcb, tree_cookies[i], NULL);
+    free(error);
+    if (reply == NULL || trees[i] == NULL) {
+      free(reply);
+      continue;
+    }
+
+    geometry->x = reply->x;
+    geometry->y = reply->y;
+    geometry->width = reply->width;
+    geometry->height = reply->height;
+    geometry->status = XDO_SUCCESS;
+    for (s = 0; s < screencount; s++) {
+      if (RootWindow(xdo->xdpy, s) == reply->root) {
+        geometry->screen = s;
+      }
+    }
+
+    /* Now that we know its root, queue this window's translation. */
+    if (screencount > 1) {
+      translate_cookies[i] = xcb_translate_coordinates(xcb, windows[i],
+          reply->root, 0, 0);
+    }
+    free(reply);
+  }
+  _xdo_stats_waited(xdo, "xcb_get_geometry", __func__, &start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < nwindows; i++) {
+    xdo_window_geometry_t *geometry = &geometry_ret[i];
+    xcb_translate_coordinates_reply_t *translated = NULL;
+
+    /* With several screens, the translation was only sent for windows whose
+     * geometry came back, so there is no reply to collect for the rest. */
+    if (screencount == 1 || geometry->status == XDO_SUCCESS) {
+      translated = xcb_translate_coordinates_reply(xcb, translate_cookies[i],
+                                                   NULL);
+    }
+
+    if (geometry->status == XDO_SUCCESS
+        && trees[i]->parent != RootWindow(xdo->xdpy, geometry->screen)) {
+      if (translated != NULL) {
+        geometry->x = translated->dst_x;
+        geometry->y = translated->dst_y;
+      } else {
+        geometry->status = XDO_ERROR;
+      }
+    }
+
+    if (geometry->status != XDO_SUCCESS) {
+      ret = XDO_ERROR;
+    }
+    free(translated);
+    free(trees[i]);
+  }
+  if (screencount > 1) {
+    _xdo_stats_waited(xdo, "xcb_translate_coordinates", __func__,
+                      &start);
+  }
+
+  free(geometry_cookies);
+  free(tree_cookies);
+  free(translate_cookies);
+  free(trees);
+  return ret;
+}
+
+/* The requests of a simple asynchronous query, all sent up front except
+ * for the odd follow-up. Replies are taken in the order they were sent. */
+typedef struct async_requests {
+  Window window;
+  Atom atom; /* interned up front, so polling never waits on the server */
+  unsigned int sequences[3];
+  void *replies[3];
+  unsigned int nsent;
+  unsigned int ntaken;
+} async_requests_t;
+
+xdo_async_t *_xdo_async_submit(xdo_t *xdo,
+                               int (*poll)(xdo_t *, xdo_async_t *),
+                               void (*free_fn)(xdo_async_t *),
+                               void *data, xdo_async_cb_t callback,
+                               void *userdata) {
+  xdo_async_t *async = calloc(1, sizeof(xdo_async_t));
+
+  async->poll = poll;
+  async->free = free_fn;
+  async->data = data;
+  async->callback = callback;
+  async->userdata = userdata;
+
+  if (xdo->async_tail != NULL) {
+    xdo->async_tail->next = async;
+  } else {
+    xdo->async_head = async;
+  }
+  xdo->async_tail = async;
+
+  /* XCB buffers requests; get them to the server now */
+  xcb_flush(XGetXCBConnection(xdo->xdpy));
+  return async;
+} /* xdo_async_t *_xdo_async_submit */
+
+int _xdo_async_reply(const xdo_t *xdo, unsigned int sequence, int block,
+                     void **reply_ret, const char *call) {
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  xcb_generic_error_t *error = NULL;
+  struct timespec start;
+
+  *reply_ret = NULL;
+  if (xcb_poll_for_reply(xcb, sequence, reply_ret, &error)) {
+    /* Already here */
+  } else if (block) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    *reply_ret = xcb_wait_for_reply(xcb, sequence, &error);
+    _xdo_stats_waited(xdo, "xcb_wait_for_reply", call, &start);
+  } else {
+    return False;
+  }
+  free(error);
+  return True;
+} /* int _xdo_async_reply */
+
+int xdo_async_fd(const xdo_t *xdo) {
+  return ConnectionNumber(xdo->xdpy);
+} /* int xdo_async_fd */
+
+int xdo_async_dispatch(xdo_t *xdo) {
+  XDO_CALL(xdo);
+  xdo_async_t *async;
+  int outstanding = 0;
+
+  /* Every query takes its replies and sends what comes next, so one that
+   * needs several round trips does not hold up the requests of the others */
+  for (async = xdo->async_head; async != NULL; async = async->next) {
+    if (!async->done) {
+      async->done = async->poll(xdo, async);
+    }
+  }
+  xcb_flush(XGetXCBConnection(xdo->xdpy));
+
+  /* ... but they complete in the order they were started */
+  while (xdo->async_head != NULL && xdo->async_head->done) {
+    async = xdo->async_head;
+    xdo->async_head = async->next;
+    if (xdo->async_head == NULL) {
+      xdo->async_tail = NULL;
+    }
+    if (async->callback != NULL) {
+      async->callback(xdo, &async->result, async->userdata);
+    }
+    async->free(async);
+    free(async);
+  }
+
+  for (async = xdo->async_head; async != NULL; async = async->next) {
+    outstanding++;
+  }
+  return outstanding;
+} /* int xdo_async_dispatch */
+
+void xdo_async_cancel(xdo_t *xdo, xdo_async_t *async) {
+  /* The replies are still on their way; dispatch takes and drops them */
+  (void)xdo;
+  async->callback = NULL;
+} /* void xdo_async_cancel */
+
+static int _xdo_async_take(const xdo_t *xdo, async_requests_t *requests) {
+  /* Returns True once every reply sent for is in */
+  while (requests->ntaken < requests->nsent) {
+    if (!_xdo_async_reply(xdo, requests->sequences[requests->ntaken], False,
+                          &requests->replies[requests->ntaken], __func__)) {
+      return False;
+    }
+    requests->ntaken++;
+  }
+  return True;
+} /* int _xdo_async_take */
+
+static void _xdo_async_requests_free(xdo_async_t *async) {
+  async_requests_t *requests = async->data;
+  unsigned int i;
+
+  for (i = 0; i < requests->ntaken; i++) {
+    free(requests->replies[i]);
+  }
+  free(requests);
+  free(async->result.name);
+} /* void _xdo_async_requests_free */
+
+static xdo_async_t *_xdo_async_properties(xdo_t *xdo, Window window,
+                                          const Atom *atoms,
+                                          unsigned int natoms,
+                                          int (*poll)(xdo_t *, xdo_async_t *),
+                                          xdo_async_cb_t callback,
+                                          void *userdata) {
+  /* Start a query that reads whole properties of one window */
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  async_requests_t *requests = calloc(1, sizeof(async_requests_t));
+  unsigned int i;
+
+  requests->window = window;
+  for (i = 0; i < natoms; i++) {
+    requests->sequences[requests->nsent++] = xcb_get_property(xcb, 0, window,
+        atoms[i], XCB_GET_PROPERTY_TYPE_ANY, 0, UINT32_MAX).sequence;
+  }
+  return _xdo_async_submit(xdo, poll, _xdo_async_requests_free, requests,
+                           callback, userdata);
+} /* xdo_async_t *_xdo_async_properties */
+
+static int _xdo_async_name_poll(xdo_t *xdo, xdo_async_t *async) {
+  async_requests_t *requests = async->data;
+  xcb_get_property_reply_t *reply;
+  int len;
+
+  if (!_xdo_async_take(xdo, requests)) {
+    return False;
+  }
+
+  async->result.window = requests->window;
+  if (requests->replies[0] == NULL && requests->replies[1] == NULL) {
+    async->result.status = XDO_ERROR;
+    return True;
+  }
+  async->result.status = XDO_SUCCESS;
+
+  /* Prefer _NET_WM_NAME, like xdo_get_window_name */
+  reply = requests->replies[0];
+  if (reply == NULL || reply->value_len == 0) {
+    reply = requests->replies[1];
+  }
+  if (reply != NULL && reply->value_len > 0) {
+    len = xcb_get_property_value_length(reply);
+    async->result.name = malloc(len + 1);
+    memcpy(async->result.name, xcb_get_property_value(reply), len);
+    async->result.name[len] = '\0';
+    async->result.name_len = len;
+    async->result.name_type = reply->type;
+  }
+  return True;
+} /* int _xdo_async_name_poll */
+
+xdo_async_t *xdo_async_get_window_name(xdo_t *xdo, Window window,
+                                       xdo_async_cb_t callback,
+                                       void *userdata) {
+  XDO_CALL(xdo);
+  /* Both go out together; the reply to WM_NAME is dropped if
+   * _NET_WM_NAME is set */
+  return _xdo_async_properties(xdo, window,
+                               &xdo->atoms[XDO_ATOM_NET_WM_NAME], 2, _xdo_async_name_poll,
+                               callback, userdata);
+} /* xdo_async_t *xdo_async_get_window_name */
+
+static int _xdo_async_location_poll(xdo_t *xdo, xdo_async_t *async) {
+  async_requests_t *requests = async->data;
+  xcb_get_geometry_reply_t *geometry;
+  xcb_query_tree_reply_t *tree;
+  xcb_translate_coordinates_reply_t *translated;
+  int s;
+
+  if (!_xdo_async_take(xdo, requests)) {
+    return False;
+  }
+
+  async->result.window = requests->window;
+  async->result.status = XDO_ERROR;
+  geometry = requests->replies[0];
+  tree = requests->replies[1];
+  if (geometry == NULL || tree == NULL) {
+    return True;
+  }
+
+  for (s = 0; s < ScreenCount(xdo->xdpy); s++) {
+    if (RootWindow(xdo->xdpy, s) == geometry->root) {
+      async->result.screen = s;
+    }
+  }
+
+  /* Like xdo_get_window_location, the position is relative to the parent
+   * and needs translating unless the parent is the root */
+  if (tree->parent == geometry->root) {
+    async->result.x = geometry->x;
+    async->result.y = geometry->y;
+    async->result.status = XDO_SUCCESS;
+    return True;
+  }
+
+  if (requests->nsent == 2) {
+    /* With several screens, the root was only known now */
+    requests->sequences[requests->nsent++] = xcb_translate_coordinates(
+        XGetXCBConnection(xdo->xdpy), requests->window, geometry->root,
+        0, 0).sequence;
+    return False;
+  }
+
+  translated = requests->replies[2];
+  if (translated != NULL) {
+    async->result.x = translated->dst_x;
+    async->result.y = translated->dst_y;
+    async->result.status = XDO_SUCCESS;
+  }
+  return True;
+} /* int _xdo_async_location_poll */
+
+xdo_async_t *xdo_async_get_window_location(xdo_t *xdo, Window window,
+                                           xdo_async_cb_t callback,
+                                           void *userdata) {
+  XDO_CALL(xdo);
+  /* As in xdo_get_windows_geometry, with a single screen the root is known
+   * up front and the translation can go out with the rest */
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  async_requests_t *requests = calloc(1, sizeof(async_requests_t));
+
+  requests->window = window;
+  requests->sequences[requests->nsent++] = xcb_get_geometry(xcb,
+                                                            window).sequence;
+  requests->sequences[requests->nsent++] = xcb_query_tree(xcb,
+                                                          window).sequence;
+  if (ScreenCount(xdo->xdpy) == 1) {
+    requests->sequences[requests->nsent++] = xcb_translate_coordinates(xcb,
+        window, DefaultRootWindow(xdo->xdpy), 0, 0).sequence;
+  }
+  return _xdo_async_submit(xdo, _xdo_async_location_poll,
+                           _xdo_async_requests_free, requests, callback,
+                           userdata);
+} /* xdo_async_t *xdo_async_get_window_location */
+
+static int _xdo_async_active_poll(xdo_t *xdo, xdo_async_t *async) {
+  async_requests_t *requests = async->data;
+  xcb_get_property_reply_t *supported;
+  xcb_get_property_reply_t *active;
+  uint32_t *atoms;
+  int i, nsupported, found = False;
+
+  if (!_xdo_async_take(xdo, requests)) {
+    return False;
+  }
+  supported = requests->replies[0];
+  active = requests->replies[1];
+
+  /* Like xdo_get_active_window, trust _NET_ACTIVE_WINDOW only if the
+   * window manager says it supports it */
+  async->result.status = XDO_ERROR;
+  if (supported == NULL || supported->format != 32) {
+    return True;
+  }
+  atoms = xcb_get_property_value(supported);
+  nsupported = supported->value_len;
+  for (i = 0; i < nsupported; i++) {
+    if (atoms[i] == requests->atom) {
+      found = True;
+    }
+  }
+  if (!found) {
+    return True;
+  }
+
+  if (active != NULL && active->format == 32 && active->value_len > 0) {
+    async->result.window = *((uint32_t *)xcb_get_property_value(active));
+  }
+  if (async->result.window != 0) {
+    async->result.status = XDO_SUCCESS;
+  }
+  return True;
+} /* int _xdo_async_active_poll */
+
+xdo_async_t *xdo_async_get_active_window(xdo_t *xdo,
+                                         xdo_async_cb_t callback,
+                                         void *userdata) {
+  XDO_CALL(xdo);
+  xdo_async_t *async;
+  Atom atoms[2];
+
+  /* Check _NET_SUPPORTED in the same round trip */
+  atoms[0] = XInternAtom(xdo->xdpy, "_NET_SUPPORTED", False);
+  atoms[1] = XInternAtom(xdo->xdpy, "_NET_ACTIVE_WINDOW", False);
+  async = _xdo_async_properties(xdo, DefaultRootWindow(xdo->xdpy), atoms, 2,
+                                _xdo_async_active_poll, callback, userdata);
+  ((async_requests_t *)async->data)->atom = atoms[1];
+  return async;
+} /* xdo_async_t *xdo_async_get_active_window */
+
+static int _xdo_async_pid_poll(xdo_t *xdo, xdo_async_t *async) {
+  async_requests_t *requests = async->data;
+  xcb_get_property_reply_t *reply;
+
+  if (!_xdo_async_take(xdo, requests)) {
+    return False;
+  }
+
+  reply = requests->replies[0];
+  async->result.window = requests->window;
+  async->result.status = (reply != NULL) ? XDO_SUCCESS : XDO_ERROR;
+  if (reply != NULL && reply->format == 32 && reply->value_len > 0) {
+    async->result.pid = (int) *((uint32_t *)xcb_get_property_value(reply));
+  }
+  return True;
+} /* int _xdo_async_pid_poll */
+
+xdo_async_t *xdo_async_get_pid_window(xdo_t *xdo, Window window,
+                                      xdo_async_cb_t callback,
+                                      void *userdata) {
+  XDO_CALL(xdo);
+  return _xdo_async_properties(xdo, window,
+                               &xdo->atoms[XDO_ATOM_NET_WM_PID], 1,
+                               _xdo_async_pid_poll, callback, userdata);
+} /* xdo_async_t *xdo_async_get_pid_window */
+
 int xdo_move_window(const xdo_t *xdo, Window wid, int x, int y) {
+  XDO_CALL(xdo);
   XWindowChanges wc;
   int ret = 0;
+
+  _xdo_errors_tag(xdo, __func__, wid);
   wc.x = x;
   wc.y = y;
 
@@ -274,6 +1007,7 @@ int xdo_move_window(const xdo_t *xdo, Window wid, int x, int y) {
 int xdo_translate_window_with_sizehint(const xdo_t *xdo, Window window,
                                        unsigned int width, unsigned int height, 
                                        unsigned int *width_ret, unsigned int *height_ret) {
+  XDO_CALL(xdo);
   XSizeHints hints;
   long supplied_return;
   XGetWMNormalHints(xdo->xdpy, window, &hints, &supplied_return);
@@ -303,10 +1037,13 @@ int xdo_translate_window_with_sizehint(const xdo_t *xdo, Window window,
 }
 
 int xdo_set_window_size(const xdo_t *xdo, Window window, int width, int height, int flags) {
+  XDO_CALL(xdo);
   XWindowChanges wc;
   int ret = 0;
   int cw_flags = 0;
 
+  _xdo_errors_tag(xdo, __func__, window);
+
   if (flags & SIZE_USEHINTS) {
     flags |= SIZE_USEHINTS_X | SIZE_USEHINTS_Y;
   }
@@ -314,14 +1051,17 @@ int xdo_set_window_size(const xdo_t *xdo, Window window, int width, int height,
   wc.width = width;
   wc.height = height;
 
-  if (flags & SIZE_USEHINTS_X) {
-    xdo_translate_window_with_sizehint(xdo, window, width, height, (unsigned int*)&wc.width,
-                                       NULL);
-  }
-
-  if (flags & SIZE_USEHINTS_Y) {
-    xdo_translate_window_with_sizehint(xdo, window, width, height, NULL,
-                                       (unsigned int*)&wc.height);
+  if (flags & (SIZE_USEHINTS_X | SIZE_USEHINTS_Y)) {
+    /* One read of the size hints serves both axes */
+    unsigned int hinted_width, hinted_height;
+    xdo_translate_window_with_sizehint(xdo, window, width, height,
+                                       &hinted_width, &hinted_height);
+    if (flags & SIZE_USEHINTS_X) {
+      wc.width = hinted_width;
+    }
+    if (flags & SIZE_USEHINTS_Y) {
+      wc.height = hinted_height;
+    }
   }
 
   if (width > 0) {
@@ -333,12 +1073,13 @@ int xdo_set_window_size(const xdo_t *xdo, Window window, int width, int height,
   }
 
   ret = XConfigureWindow(xdo->xdpy, window, cw_flags, &wc);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XConfigureWindow", ret == 0, xdo);
 }
 
 int xdo_set_window_override_redirect(const xdo_t *xdo, Window wid,
                                      int override_redirect) {
+  XDO_CALL(xdo);
   int ret;
   XSetWindowAttributes wattr;
   long mask = CWOverrideRedirect;
@@ -381,6 +1122,7 @@ int xdo_set_window_urgency (const xdo_t *xdo, Window wid, int urgency) {
 }
 
 int xdo_set_window_property(const xdo_t *xdo, Window wid, const char *property, const char *value) {
+  XDO_CALL(xdo);
   
   char netwm_property[256] = "_NET_";
   int ret = 0;
@@ -404,15 +1146,18 @@ int xdo_set_window_property(const xdo_t *xdo, Window wid, const char *property,
 }
 
 int xdo_focus_window(const xdo_t *xdo, Window wid) {
+  XDO_CALL(xdo);
   int ret = 0;
+  _xdo_errors_tag(xdo, __func__, wid);
   ret = XSetInputFocus(xdo->xdpy, wid, RevertToParent, CurrentTime);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XSetInputFocus", ret == 0, xdo);
 }
 
 int xdo_wait_for_window_size(const xdo_t *xdo, Window window,
                              unsigned int width, unsigned int height,
                              int flags, int to_or_from) {
+  XDO_CALL(xdo);
   unsigned int cur_width, cur_height;
   /*unsigned int alt_width, alt_height;*/
 
@@ -443,7 +1188,7 @@ int xdo_wait_for_window_size(const xdo_t *xdo, Window window,
          : (cur_width == width && cur_height == height))) {
     xdo_get_window_size(xdo, window, (unsigned int *)&cur_width,
                         (unsigned int *)&cur_height);
-    usleep(30000);
+    _xdo_usleep(__func__, 30000);
     tries--;
   }
 
@@ -451,6 +1196,7 @@ int xdo_wait_for_window_size(const xdo_t *xdo, Window window,
 }
 
 int xdo_wait_for_window_active(const xdo_t *xdo, Window window, int active) {
+  XDO_CALL(xdo);
   Window activewin = 0;
   int ret = 0;
   int tries = MAX_TRIES;
@@ -463,7 +1209,7 @@ int xdo_wait_for_window_active(const xdo_t *xdo, Window window, int active) {
     if (ret == XDO_ERROR) {
       return ret;
     }
-    usleep(30000);
+    _xdo_usleep(__func__, 30000);
     tries--;
   }
 
@@ -471,10 +1217,12 @@ int xdo_wait_for_window_active(const xdo_t *xdo, Window window, int active) {
 }
 
 int xdo_activate_window(const xdo_t *xdo, Window wid) {
+  XDO_CALL(xdo);
   int ret = 0;
   long desktop = 0;
   XEvent xev;
-  XWindowAttributes wattr;
+  Window root;
+  int screen;
 
   if (_xdo_ewmh_is_supported(xdo, "_NET_ACTIVE_WINDOW") == False) {
     fprintf(stderr,
@@ -500,8 +1248,8 @@ int xdo_activate_window(const xdo_t *xdo, Window wid) {
   xev.xclient.data.l[0] = 2L; /* 2 == Message from a window pager */
   xev.xclient.data.l[1] = CurrentTime;
 
-  XGetWindowAttributes(xdo->xdpy, wid, &wattr);
-  ret = XSendEvent(xdo->xdpy, wattr.screen->root, False,
+  _xdo_window_root(xdo, wid, &root, &screen);
+  ret = XSendEvent(xdo->xdpy, root, False,
                    SubstructureNotifyMask | SubstructureRedirectMask,
                    &xev);
 
@@ -511,6 +1259,7 @@ int xdo_activate_window(const xdo_t *xdo, Window wid) {
 }
 
 int xdo_set_number_of_desktops(const xdo_t *xdo, long ndesktops) {
+  XDO_CALL(xdo);
   /* XXX: This should support passing a screen number */
   XEvent xev;
   Window root;
@@ -530,7 +1279,7 @@ int xdo_set_number_of_desktops(const xdo_t *xdo, long ndesktops) {
   xev.xclient.display = xdo->xdpy;
   xev.xclient.window = root;
   xev.xclient.message_type = XInternAtom(xdo->xdpy, "_NET_NUMBER_OF_DESKTOPS", 
-                                         False);
+                                       False);
   xev.xclient.format = 32;
   xev.xclient.data.l[0] = ndesktops;
 
@@ -542,6 +1291,7 @@ int xdo_set_number_of_desktops(const xdo_t *xdo, long ndesktops) {
 }
 
 int xdo_get_number_of_desktops(const xdo_t *xdo, long *ndesktops) {
+  XDO_CALL(xdo);
   Atom type;
   int size;
   long nitems;
@@ -573,6 +1323,7 @@ int xdo_get_number_of_desktops(const xdo_t *xdo, long *ndesktops) {
 }
 
 int xdo_set_current_desktop(const xdo_t *xdo, long desktop) {
+  XDO_CALL(xdo);
   /* XXX: This should support passing a screen number */
   XEvent xev;
   Window root;
@@ -592,7 +1343,7 @@ int xdo_set_current_desktop(const xdo_t *xdo, long desktop) {
   xev.xclient.display = xdo->xdpy;
   xev.xclient.window = root;
   xev.xclient.message_type = XInternAtom(xdo->xdpy, "_NET_CURRENT_DESKTOP", 
-                                         False);
+                                       False);
   xev.xclient.format = 32;
   xev.xclient.data.l[0] = desktop;
   xev.xclient.data.l[1] = CurrentTime;
@@ -605,6 +1356,7 @@ int xdo_set_current_desktop(const xdo_t *xdo, long desktop) {
 }
 
 int xdo_get_current_desktop(const xdo_t *xdo, long *desktop) {
+  XDO_CALL(xdo);
   Atom type;
   int size;
   long nitems;
@@ -637,10 +1389,13 @@ int xdo_get_current_desktop(const xdo_t *xdo, long *desktop) {
 }
 
 int xdo_set_desktop_for_window(const xdo_t *xdo, Window wid, long desktop) {
+  XDO_CALL(xdo);
   XEvent xev;
   int ret = 0;
-  XWindowAttributes wattr;
-  XGetWindowAttributes(xdo->xdpy, wid, &wattr);
+  Window root;
+  int screen;
+
+  _xdo_errors_tag(xdo, __func__, wid);
 
   if (_xdo_ewmh_is_supported(xdo, "_NET_WM_DESKTOP") == False) {
     fprintf(stderr,
@@ -655,12 +1410,16 @@ int xdo_set_desktop_for_window(const xdo_t *xdo, Window wid, long desktop) {
   xev.xclient.display = xdo->xdpy;
   xev.xclient.window = wid;
   xev.xclient.message_type = XInternAtom(xdo->xdpy, "_NET_WM_DESKTOP", 
-                                         False);
+                                       False);
   xev.xclient.format = 32;
   xev.xclient.data.l[0] = desktop;
   xev.xclient.data.l[1] = 2; /* indicate we are messaging from a pager */
 
-  ret = XSendEvent(xdo->xdpy, wattr.screen->root, False,
+  if (_xdo_window_root(xdo, wid, &root, &screen) != XDO_SUCCESS) {
+    return _is_success("XGetWindowAttributes", XDO_ERROR, xdo);
+  }
+
+  ret = XSendEvent(xdo->xdpy, root, False,
                    SubstructureNotifyMask | SubstructureRedirectMask,
                    &xev);
 
@@ -668,6 +1427,7 @@ int xdo_set_desktop_for_window(const xdo_t *xdo, Window wid, long desktop) {
 }
 
 int xdo_get_desktop_for_window(const xdo_t *xdo, Window wid, long *desktop) {
+  XDO_CALL(xdo);
   Atom type;
   int size;
   long nitems;
@@ -701,6 +1461,7 @@ int xdo_get_desktop_for_window(const xdo_t *xdo, Window wid, long *desktop) {
 }
 
 int xdo_get_active_window(const xdo_t *xdo, Window *window_ret) {
+  XDO_CALL(xdo);
   Atom type;
   int size;
   long nitems;
@@ -731,6 +1492,7 @@ int xdo_get_active_window(const xdo_t *xdo, Window *window_ret) {
 }
 
 int xdo_select_window_with_click(const xdo_t *xdo, Window *window_ret) {
+  XDO_CALL(xdo);
   int screen_num;
   Screen *screen;
   xdo_get_mouse_location(xdo, NULL, NULL, &screen_num);
@@ -778,22 +1540,25 @@ int xdo_select_window_with_click(const xdo_t *xdo, Window *window_ret) {
 
 /* XRaiseWindow is ignored in ion3 and Gnome2. Is it even useful? */
 int xdo_raise_window(const xdo_t *xdo, Window wid) {
+  XDO_CALL(xdo);
   int ret = 0;
+  _xdo_errors_tag(xdo, __func__, wid);
   ret = XRaiseWindow(xdo->xdpy, wid);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XRaiseWindow", ret == 0, xdo);
 }
 
 int xdo_lower_window(const xdo_t *xdo, Window wid) {
+  XDO_CALL(xdo);
   int ret = 0;
+  _xdo_errors_tag(xdo, __func__, wid);
   ret = XLowerWindow(xdo->xdpy, wid);
-  XFlush(xdo->xdpy);
+  _xdo_flush(xdo);
   return _is_success("XLowerWindow", ret == 0, xdo);
 }
 
-int xdo_move_mouse(const xdo_t *xdo, int x, int y, int screen)  {
-  int ret = 0;
-
+/* Queue a pointer motion; the caller flushes */
+static int _xdo_move_mouse_to(const xdo_t *xdo, int x, int y, int screen) {
   /* There is a bug (feature?) in XTestFakeMotionEvent that causes
    * the screen number in the request to be ignored. The internets
    * seem to recommend XWarpPointer instead, ie;
@@ -801,26 +1566,321 @@ int xdo_move_mouse(const xdo_t *xdo, int x, int y, int screen)  {
    */
   if (screen > 0) {
     Window screen_root = RootWindow(xdo->xdpy, screen);
-    ret = XWarpPointer(xdo->xdpy, None, screen_root, 0, 0, 0, 0, x, y);
+    return XWarpPointer(xdo->xdpy, None, screen_root, 0, 0, 0, 0, x, y);
   } else {
-    ret = XTestFakeMotionEvent(xdo->xdpy, 0, x, y, CurrentTime);
+    return XTestFakeMotionEvent(xdo->xdpy, 0, x, y, CurrentTime);
   }
+}
+
+int xdo_move_mouse(const xdo_t *xdo, int x, int y, int screen)  {
+  XDO_CALL(xdo);
+  int ret = 0;
+
+  ret = _xdo_move_mouse_to(xdo, x, y, screen);
   XFlush(xdo->xdpy);
   return _is_success("XWarpPointer", ret == 0, xdo);
 }
 
+/* Where a path from x0,y0 to x1,y1 is after a fraction 't' of its steps */
+static void _xdo_mouse_path_point(int path, double t, int x0, int y0,
+                                  int x1, int y1, int *x_ret, int *y_ret) {
+  double dx = x1 - x0, dy = y1 - y0;
+  double u = t, px, py;
+
+  if (path != XDO_MOUSE_PATH_LINE) {
+    /* Speed up, then slow down */
+    u = t * t * (3 - 2 * t);
+  }
+  px = x0 + dx * u;
+  py = y0 + dy * u;
+  if (path == XDO_MOUSE_PATH_CURVE) {
+    /* A cubic Bezier curve whose control points sit a third and two thirds
+     * of the way along, both pushed a fifth of the distance to the right
+     * (y grows downwards). That is the line plus 3u(1-u) of the push. */
+    px += -dy / 5 * 3 * u * (1 - u);
+    py += dx / 5 * 3 * u * (1 - u);
+  }
+  *x_ret = (int)(px < 0 ? px - 0.5 : px + 0.5);
+  *y_ret = (int)(py < 0 ? py - 0.5 : py + 0.5);
+} /* void _xdo_mouse_path_point */
+
+/* Sleep until 'deadline' on CLOCK_MONOTONIC. Sleeping until a time rather
+ * than for a time keeps one late wakeup from delaying every step after it. */
+static void _xdo_sleep_until(const struct timespec *deadline,
+                             const char *call) {
+  double start = xdo_trace_now();
+#ifdef TIMER_ABSTIME
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL)
+         == EINTR);
+#else
+  /* No clock_nanosleep (OS X): sleep for whatever is left */
+  struct timespec now, left;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  left.tv_sec = deadline->tv_sec - now.tv_sec;
+  left.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+  if (left.tv_nsec < 0) {
+    left.tv_sec--;
+    left.tv_nsec += 1000000000L;
+  }
+  if (left.tv_sec >= 0) {
+    nanosleep(&left, NULL);
+  }
+#endif
+  xdo_trace_span("sleep", "clock_nanosleep", start, call);
+} /* void _xdo_sleep_until */
+
+int xdo_move_mouse_path(const xdo_t *xdo, int x, int y, int screen, int path,
+                        unsigned int steps, unsigned long interval) {
+  XDO_CALL(xdo);
+  int x0, y0, screen0, px, py;
+  int ret = 0;
+  unsigned int i;
+  struct timespec deadline;
+
+  xdo_get_mouse_location(xdo, &x0, &y0, &screen0);
+  if (steps <= 1 || screen0 != screen) {
+    return xdo_move_mouse(xdo, x, y, screen);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  for (i = 1; i <= steps; i++) {
+    _xdo_mouse_path_point(path, (double)i / steps, x0, y0, x, y, &px, &py);
+    if (_xdo_move_mouse_to(xdo, px, py, screen) == 0) {
+      ret = 1;
+    }
+    /* One flush per step, so each motion goes out on time */
+    XFlush(xdo->xdpy);
+
+    if (i < steps) {
+      deadline.tv_nsec += interval % 1000000000UL;
+      deadline.tv_sec += interval / 1000000000UL
+                         + deadline.tv_nsec / 1000000000L;
+      deadline.tv_nsec %= 1000000000L;
+      _xdo_sleep_until(&deadline, __func__);
+    }
+  }
+  return _is_success("XTestFakeMotionEvent", ret, xdo);
+} /* int xdo_move_mouse_path */
+
+/* What xdo_record_input hands to the RECORD callback */
+struct xdo_record {
+  const xdo_t *xdo;
+  xdo_record_cb_t callback;
+  void *userdata;
+  int stop;
+};
+
+static void _xdo_record_intercept(XPointer closure,
+                                  XRecordInterceptData *data) {
+  struct xdo_record *record = (struct xdo_record *)closure;
+  xdo_input_event_t event;
+  xEvent xev;
+
+  /* data_len counts 4-byte units */
+  if (data->category == XRecordFromServer && !record->stop
+      && data->data_len * 4 >= sizeof(xEvent)) {
+    memcpy(&xev, data->data, sizeof(xEvent));
+    event.time = data->server_time;
+    event.type = xev.u.u.type & 0x7f;
+    event.detail = (event.type == MotionNotify ? 0 : xev.u.u.detail);
+    event.x = xev.u.keyButtonPointer.rootX;
+    event.y = xev.u.keyButtonPointer.rootY;
+    for (event.screen = ScreenCount(record->xdo->xdpy) - 1;
+         event.screen > 0 && RootWindow(record->xdo->xdpy, event.screen)
+                             != xev.u.keyButtonPointer.root;
+         event.screen--);
+    if (record->callback(record->xdo, &event, record->userdata)
+        == XDO_RECORD_STOP) {
+      record->stop = True;
+    }
+  }
+  XRecordFreeData(data);
+} /* void _xdo_record_intercept */
+
+int xdo_record_input(const xdo_t *xdo, xdo_record_cb_t callback,
+                     void *userdata) {
+  XDO_CALL(xdo);
+  struct xdo_record record;
+  XRecordClientSpec clients = XRecordAllClients;
+  XRecordRange *range;
+  XRecordContext context;
+  Display *data_dpy;
+  sigset_t blocked, unblocked;
+  fd_set readable;
+  int fd, major, minor;
+  int ret = XDO_SUCCESS;
+
+  if (!XRecordQueryVersion(xdo->xdpy, &major, &minor)) {
+    _xdo_eprintf(xdo, False, "xdo_record_input: the RECORD extension is "
+                 "unavailable on '%s'", DisplayString(xdo->xdpy));
+    return XDO_ERROR;
+  }
+
+  /* Recorded data arrives on a connection of its own */
+  data_dpy = XOpenDisplay(DisplayString(xdo->xdpy));
+  if (data_dpy == NULL) {
+    _xdo_eprintf(xdo, False, "xdo_record_input: cannot open a second "
+                 "connection to '%s'", DisplayString(xdo->xdpy));
+    return XDO_ERROR;
+  }
+
+  range = XRecordAllocRange();
+  range->device_events.first = KeyPress;
+  range->device_events.last = MotionNotify;
+  context = XRecordCreateContext(xdo->xdpy, XRecordFromServerTime, &clients,
+                                 1, &range, 1);
+  XFree(range);
+  /* The context must exist before the other connection can enable it */
+  XSync(xdo->xdpy, False);
+
+  record.xdo = xdo;
+  record.callback = callback;
+  record.userdata = userdata;
+  record.stop = False;
+  if (!XRecordEnableContextAsync(data_dpy, context, _xdo_record_intercept,
+                                 (XPointer)&record)) {
+    _xdo_eprintf(xdo, False, "xdo_record_input: cannot enable recording");
+    ret = XDO_ERROR;
+    record.stop = True;
+  }
+
+  /* A signal is how a caller stops recording from outside. Signals are
+   * only let in while waiting, so one that arrives while replies are being
+   * processed is not lost but ends the next wait. */
+  sigfillset(&blocked);
+  pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+  fd = ConnectionNumber(data_dpy);
+  while (!record.stop) {
+    XRecordProcessReplies(data_dpy);
+    if (record.stop) {
+      break;
+    }
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    if (pselect(fd + 1, &readable, NULL, NULL, NULL, &unblocked) < 0) {
+      if (errno != EINTR) {
+        ret = XDO_ERROR;
+      }
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+
+  XRecordDisableContext(xdo->xdpy, context);
+  XRecordFreeContext(xdo->xdpy, context);
+  XSync(xdo->xdpy, False);
+  XCloseDisplay(data_dpy);
+  return ret;
+} /* int xdo_record_input */
+
+int xdo_replay_input(const xdo_t *xdo, xdo_replay_cb_t next, void *userdata) {
+  XDO_CALL(xdo);
+  xdo_input_event_t event;
+  struct timespec start, deadline;
+  unsigned long first = 0, elapsed, last = 0;
+  int have_first = False;
+  /* Keys and buttons pressed and not yet released */
+  unsigned char keys_down[32], buttons_down[32];
+  unsigned int i;
+  int ret = 0;
+
+  if (!(xdo->features_mask & (1 << XDO_FEATURE_XTEST))) {
+    _xdo_eprintf(xdo, False, "xdo_replay_input: the XTEST extension is "
+                 "unavailable on '%s'", DisplayString(xdo->xdpy));
+    return XDO_ERROR;
+  }
+
+  memset(keys_down, 0, sizeof(keys_down));
+  memset(buttons_down, 0, sizeof(buttons_down));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (next(xdo, &event, userdata)) {
+    if (!have_first) {
+      first = event.time;
+      have_first = True;
+    }
+    /* Server time is a 32-bit count of milliseconds that wraps around */
+    elapsed = (event.time - first) & 0xffffffffUL;
+
+    /* Events from the same millisecond go out together. Each deadline is
+     * measured from the start, so timing does not drift over a long
+     * session however late any one wakeup is. */
+    if (elapsed != last) {
+      XFlush(xdo->xdpy);
+      deadline.tv_sec = start.tv_sec + elapsed / 1000;
+      deadline.tv_nsec = start.tv_nsec + (elapsed % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      _xdo_sleep_until(&deadline, __func__);
+      last = elapsed;
+    }
+
+    switch (event.type) {
+      case KeyPress:
+      case KeyRelease:
+        if (event.detail > 255) {
+          continue;
+        }
+        if (event.type == KeyPress) {
+          keys_down[event.detail / 8] |= 1 << (event.detail % 8);
+        } else {
+          keys_down[event.detail / 8] &= ~(1 << (event.detail % 8));
+        }
+        ret |= !XTestFakeKeyEvent(xdo->xdpy, event.detail,
+                                  event.type == KeyPress, CurrentTime);
+        break;
+      case ButtonPress:
+      case ButtonRelease:
+        if (event.detail > 255) {
+          continue;
+        }
+        if (event.type == ButtonPress) {
+          buttons_down[event.detail / 8] |= 1 << (event.detail % 8);
+        } else {
+          buttons_down[event.detail / 8] &= ~(1 << (event.detail % 8));
+        }
+        ret |= !XTestFakeButtonEvent(xdo->xdpy, event.detail,
+                                     event.type == ButtonPress, CurrentTime);
+        break;
+      case MotionNotify:
+        if (event.screen < 0 || event.screen >= ScreenCount(xdo->xdpy)) {
+          continue;
+        }
+        ret |= !_xdo_move_mouse_to(xdo, event.x, event.y, event.screen);
+        break;
+    }
+  }
+
+  /* A recording may end with keys held, such as those pressed to stop it;
+   * don't leave them stuck down */
+  for (i = 0; i < 256; i++) {
+    if (keys_down[i / 8] & (1 << (i % 8))) {
+      XTestFakeKeyEvent(xdo->xdpy, i, False, CurrentTime);
+    }
+    if (buttons_down[i / 8] & (1 << (i % 8))) {
+      XTestFakeButtonEvent(xdo->xdpy, i, False, CurrentTime);
+    }
+  }
+  XFlush(xdo->xdpy);
+  return _is_success("XTestFakeInput", ret, xdo);
+} /* int xdo_replay_input */
+
 int xdo_move_mouse_relative_to_window(const xdo_t *xdo, Window window, int x, int y) {
+  XDO_CALL(xdo);
   XWindowAttributes attr;
   Window unused_child;
   int root_x, root_y;
 
   XGetWindowAttributes(xdo->xdpy, window, &attr);
   XTranslateCoordinates(xdo->xdpy, window, attr.root,
-                        x, y, &root_x, &root_y, &unused_child);
+            x, y, &root_x, &root_y, &unused_child);
   return xdo_move_mouse(xdo, root_x, root_y, XScreenNumberOfScreen(attr.screen));
 }
 
 int xdo_move_mouse_relative(const xdo_t *xdo, int x, int y)  {
+  XDO_CALL(xdo);
   int ret = 0;
   ret = XTestFakeRelativeMotionEvent(xdo->xdpy, x, y, CurrentTime);
   XFlush(xdo->xdpy);
@@ -859,7 +1919,7 @@ int _xdo_mousebutton(const xdo_t *xdo, Window window, int button, int is_press)
     /* Get the coordinates of the cursor relative to xbpe.window and also find what
      * subwindow it might be on */
     XTranslateCoordinates(xdo->xdpy, xbpe.root, xbpe.window, 
-                          xbpe.x_root, xbpe.y_root, &xbpe.x, &xbpe.y, &xbpe.subwindow);
+              xbpe.x_root, xbpe.y_root, &xbpe.x, &xbpe.y, &xbpe.subwindow);
 
     /* Normal behavior of 'mouse up' is that the modifier mask includes
      * 'ButtonNMotionMask' where N is the button being released. This works the
@@ -881,24 +1941,29 @@ int _xdo_mousebutton(const xdo_t *xdo, Window window, int button, int is_press)
 }
 
 int xdo_mouse_up(const xdo_t *xdo, Window window, int button) {
+  XDO_CALL(xdo);
   return _xdo_mousebutton(xdo, window, button, False);
 }
 
 int xdo_mouse_down(const xdo_t *xdo, Window window, int button) {
+  XDO_CALL(xdo);
   return _xdo_mousebutton(xdo, window, button, True);
 }
 
 int xdo_get_mouse_location(const xdo_t *xdo, int *x_ret, int *y_ret,
                            int *screen_num_ret) {
+  XDO_CALL(xdo);
   return xdo_get_mouse_location2(xdo, x_ret, y_ret, screen_num_ret, NULL);
 }
 
 int xdo_get_window_at_mouse(const xdo_t *xdo, Window *window_ret) {
+  XDO_CALL(xdo);
   return xdo_get_mouse_location2(xdo, NULL, NULL, NULL, window_ret);
 }
 
 int xdo_get_mouse_location2(const xdo_t *xdo, int *x_ret, int *y_ret,
                             int *screen_num_ret, Window *window_ret) {
+  XDO_CALL(xdo);
   int ret = False;
   int x = 0, y = 0, screen_num = 0;
   int i = 0;
@@ -911,8 +1976,8 @@ int xdo_get_mouse_location2(const xdo_t *xdo, int *x_ret, int *y_ret,
   for (i = 0; i < screencount; i++) {
     Screen *screen = ScreenOfDisplay(xdo->xdpy, i);
     ret = XQueryPointer(xdo->xdpy, RootWindowOfScreen(screen),
-                        &root, &window,
-                        &x, &y, &dummy_int, &dummy_int, &dummy_uint);
+                    &root, &window,
+                    &x, &y, &dummy_int, &dummy_int, &dummy_uint);
     if (ret == True) {
       screen_num = i;
       break;
@@ -953,19 +2018,21 @@ int xdo_get_mouse_location2(const xdo_t *xdo, int *x_ret, int *y_ret,
 }
 
 int xdo_click_window(const xdo_t *xdo, Window window, int button) {
+  XDO_CALL(xdo);
   int ret = 0;
   ret = xdo_mouse_down(xdo, window, button);
   if (ret != XDO_SUCCESS) {
     fprintf(stderr, "xdo_mouse_down failed, aborting click.\n");
     return ret;
   }
-  usleep(DEFAULT_DELAY);
+  _xdo_usleep(__func__, DEFAULT_DELAY);
   ret = xdo_mouse_up(xdo, window, button);
   return ret;
 }
 
 int xdo_click_window_multiple(const xdo_t *xdo, Window window, int button,
                        int repeat, useconds_t delay) {
+  XDO_CALL(xdo);
   int ret = 0;
   while (repeat > 0) {
     ret = xdo_click_window(xdo, window, button);
@@ -977,13 +2044,14 @@ int xdo_click_window_multiple(const xdo_t *xdo, Window window, int button,
 
     /* Sleeping even after the last click is important, so that a call to xdo_set_active_modifiers()
      * right after won't think that the button is still pressed. */
-    usleep(delay);
+    _xdo_usleep(__func__, delay);
   } /* while (repeat > 0) */
   return ret;
 } /* int xdo_click_window_multiple */
 
 /* XXX: Return proper code if errors found */
 int xdo_enter_text_window(const xdo_t *xdo, Window window, const char *string, useconds_t delay) {
+  XDO_CALL(xdo);
   /* Split delay into keyup and keydown, not letting keydown exceed 50000 (50ms) */
   useconds_t down_delay, up_delay;
   down_delay = up_delay = delay / 2;
@@ -1037,6 +2105,7 @@ int _xdo_send_keysequence_window_do(const xdo_t *xdo, Window window, const char
 
 int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window, charcodemap_t *keys, 
                             int nkeys, int pressed, int *modifier, useconds_t delay) {
+  XDO_CALL(xdo);
   int i = 0;
   int modstate = 0;
   int keymapchanged = 0;
@@ -1046,8 +2115,8 @@ int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window, charcod
   int keysyms_per_keycode = 0;
   int scratch_keycode = 0; /* Scratch space for temporary keycode bindings */
   keysyms = XGetKeyboardMapping(xdo->xdpy, xdo->keycode_low,
-                                xdo->keycode_high - xdo->keycode_low,
-                                &keysyms_per_keycode);
+                          xdo->keycode_high - xdo->keycode_low,
+                          &keysyms_per_keycode);
 
   /* Find a keycode that is unused for scratchspace */
   for (i = xdo->keycode_low; i <= xdo->keycode_high; i++) {
@@ -1121,16 +2190,19 @@ int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window, charcod
   
 int xdo_send_keysequence_window_down(const xdo_t *xdo, Window window, const char *keyseq,
                          useconds_t delay) {
+  XDO_CALL(xdo);
   return _xdo_send_keysequence_window_do(xdo, window, keyseq, True, NULL, delay);
 }
 
 int xdo_send_keysequence_window_up(const xdo_t *xdo, Window window, const char *keyseq,
                        useconds_t delay) {
+  XDO_CALL(xdo);
   return _xdo_send_keysequence_window_do(xdo, window, keyseq, False, NULL, delay);
 }
 
 int xdo_send_keysequence_window(const xdo_t *xdo, Window window, const char *keyseq,
                     useconds_t delay) {
+  XDO_CALL(xdo);
   int ret = 0;
   int modifier = 0;
   ret += _xdo_send_keysequence_window_do(xdo, window, keyseq, True, &modifier, delay / 2);
@@ -1141,6 +2213,7 @@ int xdo_send_keysequence_window(const xdo_t *xdo, Window window, const char *key
 /* Add by Lee Pumphret 2007-07-28
  * Modified slightly by Jordan Sissel */
 int xdo_get_focused_window(const xdo_t *xdo, Window *window_ret) {
+  XDO_CALL(xdo);
   int ret = 0;
   int unused_revert_ret;
 
@@ -1158,6 +2231,7 @@ int xdo_get_focused_window(const xdo_t *xdo, Window *window_ret) {
 }
 
 int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus) {
+  XDO_CALL(xdo);
   Window focuswin = 0;
   int ret;
   int tries = MAX_TRIES;
@@ -1168,7 +2242,7 @@ int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus) {
 
   while (tries > 0 && 
          (want_focus ? focuswin != window : focuswin == window)) {
-    usleep(30000); /* TODO(sissel): Use exponential backoff up to 1 second */
+    _xdo_usleep(__func__, 30000); /* TODO(sissel): Use exponential backoff up to 1 second */
     ret = xdo_get_focused_window(xdo, &focuswin);
     if (ret != 0) {
       return ret;
@@ -1183,6 +2257,7 @@ int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus) {
  * top-level-ish window having focus rather than something you may
  * not expect to be the window having focused. */
 int xdo_get_focused_window_sane(const xdo_t *xdo, Window *window_ret) {
+  XDO_CALL(xdo);
   xdo_get_focused_window(xdo, window_ret);
   xdo_find_window_client(xdo, *window_ret, window_ret, XDO_FIND_PARENTS);
   return _is_success("xdo_get_focused_window_sane", *window_ret == 0, xdo);
@@ -1190,6 +2265,7 @@ int xdo_get_focused_window_sane(const xdo_t *xdo, Window *window_ret) {
 
 int xdo_find_window_client(const xdo_t *xdo, Window window, Window *window_ret,
                            int direction) {
+  XDO_CALL(xdo);
   /* for XQueryTree */
   Window dummy, parent, *children = NULL;
   unsigned int nchildren;
@@ -1310,6 +2386,16 @@ static int _xdo_has_xtest(const xdo_t *xdo) {
   return (XTestQueryExtension(xdo->xdpy, &dummy, &dummy, &dummy, &dummy) == True);
 }
 
+static int _xdo_has_xres(const xdo_t *xdo) {
+  /* XResQueryClientIds needs X-Resource 1.2 */
+  int dummy;
+  int major = 0, minor = 0;
+
+  return (XResQueryExtension(xdo->xdpy, &dummy, &dummy) == True
+          && XResQueryVersion(xdo->xdpy, &major, &minor)
+          && (major > 1 || (major == 1 && minor >= 2)));
+}
+
 #define AddCharcodeEntry(idx, xdo, keysym, keycode, group, mask) \
           if (idx == charcodes_size) { \
             xdo->charcodes = realloc(xdo->charcodes, (charcodes_size += 100) * sizeof(charcodemap_t)); \
@@ -1548,8 +2634,613 @@ int _is_success(const char *funcname, int code, const xdo_t *xdo) {
   return code;
 }
 
+/* Flush the output buffer, unless a batch is open; xdo_batch_end flushes
+ * everything at once. */
+void _xdo_flush(const xdo_t *xdo) {
+  if (!xdo->batch) {
+    XFlush(xdo->xdpy);
+  }
+}
+
+/* Find the root window and screen number of a window. With only one screen
+ * there is only one root, so we can answer without asking the server. */
+int _xdo_window_root(const xdo_t *xdo, Window window, Window *root_ret,
+                     int *screen_ret) {
+  XWindowAttributes attr;
+
+  if (ScreenCount(xdo->xdpy) == 1) {
+    *root_ret = DefaultRootWindow(xdo->xdpy);
+    *screen_ret = DefaultScreen(xdo->xdpy);
+    return XDO_SUCCESS;
+  }
+
+  if (XGetWindowAttributes(xdo->xdpy, window, &attr) == 0) {
+    return XDO_ERROR;
+  }
+  *root_ret = attr.root;
+  *screen_ret = XScreenNumberOfScreen(attr.screen);
+  return XDO_SUCCESS;
+}
+
+int xdo_batch_begin(xdo_t *xdo) {
+  XDO_CALL(xdo);
+  if (xdo->batch) {
+    _xdo_eprintf(xdo, False, "xdo_batch_begin: a batch is already open");
+    return XDO_ERROR;
+  }
+
+  /* EWMH checks inside the batch share one read of _NET_SUPPORTED, made by
+   * the first of them, so batches that never check cost no round trip. */
+  xdo->batch_ewmh_supported = calloc(1, sizeof(struct xdo_ewmh_supported));
+  xdo->batch = True;
+  _xdo_errors_begin(xdo, False);
+  return XDO_SUCCESS;
+}
+
+int xdo_batch_take_errors(xdo_t *xdo, xdo_batch_error_t **errors_ret,
+                          unsigned int *nerrors_ret) {
+  XDO_CALL(xdo);
+  xdo_batch_error_t *errors = NULL;
+  unsigned int nerrors = 0;
+
+  if (!xdo->batch) {
+    _xdo_eprintf(xdo, False, "xdo_batch_take_errors: no batch is open");
+    return XDO_ERROR;
+  }
+
+  /* Send what is queued and read whatever has come back, but don't wait */
+  XEventsQueued(xdo->xdpy, QueuedAfterFlush);
+  nerrors = _xdo_errors_take(xdo, &errors);
+  if (errors_ret != NULL) {
+    *errors_ret = errors;
+  } else {
+    free(errors);
+  }
+  if (nerrors_ret != NULL) {
+    *nerrors_ret = nerrors;
+  }
+  return (nerrors == 0 ? XDO_SUCCESS : XDO_ERROR);
+}
+
+int xdo_batch_end(xdo_t *xdo, xdo_batch_error_t **errors_ret,
+                  unsigned int *nerrors_ret) {
+  XDO_CALL(xdo);
+  xdo_batch_error_t *errors = NULL;
+  unsigned int nerrors;
+
+  if (!xdo->batch) {
+    _xdo_eprintf(xdo, False, "xdo_batch_end: no batch is open");
+    return XDO_ERROR;
+  }
+
+  /* One round trip for everything queued; errors arrive in the handler. */
+  XSync(xdo->xdpy, False);
+  nerrors = _xdo_errors_take(xdo, &errors);
+  _xdo_errors_end(xdo);
+  xdo->batch = False;
+
+  free(xdo->batch_ewmh_supported->atoms);
+  free(xdo->batch_ewmh_supported);
+  xdo->batch_ewmh_supported = NULL;
+
+  if (errors_ret != NULL) {
+    *errors_ret = errors;
+  } else {
+    free(errors);
+  }
+  if (nerrors_ret != NULL) {
+    *nerrors_ret = nerrors;
+  }
+
+  return (nerrors == 0 ? XDO_SUCCESS : XDO_ERROR);
+}
+
+struct xdo_error_log *_xdo_error_log_new(Display *xdpy) {
+  struct xdo_error_log *log = calloc(1, sizeof(struct xdo_error_log));
+
+  log->xdpy = xdpy;
+  return log;
+} /* struct xdo_error_log *_xdo_error_log_new */
+
+void _xdo_error_log_free(struct xdo_error_log *log) {
+  free(log->scopes);
+  free(log->tags);
+  free(log->errors);
+  free(log);
+} /* void _xdo_error_log_free */
+
+void _xdo_errors_begin(const xdo_t *xdo, int ignore_badwindow) {
+  struct xdo_error_log *log = xdo->error_log;
+
+  if (log->nscopes == log->scopes_size) {
+    log->scopes_size = (log->scopes_size == 0 ? 4 : log->scopes_size * 2);
+    log->scopes = realloc(log->scopes,
+                          log->scopes_size * sizeof(error_scope_t));
+  }
+  log->scopes[log->nscopes].serial = NextRequest(xdo->xdpy);
+  log->scopes[log->nscopes].ignore_badwindow = ignore_badwindow;
+  if (log->nscopes++ > 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&error_lock);
+  log->next = error_logs;
+  error_logs = log;
+  if (error_users++ == 0) {
+    error_handler_saved = XSetErrorHandler(_xdo_error_handler);
+  } else if (error_handler_suspended) {
+    XSetErrorHandler(_xdo_error_handler);
+    error_handler_suspended = False;
+  }
+  pthread_mutex_unlock(&error_lock);
+} /* void _xdo_errors_begin */
+
+/* The index of the first error for a request sent since 'serial' */
+static unsigned int _xdo_errors_since(const struct xdo_error_log *log,
+                                      unsigned long serial) {
+  unsigned int i = log->nerrors;
+
+  while (i > 0 && log->errors[i - 1].serial >= serial) {
+    i--;
+  }
+  return i;
+} /* unsigned int _xdo_errors_since */
+
+/* Report and drop the errors of the scope at 'scope'. Returns how many
+ * there were. */
+static unsigned int _xdo_errors_report(const xdo_t *xdo, unsigned int scope) {
+  struct xdo_error_log *log = xdo->error_log;
+  unsigned int i, first, nerrors;
+  char text[256];
+
+  first = _xdo_errors_since(log, log->scopes[scope].serial);
+  nerrors = log->nerrors - first;
+  for (i = first; i < log->nerrors && !xdo->quiet; i++) {
+    xdo_batch_error_t *error = &log->errors[i];
+    XGetErrorText(xdo->xdpy, error->error_code, text, sizeof(text));
+    _xdo_eprintf(xdo, True, "X error in %s for window %ld: %s "
+                 "(major opcode %d)", error->call ? error->call : "request",
+                 error->window, text, error->request_code);
+  }
+  log->nerrors = first;
+  return nerrors;
+} /* unsigned int _xdo_errors_report */
+
+unsigned int _xdo_errors_end(const xdo_t *xdo) {
+  struct xdo_error_log *log = xdo->error_log;
+  struct xdo_error_log **prev;
+  unsigned int nerrors;
+
+  log->nscopes--;
+  nerrors = _xdo_errors_report(xdo, log->nscopes);
+
+  if (log->nscopes > 0) {
+    return nerrors;
+  }
+
+  /* Nothing sent from here on can be attributed to anything */
+  log->ntags = 0;
+  log->nerrors = 0;
+
+  pthread_mutex_lock(&error_lock);
+  for (prev = &error_logs; *prev != log; prev = &(*prev)->next);
+  *prev = log->next;
+  if (--error_users == 0) {
+    XSetErrorHandler(error_handler_saved);
+    error_handler_suspended = False;
+  }
+  pthread_mutex_unlock(&error_lock);
+  return nerrors;
+} /* unsigned int _xdo_errors_end */
+
+unsigned int _xdo_errors_flush(const xdo_t *xdo) {
+  return _xdo_errors_report(xdo, xdo->error_log->nscopes - 1);
+} /* unsigned int _xdo_errors_flush */
+
+unsigned int _xdo_errors_take(const xdo_t *xdo,
+                              xdo_batch_error_t **errors_ret) {
+  struct xdo_error_log *log = xdo->error_log;
+  unsigned int first, nerrors;
+
+  first = _xdo_errors_since(log, log->scopes[log->nscopes - 1].serial);
+  nerrors = log->nerrors - first;
+  *errors_ret = NULL;
+  if (nerrors > 0) {
+    *errors_ret = malloc(nerrors * sizeof(xdo_batch_error_t));
+    memcpy(*errors_ret, log->errors + first,
+           nerrors * sizeof(xdo_batch_error_t));
+  }
+  log->nerrors = first;
+  return nerrors;
+} /* unsigned int _xdo_errors_take */
+
+void _xdo_errors_tag(const xdo_t *xdo, const char *call, Window window) {
+  struct xdo_error_log *log = xdo->error_log;
+  unsigned long processed;
+  unsigned int i, keep;
+
+  if (log->nscopes == 0) {
+    return;
+  }
+
+  if (log->ntags == log->tags_size) {
+    /* A tag is done with once the server is past every request it covers,
+     * since errors arrive in order */
+    processed = LastKnownRequestProcessed(xdo->xdpy);
+    for (keep = 0; keep + 1 < log->ntags; keep++) {
+      if (log->tags[keep + 1].serial > processed + 1) {
+        break;
+      }
+    }
+    for (i = keep; i < log->ntags; i++) {
+      log->tags[i - keep] = log->tags[i];
+    }
+    log->ntags -= keep;
+  }
+  if (log->ntags == log->tags_size) {
+    log->tags_size = (log->tags_size == 0 ? 64 : log->tags_size * 2);
+    log->tags = realloc(log->tags, log->tags_size * sizeof(request_tag_t));
+  }
+  log->tags[log->ntags].serial = NextRequest(xdo->xdpy);
+  log->tags[log->ntags].call = call;
+  log->tags[log->ntags].window = window;
+  log->ntags++;
+} /* void _xdo_errors_tag */
+
+void _xdo_errors_suspend(void) {
+  pthread_mutex_lock(&error_lock);
+  if (error_users == 1) {
+    XSetErrorHandler(error_handler_saved);
+    error_handler_suspended = True;
+  }
+  pthread_mutex_unlock(&error_lock);
+} /* void _xdo_errors_suspend */
+
+void _xdo_errors_resume(void) {
+  pthread_mutex_lock(&error_lock);
+  if (error_handler_suspended) {
+    XSetErrorHandler(_xdo_error_handler);
+    error_handler_suspended = False;
+  }
+  pthread_mutex_unlock(&error_lock);
+} /* void _xdo_errors_resume */
+
+static int _xdo_error_handler(Display *dpy, XErrorEvent *xerr) {
+  struct xdo_error_log *log;
+  XErrorHandler saved;
+  xdo_batch_error_t *error;
+  unsigned long scope_serial;
+  int i;
+
+  pthread_mutex_lock(&error_lock);
+  for (log = error_logs; log != NULL && log->xdpy != dpy; log = log->next);
+  saved = error_handler_saved;
+  pthread_mutex_unlock(&error_lock);
+
+  /* Not ours; let whoever was installed before us deal with it. The log
+   * itself is only touched by the thread using its connection, which is
+   * the one running this handler. */
+  if (log == NULL) {
+    return (saved != NULL ? saved(dpy, xerr) : 0);
+  }
+
+  /* The innermost scope the request was sent in decides */
+  for (i = log->nscopes - 1; i > 0; i--) {
+    if (log->scopes[i].serial <= xerr->serial) {
+      break;
+    }
+  }
+  if (log->scopes[i].ignore_badwindow && xerr->error_code == BadWindow) {
+    return 0;
+  }
+  scope_serial = log->scopes[i].serial;
+
+  if (log->nerrors == log->errors_size) {
+    log->errors_size = (log->errors_size == 0 ? 16 : log->errors_size * 2);
+    log->errors = realloc(log->errors,
+                          log->errors_size * sizeof(xdo_batch_error_t));
+  }
+  error = &log->errors[log->nerrors++];
+  error->window = xerr->resourceid;
+  error->error_code = xerr->error_code;
+  error->request_code = xerr->request_code;
+  error->serial = xerr->serial;
+  error->call = NULL;
+  for (i = log->ntags - 1; i >= 0 && log->tags[i].serial >= scope_serial;
+       i--) {
+    if (log->tags[i].serial <= xerr->serial) {
+      error->call = log->tags[i].call;
+      error->window = log->tags[i].window;
+      break;
+    }
+  }
+  return 0;
+} /* int _xdo_error_handler */
+
+struct xdo_stats_log *_xdo_stats_log_new(Display *xdpy) {
+  struct xdo_stats_log *log = calloc(1, sizeof(struct xdo_stats_log));
+
+  log->xdpy = xdpy;
+  log->checked_request = NextRequest(xdpy);
+  log->checked_read = LastKnownRequestProcessed(xdpy);
+  pthread_mutex_lock(&stats_lock);
+  log->next = stats_logs;
+  stats_logs = log;
+  pthread_mutex_unlock(&stats_lock);
+  log->after_saved = XSetAfterFunction(xdpy, _xdo_stats_after);
+  return log;
+} /* struct xdo_stats_log *_xdo_stats_log_new */
+
+void _xdo_stats_log_free(struct xdo_stats_log *log) {
+  struct xdo_stats_log **prev;
+
+  XSetAfterFunction(log->xdpy, log->after_saved);
+  pthread_mutex_lock(&stats_lock);
+  for (prev = &stats_logs; *prev != log; prev = &(*prev)->next);
+  *prev = log->next;
+  pthread_mutex_unlock(&stats_lock);
+  free(log->calls);
+  free(log);
+} /* void _xdo_stats_log_free */
+
+/* Count a round trip if the server has answered everything that had been
+ * sent at the last check. Requests that need no reply leave the last
+ * answered request behind; one that waited for its reply catches up. */
+static void _xdo_stats_check(struct xdo_stats_log *log) {
+  unsigned long read = LastKnownRequestProcessed(log->xdpy);
+
+  if (read != log->checked_read && read + 1 >= log->checked_request) {
+    log->round_trips++;
+  }
+  log->checked_read = read;
+  log->checked_request = NextRequest(log->xdpy);
+} /* void _xdo_stats_check */
+
+static int _xdo_stats_after(Display *xdpy) {
+  struct xdo_stats_log *log;
+
+  pthread_mutex_lock(&stats_lock);
+  for (log = stats_logs; log != NULL && log->xdpy != xdpy; log = log->next);
+  pthread_mutex_unlock(&stats_lock);
+  if (log == NULL) {
+    return 0;
+  }
+  _xdo_stats_check(log);
+  if (log->after_saved != NULL) {
+    return log->after_saved(xdpy);
+  }
+  return 0;
+} /* int _xdo_stats_after */
+
+static double _xdo_monotonic_us(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+} /* double _xdo_monotonic_us */
+
+struct xdo_call _xdo_call_begin(const xdo_t *xdo, const char *name) {
+  struct xdo_call call;
+  xcb_connection_t *xcb;
+
+  memset(&call, 0, sizeof(call));
+  if (xdo == NULL || xdo->stats_log == NULL) {
+    return call;
+  }
+  call.log = xdo->stats_log;
+  if (call.log->depth++ > 0) {
+    return call;
+  }
+  /* Round trips made between public calls are not this call's */
+  _xdo_stats_check(call.log);
+  xcb = XGetXCBConnection(xdo->xdpy);
+  call.name = name;
+  call.outer = True;
+  call.request = NextRequest(xdo->xdpy);
+  call.round_trips = call.log->round_trips;
+  call.sent = xcb_total_written(xcb);
+  call.received = xcb_total_read(xcb);
+  call.start = _xdo_monotonic_us();
+  return call;
+} /* struct xdo_call _xdo_call_begin */
+
+void _xdo_call_end(struct xdo_call *call) {
+  struct xdo_stats_log *log = call->log;
+  xcb_connection_t *xcb;
+  xdo_stat_t *stat;
+  char detail[64];
+  double now;
+  unsigned int i;
+
+  if (log == NULL) {
+    return;
+  }
+  log->depth--;
+  if (!call->outer) {
+    return;
+  }
+  _xdo_stats_check(log);
+  now = _xdo_monotonic_us();
+
+  /* call->name is always a __func__, so the pointer says which function */
+  for (i = 0; i < log->ncalls && log->calls[i].call != call->name; i++);
+  if (i == log->ncalls) {
+    if (log->ncalls == log->calls_size) {
+      log->calls_size = (log->calls_size == 0 ? 32 : log->calls_size * 2);
+      log->calls = realloc(log->calls, log->calls_size * sizeof(xdo_stat_t));
+    }
+    memset(&log->calls[i], 0, sizeof(xdo_stat_t));
+    log->calls[i].call = call->name;
+    log->ncalls++;
+  }
+  stat = &log->calls[i];
+  xcb = XGetXCBConnection(log->xdpy);
+  stat->count++;
+  stat->requests += NextRequest(log->xdpy) - call->request;
+  stat->round_trips += log->round_trips - call->round_trips;
+  stat->bytes_sent += xcb_total_written(xcb) - call->sent;
+  stat->bytes_received += xcb_total_read(xcb) - call->received;
+  stat->time += (now - call->start) / 1e6;
+
+  if (trace_fd >= 0) {
+    snprintf(detail, sizeof(detail), "%lu requests, %lu round trips",
+             NextRequest(log->xdpy) - call->request,
+             log->round_trips - call->round_trips);
+    _xdo_trace_write("xdo", call->name, call->start, now - call->start,
+                     detail);
+  }
+} /* void _xdo_call_end */
+
+void _xdo_stats_waited(const xdo_t *xdo, const char *request,
+                       const char *call, const struct timespec *since) {
+  struct timespec now;
+
+  if (xdo->stats_log == NULL) {
+    return;
+  }
+  xdo->stats_log->round_trips++;
+  if (trace_fd >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    _xdo_trace_write("x11", request, since->tv_sec * 1e6 + since->tv_nsec / 1e3,
+                     (now.tv_sec - since->tv_sec) * 1e6
+                     + (now.tv_nsec - since->tv_nsec) / 1e3, call);
+  }
+} /* void _xdo_stats_waited */
+
+void xdo_get_stats(const xdo_t *xdo, xdo_stats_t *stats_ret) {
+  struct xdo_stats_log *log = xdo->stats_log;
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+
+  memset(stats_ret, 0, sizeof(xdo_stats_t));
+  stats_ret->requests = NextRequest(xdo->xdpy) - 1;
+  stats_ret->bytes_sent = xcb_total_written(xcb);
+  stats_ret->bytes_received = xcb_total_read(xcb);
+  if (log == NULL) {
+    return;
+  }
+  _xdo_stats_check(log);
+  stats_ret->round_trips = log->round_trips;
+  stats_ret->ncalls = log->ncalls;
+  if (log->ncalls > 0) {
+    stats_ret->calls = malloc(log->ncalls * sizeof(xdo_stat_t));
+    memcpy(stats_ret->calls, log->calls, log->ncalls * sizeof(xdo_stat_t));
+  }
+} /* void xdo_get_stats */
+
+static void _xdo_trace_open(void) {
+  const char *path = getenv("XDO_TRACE");
+  struct stat st;
+  int started = False;
+
+  if (path == NULL || *path == '\0') {
+    return;
+  }
+  /* The file is appended to, never truncated, so an xdotool run by 'exec'
+   * adds its events to its parent's. Whoever finds it empty starts the
+   * array; a file created here is empty to no one else. */
+  trace_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+  if (trace_fd < 0 && errno == EEXIST) {
+    trace_fd = open(path, O_WRONLY | O_APPEND);
+    if (trace_fd >= 0 && (fstat(trace_fd, &st) != 0 || st.st_size > 0)) {
+      started = True;
+    }
+  }
+  if (trace_fd < 0) {
+    fprintf(stderr, "xdo: cannot open XDO_TRACE file '%s': %s\n", path,
+            strerror(errno));
+    return;
+  }
+  /* Trace viewers accept the array without its closing ']', so events can
+   * be appended until the program exits, however it exits. */
+  if (!started && write(trace_fd, "[\n", 2) != 2) {
+    close(trace_fd);
+    trace_fd = -1;
+    return;
+  }
+  pthread_key_create(&trace_tid_key, NULL);
+} /* void _xdo_trace_open */
+
+/* Append 'str' to the JSON string being built at *pos, escaped */
+static void _xdo_trace_quote(char *buf, size_t size, size_t *pos,
+                             const char *str) {
+  for (; *str != '\0' && *pos + 7 < size; str++) {
+    unsigned char c = *str;
+    if (c == '"' || c == '\\') {
+      buf[(*pos)++] = '\\';
+      buf[(*pos)++] = c;
+    } else if (c < 0x20) {
+      *pos += sprintf(buf + *pos, "\\u%04x", c);
+    } else {
+      buf[(*pos)++] = c;
+    }
+  }
+} /* void _xdo_trace_quote */
+
+static void _xdo_trace_write(const char *category, const char *name,
+                             double start, double duration,
+                             const char *detail) {
+  char buf[1024];
+  size_t pos = 0;
+  void *key = pthread_getspecific(trace_tid_key);
+  unsigned long tid = (uintptr_t)key;
+
+  /* Short thread numbers read better in a viewer than pthread_t values */
+  if (tid == 0) {
+    pthread_mutex_lock(&trace_lock);
+    tid = ++trace_tids;
+    pthread_mutex_unlock(&trace_lock);
+    pthread_setspecific(trace_tid_key, (void *)(uintptr_t)tid);
+  }
+
+  pos += sprintf(buf, "{\"name\":\"");
+  _xdo_trace_quote(buf, sizeof(buf) / 2, &pos, name);
+  pos += sprintf(buf + pos, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                 "\"dur\":%.3f,\"pid\":%ld,\"tid\":%lu", category, start,
+                 duration, (long)getpid(), tid);
+  if (detail != NULL) {
+    pos += sprintf(buf + pos, ",\"args\":{\"detail\":\"");
+    _xdo_trace_quote(buf, sizeof(buf) - 8, &pos, detail);
+    buf[pos++] = '"';
+    buf[pos++] = '}';
+  }
+  buf[pos++] = '}';
+  buf[pos++] = ',';
+  buf[pos++] = '\n';
+  if (write(trace_fd, buf, pos) < 0) {
+    /* Nothing to be done; the trace is missing an event */
+  }
+} /* void _xdo_trace_write */
+
+double xdo_trace_now(void) {
+  pthread_once(&trace_once, _xdo_trace_open);
+  if (trace_fd < 0) {
+    return 0;
+  }
+  return _xdo_monotonic_us();
+} /* double xdo_trace_now */
+
+void xdo_trace_span(const char *category, const char *name, double start,
+                    const char *detail) {
+  double end;
+
+  if (start == 0 || trace_fd < 0) {
+    return;
+  }
+  end = xdo_trace_now();
+  _xdo_trace_write(category, name, start, end - start, detail);
+} /* void xdo_trace_span */
+
+int _xdo_usleep(const char *call, unsigned long usec) {
+  double start = xdo_trace_now();
+  int ret = usleep(usec);
+
+  xdo_trace_span("sleep", "usleep", start, call);
+  return ret;
+} /* int _xdo_usleep */
+
 int xdo_get_window_property(const xdo_t *xdo, Window window, const char *property,
                             unsigned char **value, long *nitems, Atom *type, int *size) {
+  XDO_CALL(xdo);
     *value = xdo_get_window_property_by_atom(xdo, window, XInternAtom(xdo->xdpy, property, False), nitems, type, size);
     if (*value == NULL) {
         return XDO_ERROR;
@@ -1561,6 +3252,7 @@ int xdo_get_window_property(const xdo_t *xdo, Window window, const char *propert
  * slightly modified version from xprop.c from Xorg */
 unsigned char *xdo_get_window_property_by_atom(const xdo_t *xdo, Window window, Atom atom,
                                             long *nitems, Atom *type, int *size) {
+  XDO_CALL(xdo);
   Atom actual_type;
   int actual_format;
   unsigned long _nitems;
@@ -1570,9 +3262,9 @@ unsigned char *xdo_get_window_property_by_atom(const xdo_t *xdo, Window window,
   int status;
 
   status = XGetWindowProperty(xdo->xdpy, window, atom, 0, (~0L),
-                              False, AnyPropertyType, &actual_type,
-                              &actual_format, &_nitems, &bytes_after,
-                              &prop);
+                     False, AnyPropertyType, &actual_type,
+                     &actual_format, &_nitems, &bytes_after,
+                     &prop);
   if (status == BadWindow) {
     fprintf(stderr, "window id # 0x%lx does not exists!", window);
     return NULL;
@@ -1617,10 +3309,30 @@ int _xdo_ewmh_is_supported(const xdo_t *xdo, const char *feature) {
   Atom request;
   Atom feature_atom;
 
-  request = XInternAtom(xdo->xdpy, "_NET_SUPPORTED", False);
   feature_atom = XInternAtom(xdo->xdpy, feature, False);
+
+  request = XInternAtom(xdo->xdpy, "_NET_SUPPORTED", False);
   root = XDefaultRootWindow(xdo->xdpy);
 
+  /* Inside a batch, read _NET_SUPPORTED once and keep it until the end */
+  if (xdo->batch) {
+    struct xdo_ewmh_supported *supported = xdo->batch_ewmh_supported;
+    if (!supported->fetched) {
+      supported->fetched = True;
+      supported->atoms = (Atom *)xdo_get_window_property_by_atom(
+          xdo, root, request, &supported->natoms, &type, &size);
+      if (supported->atoms == NULL) {
+        supported->natoms = 0;
+      }
+    }
+    for (i = 0L; i < supported->natoms; i++) {
+      if (supported->atoms[i] == feature_atom) {
+        return True;
+      }
+    }
+    return False;
+  }
+
   results = (Atom *) xdo_get_window_property_by_atom(xdo, root, request, &nitems, &type, &size);
   for (i = 0L; i < nitems; i++) {
     if (results[i] == feature_atom) {
@@ -1687,7 +3399,7 @@ void _xdo_send_key(const xdo_t *xdo, Window window, charcodemap_t *key,
   /* Skipping the usleep if delay is 0 is much faster than calling usleep(0) */
   XFlush(xdo->xdpy);
   if (delay > 0) {
-    usleep(delay);
+    _xdo_usleep(__func__, delay);
   }
 }
 int _xdo_query_keycode_to_modifier(XModifierKeymap *modmap, KeyCode keycode) {
@@ -1744,6 +3456,7 @@ void _xdo_send_modifier(const xdo_t *xdo, int modmask, int is_press) {
 
 int xdo_get_active_modifiers(const xdo_t *xdo, charcodemap_t **keys,
                                     int *nkeys) {
+  XDO_CALL(xdo);
   /* For each keyboard device, if an active key is a modifier,
    * then add the keycode to the keycode list */
 
@@ -1787,13 +3500,14 @@ int xdo_get_active_modifiers(const xdo_t *xdo, charcodemap_t **keys,
 }
 
 unsigned int xdo_get_input_state(const xdo_t *xdo) {
+  XDO_CALL(xdo);
   Window root, dummy;
   int root_x, root_y, win_x, win_y;
   unsigned int mask;
   root = DefaultRootWindow(xdo->xdpy);
 
   XQueryPointer(xdo->xdpy, root, &dummy, &dummy,
-                &root_x, &root_y, &win_x, &win_y, &mask);
+            &root_x, &root_y, &win_x, &win_y, &mask);
 
   return mask;
 }
@@ -1803,6 +3517,7 @@ const char **xdo_get_symbol_map(void) {
 }
 
 int xdo_clear_active_modifiers(const xdo_t *xdo, Window window, charcodemap_t *active_mods, int active_mods_n) {
+  XDO_CALL(xdo);
   int ret = 0;
   unsigned int input_state = xdo_get_input_state(xdo);
   xdo_send_keysequence_window_list_do(xdo, window, active_mods,
@@ -1831,6 +3546,7 @@ int xdo_clear_active_modifiers(const xdo_t *xdo, Window window, charcodemap_t *a
 }
 
 int xdo_set_active_modifiers(const xdo_t *xdo, Window window, charcodemap_t *active_mods, int active_mods_n) {
+  XDO_CALL(xdo);
   int ret = 0;
   unsigned int input_state = xdo_get_input_state(xdo);
   xdo_send_keysequence_window_list_do(xdo, window, active_mods,
@@ -1858,17 +3574,16 @@ int xdo_set_active_modifiers(const xdo_t *xdo, Window window, charcodemap_t *act
 }
 
 int xdo_get_pid_window(const xdo_t *xdo, Window window) {
+  XDO_CALL(xdo);
   Atom type;
   int size;
   long nitems;
   unsigned char *data;
   int window_pid = 0;
 
-  if (atom_NET_WM_PID == (Atom)-1) {
-    atom_NET_WM_PID = XInternAtom(xdo->xdpy, "_NET_WM_PID", False);
-  }
-
-  data = xdo_get_window_property_by_atom(xdo, window, atom_NET_WM_PID, &nitems, &type, &size);
+  data = xdo_get_window_property_by_atom(xdo, window,
+                                         xdo->atoms[XDO_ATOM_NET_WM_PID],
+                                         &nitems, &type, &size);
 
   if (nitems > 0) {
     /* The data itself is unsigned long, but everyone uses int as pid values */
@@ -1876,10 +3591,32 @@ int xdo_get_pid_window(const xdo_t *xdo, Window window) {
   }
   free(data);
 
+  /* Without _NET_WM_PID, ask the X server which process owns the client
+   * connection that created the window. Only known for local clients. */
+  if (window_pid == 0 && _xdo_has_xres(xdo)) {
+    XResClientIdSpec spec;
+    XResClientIdValue *ids = NULL;
+    long nids = 0;
+    long i;
+
+    spec.client = window;
+    spec.mask = XRES_CLIENT_ID_PID_MASK;
+    if (XResQueryClientIds(xdo->xdpy, 1, &spec, &nids, &ids) == Success) {
+      for (i = 0; i < nids; i++) {
+        if (XResGetClientIdType(&ids[i]) == XRES_CLIENT_ID_PID
+            && XResGetClientPid(&ids[i]) > 0) {
+          window_pid = (int) XResGetClientPid(&ids[i]);
+        }
+      }
+      XResClientIdsDestroy(nids, ids);
+    }
+  }
+
   return window_pid;
 }
 
 int xdo_wait_for_mouse_move_from(const xdo_t *xdo, int origin_x, int origin_y) {
+  XDO_CALL(xdo);
   int x, y;
   int ret = 0;
   int tries = MAX_TRIES;
@@ -1887,7 +3624,7 @@ int xdo_wait_for_mouse_move_from(const xdo_t *xdo, int origin_x, int origin_y) {
   ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
   while (tries > 0 && 
          (x == origin_x && y == origin_y)) {
-    usleep(30000);
+    _xdo_usleep(__func__, 30000);
     ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
     tries--;
   }
@@ -1896,13 +3633,14 @@ int xdo_wait_for_mouse_move_from(const xdo_t *xdo, int origin_x, int origin_y) {
 }
 
 int xdo_wait_for_mouse_move_to(const xdo_t *xdo, int dest_x, int dest_y) {
+  XDO_CALL(xdo);
   int x, y;
   int ret = 0;
   int tries = MAX_TRIES;
 
   ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
   while (tries > 0 && (x != dest_x && y != dest_y)) {
-    usleep(30000);
+    _xdo_usleep(__func__, 30000);
     ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
     tries--;
   }
@@ -1911,6 +3649,7 @@ int xdo_wait_for_mouse_move_to(const xdo_t *xdo, int dest_x, int dest_y) {
 }
 
 int xdo_get_desktop_viewport(const xdo_t *xdo, int *x_ret, int *y_ret) {
+  XDO_CALL(xdo);
   if (_xdo_ewmh_is_supported(xdo, "_NET_DESKTOP_VIEWPORT") == False) {
     fprintf(stderr,
             "Your windowmanager claims not to support _NET_DESKTOP_VIEWPORT, "
@@ -1951,6 +3690,7 @@ int xdo_get_desktop_viewport(const xdo_t *xdo, int *x_ret, int *y_ret) {
 }
 
 int xdo_set_desktop_viewport(const xdo_t *xdo, int x, int y) {
+  XDO_CALL(xdo);
   XEvent xev;
   int ret;
   Window root = RootWindow(xdo->xdpy, 0);
@@ -1960,7 +3700,7 @@ int xdo_set_desktop_viewport(const xdo_t *xdo, int x, int y) {
   xev.xclient.display = xdo->xdpy;
   xev.xclient.window = root;
   xev.xclient.message_type = XInternAtom(xdo->xdpy, "_NET_DESKTOP_VIEWPORT",
-                                         False);
+                                       False);
   xev.xclient.format = 32;
   xev.xclient.data.l[0] = x;
   xev.xclient.data.l[1] = y;
@@ -1974,18 +3714,21 @@ int xdo_set_desktop_viewport(const xdo_t *xdo, int x, int y) {
 }
 
 int xdo_kill_window(const xdo_t *xdo, Window window) {
+  XDO_CALL(xdo);
   int ret;
   ret = XKillClient(xdo->xdpy, window);
   return _is_success("XKillClient", ret == 0, xdo);
 }
 
 int xdo_close_window(const xdo_t *xdo, Window window) {
+  XDO_CALL(xdo);
   int ret;
   ret = XDestroyWindow(xdo->xdpy, window);
   return _is_success("XDestroyWindow", ret == 0, xdo);
 }
 
 int xdo_quit_window(const xdo_t *xdo, Window window) {
+  XDO_CALL(xdo);
   XEvent xev;
   int ret;
   Window root = RootWindow(xdo->xdpy, 0);
@@ -2011,19 +3754,7 @@ int xdo_quit_window(const xdo_t *xdo, Window window) {
 int xdo_get_window_name(const xdo_t *xdo, Window window, 
                         unsigned char **name_ret, int *name_len_ret,
                         int *name_type) {
-  if (atom_NET_WM_NAME == (Atom)-1) {
-    atom_NET_WM_NAME = XInternAtom(xdo->xdpy, "_NET_WM_NAME", False);
-  } 
-  if (atom_WM_NAME == (Atom)-1) {
-    atom_WM_NAME = XInternAtom(xdo->xdpy, "WM_NAME", False);
-  }
-  if (atom_STRING == (Atom)-1) {
-    atom_STRING = XInternAtom(xdo->xdpy, "STRING", False);
-  }
-  if (atom_UTF8_STRING == (Atom)-1) {
-    atom_UTF8_STRING = XInternAtom(xdo->xdpy, "UTF8_STRING", False);
-  }
-
+  XDO_CALL(xdo);
   Atom type;
   int size;
   long nitems;
@@ -2034,11 +3765,11 @@ int xdo_get_window_name(const xdo_t *xdo, Window window,
    * If no WM_NAME, set name_ret to NULL and set len to 0
    */
 
-  *name_ret = xdo_get_window_property_by_atom(xdo, window, atom_NET_WM_NAME, &nitems,
-                             &type, &size);
+  *name_ret = xdo_get_window_property_by_atom(xdo, window,
+      xdo->atoms[XDO_ATOM_NET_WM_NAME], &nitems, &type, &size);
   if (nitems == 0) {
-    *name_ret = xdo_get_window_property_by_atom(xdo, window, atom_WM_NAME, &nitems,
-                               &type, &size);
+    *name_ret = xdo_get_window_property_by_atom(xdo, window,
+        xdo->atoms[XDO_ATOM_WM_NAME], &nitems, &type, &size);
   }
   *name_len_ret = nitems;
   *name_type = type;
@@ -2047,6 +3778,7 @@ int xdo_get_window_name(const xdo_t *xdo, Window window,
 }
 
 int xdo_get_window_classname(const xdo_t *xdo, Window window, unsigned char **class_ret) {
+  XDO_CALL(xdo);
   XClassHint classhint;
   Status ret = XGetClassHint(xdo->xdpy, window, &classhint);
 
@@ -2060,6 +3792,7 @@ int xdo_get_window_classname(const xdo_t *xdo, Window window, unsigned char **cl
 }
 
 int xdo_window_state(xdo_t *xdo, Window window, unsigned long action, const char *property) {
+  XDO_CALL(xdo);
   int ret;
   XEvent xev;
   Window root = RootWindow(xdo->xdpy, 0);
@@ -2080,13 +3813,17 @@ int xdo_window_state(xdo_t *xdo, Window window, unsigned long action, const char
 }
 
 int xdo_minimize_window(const xdo_t *xdo, Window window) {
+  XDO_CALL(xdo);
   int ret;
   int screen;
+  Window root;
+
+  _xdo_errors_tag(xdo, __func__, window);
 
   /* Get screen number */
-  XWindowAttributes attr;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
-  screen = XScreenNumberOfScreen(attr.screen);
+  if (_xdo_window_root(xdo, window, &root, &screen) != XDO_SUCCESS) {
+    return _is_success("XGetWindowAttributes", XDO_ERROR, xdo);
+  }
 
   /* Minimize it */
   ret = XIconifyWindow(xdo->xdpy, window, screen);
@@ -2119,7 +3856,7 @@ void _xdo_eprintf(const xdo_t *xdo, int hushable, const char *format, ...) {
 } /* _xdo_eprintf */
 
 void xdo_enable_feature(xdo_t *xdo, int feature) {
-  xdo->features_mask |= (0 << feature);
+  xdo->features_mask |= (1 << feature);
 }
 
 void xdo_disable_feature(xdo_t *xdo, int feature) {
@@ -2132,6 +3869,7 @@ int xdo_has_feature(xdo_t *xdo, int feature) {
 
 int xdo_get_viewport_dimensions(xdo_t *xdo, unsigned int *width,
                                 unsigned int *height, int screen) {
+  XDO_CALL(xdo);
   int dummy;
 
   if (XineramaQueryExtension(xdo->xdpy, &dummy, &dummy) \
@@ -70,8 +70,51 @@ typedef struct charcodemap {
 
 typedef enum {
   XDO_FEATURE_XTEST, /** Is XTest available? */
+  XDO_FEATURE_XCB, /** Pipeline independent requests over XCB? Off with XDO_BACKEND=xlib */
 } XDO_FEATURES;
 
+/**
+ * An X error reported for a request queued inside a batch.
+ *
+ * @see xdo_batch_end
+ */
+typedef struct xdo_batch_error {
+  Window window;     /** the window the failed call acted on, or the resource id the error names */
+  int error_code;    /** the X error code, such as BadWindow */
+  int request_code;  /** the major opcode of the failed request */
+  unsigned long serial; /** the sequence number of the failed request */
+  const char *call;  /** the libxdo function that sent it, e.g. "xdo_move_window", or NULL */
+} xdo_batch_error_t;
+
+/**
+ * What the calls to one public libxdo function have cost.
+ *
+ * @see xdo_get_stats
+ */
+typedef struct xdo_stat {
+  const char *call;            /** the xdo_* function, e.g. "xdo_search_windows" */
+  unsigned long count;         /** times it was called */
+  unsigned long requests;      /** X requests it sent */
+  unsigned long round_trips;   /** times it waited for a reply from the X server */
+  unsigned long long bytes_sent;     /** bytes written to the connection */
+  unsigned long long bytes_received; /** bytes read from the connection */
+  double time;                 /** seconds spent in it */
+} xdo_stat_t;
+
+/**
+ * What a connection has cost so far.
+ *
+ * @see xdo_get_stats
+ */
+typedef struct xdo_stats {
+  unsigned long requests;      /** X requests sent on the connection */
+  unsigned long round_trips;   /** times libxdo waited for a reply */
+  unsigned long long bytes_sent;     /** bytes written to the connection */
+  unsigned long long bytes_received; /** bytes read from the connection */
+  xdo_stat_t *calls;           /** costs per public libxdo function, malloc'd */
+  unsigned int ncalls;         /** length of calls */
+} xdo_stats_t;
+
 /**
  * The main context.
  */
@@ -110,6 +153,34 @@ typedef struct xdo {
   /** Feature flags, such as XDO_FEATURE_XTEST, etc... */
   int features_mask;
 
+  /** @internal Nonzero while a batch is open. @see xdo_batch_begin */
+  int batch;
+
+  /** @internal _NET_SUPPORTED, read by the first EWMH check in the batch */
+  struct xdo_ewmh_supported *batch_ewmh_supported;
+
+  /** @internal X errors collected for this connection, see xdo_errors.h */
+  struct xdo_error_log *error_log;
+
+  /** @internal Calls counted with XDO_STATS, see xdo_stats.h */
+  struct xdo_stats_log *stats_log;
+
+  /** @internal True if xdo_init_threads ran before this was created */
+  int threads;
+
+  /** @internal Outstanding xdo_async_* queries, oldest first */
+  struct xdo_async *async_head;
+
+  /** @internal Newest outstanding xdo_async_* query */
+  struct xdo_async *async_tail;
+
+  /** @internal Atoms interned when this xdo was created */
+  Atom *atoms;
+
+  /** @internal Nonzero if charcodes and atoms belong to the xdo_pool_t
+   * this xdo came from, and are not ours to free */
+  int shared;
+
 } xdo_t;
 
 
@@ -169,6 +240,63 @@ typedef struct xdo {
  */
 #define SEARCH_ROLE (1UL << 8)
 
+/**
+ * Only consider windows managed by the window manager. Candidates are read
+ * from the root window's _NET_CLIENT_LIST_STACKING (or _NET_CLIENT_LIST)
+ * property instead of walking the whole window tree; max_depth is ignored.
+ * If the window manager does not publish a client list, the tree is walked
+ * as usual.
+ * @see xdo_search_windows
+ */
+#define SEARCH_CLIENTS (1UL << 9)
+
+/**
+ * Don't search below client windows, that is, windows with the WM_STATE
+ * property set by the window manager. The client windows themselves are
+ * still checked, but their toolkit subwindows are not.
+ * @see xdo_search_windows
+ */
+#define SEARCH_TOPLEVEL (1UL << 10)
+
+/**
+ * With more than one screen, search all screens at once. One extra display
+ * connection and thread is used per screen, from an xdo_pool_t sharing the
+ * xdo_t's tables; results are returned in the same order as a serial
+ * search. Ignored with SEARCH_SCREEN.
+ *
+ * The program must call xdo_init_threads (or xdo_pool_new) before
+ * anything else uses Xlib; otherwise the screens are searched one after
+ * another. Calling XInitThreads directly is not enough, as libxdo can't
+ * tell that it was done.
+ * @see xdo_search_windows
+ */
+#define SEARCH_PARALLEL (1UL << 11)
+
+/**
+ * Match patterns as plain text that may appear anywhere in the window's
+ * name, class, etc, ignoring case, instead of as regular expressions.
+ * Patterns without any regular expression operators are matched this way
+ * even without this flag.
+ * @see xdo_search_windows
+ */
+#define SEARCH_FIXED (1UL << 12)
+
+/**
+ * Match patterns as shell-style globs ('*', '?', '[...]') against the whole
+ * name, class, etc, ignoring case, instead of as regular expressions.
+ * @see xdo_search_windows
+ */
+#define SEARCH_GLOB (1UL << 13)
+
+/**
+ * With SEARCH_PID, also match windows of every descendant of the process,
+ * such as programs started through a wrapper script. The process tree is
+ * read from /proc once per search; where there is no /proc, only the
+ * process itself matches.
+ * @see xdo_search_windows
+ */
+#define SEARCH_PIDTREE (1UL << 14)
+
 /**
  * The window search query structure.
  *
@@ -238,6 +366,72 @@ const char *xdo_version(void);
  */
 void xdo_free(xdo_t *xdo);
 
+/**
+ * A set of connections to one display, one per thread.
+ *
+ * An xdo_t, like the Display it wraps, must only be used by one thread at
+ * a time. For many threads driving the same display, a pool hands each
+ * thread its own xdo_t on its own connection. The keymap and atom tables
+ * are read once, when the pool is created, and shared read-only by every
+ * connection. Searches and batches on different threads may run at once;
+ * the Xlib error handler they need is installed while any of them runs, and
+ * errors are kept per connection.
+ *
+ * @see xdo_pool_new
+ */
+typedef struct xdo_pool xdo_pool_t;
+
+/**
+ * Make Xlib safe to use from several threads, with XInitThreads, and let
+ * libxdo know it was done. Only the first call does anything.
+ *
+ * This must be called before anything else in the program uses Xlib. It
+ * is needed for SEARCH_PARALLEL, and done by xdo_pool_new.
+ *
+ * @return nonzero if Xlib is thread-safe, 0 if XInitThreads failed.
+ */
+int xdo_init_threads(void);
+
+/**
+ * Create a pool of connections to a display.
+ *
+ * This calls xdo_init_threads, so it must be called before anything else
+ * in the program uses Xlib.
+ *
+ * @param display the display name, as for xdo_new.
+ * @return the new pool, or NULL if the display can't be opened. Free it
+ *   with xdo_pool_free.
+ */
+xdo_pool_t *xdo_pool_new(const char *display);
+
+/**
+ * Create a pool of connections to the display of an existing xdo_t. The
+ * connections share its keymap and atom tables instead of reading their
+ * own, so 'xdo' must not be freed before the pool.
+ *
+ * Xlib must already be thread-safe: xdo_init_threads has to have been
+ * called before 'xdo' was created.
+ *
+ * @param xdo the xdo_t whose display and tables to share.
+ * @return the new pool. Free it with xdo_pool_free, which leaves 'xdo' open.
+ */
+xdo_pool_t *xdo_pool_new_with_xdo(const xdo_t *xdo);
+
+/**
+ * Get the calling thread's xdo_t, opening its connection the first time
+ * the thread asks. The xdo_t stays open until xdo_pool_free; don't free it
+ * yourself.
+ *
+ * @return the thread's xdo_t, or NULL if no connection could be opened.
+ */
+xdo_t *xdo_pool_get(xdo_pool_t *pool);
+
+/**
+ * Close every connection of a pool. No thread may use the pool, or an
+ * xdo_t from it, any more.
+ */
+void xdo_pool_free(xdo_pool_t *pool);
+
 /**
  * Move the mouse to a specific location.
  *
@@ -264,6 +458,102 @@ int xdo_move_mouse_relative_to_window(const xdo_t *xdo, Window window, int x, in
  */
 int xdo_move_mouse_relative(const xdo_t *xdo, int x, int y);
 
+/**
+ * Paths for xdo_move_mouse_path.
+ */
+#define XDO_MOUSE_PATH_LINE 0  /** a straight line at constant speed */
+#define XDO_MOUSE_PATH_EASE 1  /** a straight line, speeding up then slowing down */
+#define XDO_MOUSE_PATH_CURVE 2 /** an eased curve, bowing to the right of a straight line */
+
+/**
+ * Move the mouse to a specific location in steps, along a path.
+ *
+ * One motion is sent per step, 'interval' nanoseconds apart. The steps are
+ * timed from the start of the move, so a step that is sent late does not
+ * delay the ones after it. If the mouse is on another screen, it is moved
+ * in one jump.
+ *
+ * @param x the target X coordinate on the screen in pixels.
+ * @param y the target Y coordinate on the screen in pixels.
+ * @param screen the screen (number) you want to move on.
+ * @param path one of XDO_MOUSE_PATH_LINE, XDO_MOUSE_PATH_EASE or
+ *   XDO_MOUSE_PATH_CURVE.
+ * @param steps how many motions to send. The last one reaches x, y.
+ * @param interval nanoseconds between motions.
+ */
+int xdo_move_mouse_path(const xdo_t *xdo, int x, int y, int screen, int path,
+                        unsigned int steps, unsigned long interval);
+
+/**
+ * A core keyboard or pointer event, as recorded by xdo_record_input and
+ * replayed by xdo_replay_input.
+ */
+typedef struct xdo_input_event {
+  unsigned long time;  /** server time of the event, in milliseconds */
+  int type;            /** KeyPress, KeyRelease, ButtonPress, ButtonRelease or MotionNotify */
+  unsigned int detail; /** the keycode or button, 0 for MotionNotify */
+  int x;               /** pointer X position on the root window */
+  int y;               /** pointer Y position on the root window */
+  int screen;          /** the screen whose root window x and y are on */
+} xdo_input_event_t;
+
+/**
+ * Return values for an xdo_record_cb_t callback.
+ * @see xdo_record_input
+ */
+#define XDO_RECORD_CONTINUE 0
+#define XDO_RECORD_STOP 1
+
+/**
+ * Called by xdo_record_input for each input event.
+ *
+ * @param event the event.
+ * @param userdata the pointer given to xdo_record_input.
+ * @return XDO_RECORD_CONTINUE to keep recording, XDO_RECORD_STOP to stop.
+ */
+typedef int (*xdo_record_cb_t)(const xdo_t *xdo,
+                               const xdo_input_event_t *event, void *userdata);
+
+/**
+ * Record keyboard and pointer input from all devices with the RECORD
+ * extension, passing each event to a callback as it happens.
+ *
+ * Blocks until the callback returns XDO_RECORD_STOP, or until a signal
+ * interrupts the wait for input, so a signal handler that simply returns
+ * stops a recording.
+ *
+ * @param callback called for each event.
+ * @param userdata passed to the callback.
+ * @return XDO_ERROR if the RECORD extension is unavailable.
+ */
+int xdo_record_input(const xdo_t *xdo, xdo_record_cb_t callback,
+                     void *userdata);
+
+/**
+ * Called by xdo_replay_input for the next event to replay.
+ *
+ * @param event_ret where to store the event.
+ * @param userdata the pointer given to xdo_replay_input.
+ * @return True if there was another event, False at the end.
+ */
+typedef int (*xdo_replay_cb_t)(const xdo_t *xdo, xdo_input_event_t *event_ret,
+                               void *userdata);
+
+/**
+ * Replay recorded input with XTEST, keeping the time between events.
+ *
+ * The first event is sent straight away, and each one after it once as
+ * much time has passed as had passed since the first when it was recorded.
+ * The pointer is moved on the screen each motion was recorded on; motion
+ * on a screen the display doesn't have is skipped. Keys and buttons still
+ * held down at the end are released.
+ *
+ * @param next called for each event in turn.
+ * @param userdata passed to next.
+ * @return XDO_ERROR if the XTEST extension is unavailable.
+ */
+int xdo_replay_input(const xdo_t *xdo, xdo_replay_cb_t next, void *userdata);
+
 /**
  * Send a mouse press (aka mouse down) for a given button at the current mouse
  * location.
@@ -559,8 +849,12 @@ int xdo_get_focused_window(const xdo_t *xdo, Window *window_ret);
 int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus);
 
 /**
- * Get the PID owning a window. Not all applications support this.
- * It looks at the _NET_WM_PID property of the window.
+ * Get the PID owning a window.
+ *
+ * This looks at the _NET_WM_PID property of the window. Not all
+ * applications set it; for those, the X-Resource extension (1.2 or newer)
+ * is asked which process owns the client connection that created the
+ * window. That is only known for clients on the same host as the X server.
  *
  * @param window the window to query.
  * @return the process id or 0 if no pid found.
@@ -671,6 +965,41 @@ int xdo_get_window_location(const xdo_t *xdo, Window wid,
 int xdo_get_window_size(const xdo_t *xdo, Window wid, unsigned int *width_ret,
                         unsigned int *height_ret);
 
+/**
+ * The geometry of one window, as returned by xdo_get_windows_geometry.
+ */
+typedef struct xdo_window_geometry {
+  Window window;        /** the window queried */
+  int x;                /** X position, relative to the root window */
+  int y;                /** Y position, relative to the root window */
+  unsigned int width;   /** width in pixels */
+  unsigned int height;  /** height in pixels */
+  int screen;           /** the screen number the window is on */
+  /** XDO_SUCCESS, or XDO_ERROR if the window could not be queried (for
+   * example, because it no longer exists). The other fields are only
+   * valid on XDO_SUCCESS. */
+  int status;
+} xdo_window_geometry_t;
+
+/**
+ * Get the location and size of many windows at once.
+ *
+ * This gives the same results as calling xdo_get_window_location and
+ * xdo_get_window_size for each window, but the requests for all windows are
+ * sent together, so the whole query costs one round trip to the X server
+ * (two if the display has more than one screen) instead of four per window.
+ *
+ * @param windows the windows to query
+ * @param nwindows the number of windows
+ * @param geometry_ret array of at least nwindows entries where the geometry
+ *   of windows[i] is stored in geometry_ret[i].
+ * @return XDO_SUCCESS if every window was queried, XDO_ERROR if any failed.
+ *   Check the status field of each entry.
+ */
+int xdo_get_windows_geometry(const xdo_t *xdo, const Window *windows,
+                             unsigned int nwindows,
+                             xdo_window_geometry_t *geometry_ret);
+
 /* pager-like behaviors */
 
 /**
@@ -750,11 +1079,370 @@ int xdo_get_desktop_for_window(const xdo_t *xdo, Window wid, long *desktop);
  * @param search the search query.
  * @param windowlist_ret the list of matching windows to return
  * @param nwindows_ret the number of windows (length of windowlist_ret)
+ * @return XDO_ERROR if a pattern in the query is not a valid regular
+ *   expression, XDO_SUCCESS otherwise.
  * @see xdo_search_t
  */
 int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
                       Window **windowlist_ret, unsigned int *nwindows_ret);
 
+/**
+ * Return values for an xdo_search_cb_t callback.
+ * @see xdo_search_windows_cb
+ */
+#define XDO_SEARCH_CONTINUE 0
+#define XDO_SEARCH_STOP 1
+
+/**
+ * Called by xdo_search_windows_cb for each matching window.
+ *
+ * @param window the matching window.
+ * @param userdata the pointer given to xdo_search_windows_cb.
+ * @return XDO_SEARCH_CONTINUE to keep searching, XDO_SEARCH_STOP to end the
+ *   search.
+ */
+typedef int (*xdo_search_cb_t)(const xdo_t *xdo, Window window, void *userdata);
+
+/**
+ * Search for windows, reporting each match as soon as it is found.
+ *
+ * Windows are reported in the same order xdo_search_windows returns them.
+ * Nothing is collected, so memory use does not grow with the number of
+ * results. The search ends when the callback returns XDO_SEARCH_STOP or
+ * search->limit matches have been reported.
+ *
+ * @param search the search query.
+ * @param callback function called with each matching window.
+ * @param userdata passed to the callback as is.
+ * @return XDO_ERROR if a pattern in the query is not a valid regular
+ *   expression, XDO_SUCCESS otherwise.
+ * @see xdo_search_windows
+ */
+int xdo_search_windows_cb(const xdo_t *xdo, const xdo_search_t *search,
+                          xdo_search_cb_t callback, void *userdata);
+
+/**
+ * Called by xdo_search_windows_multi for each window matching a pattern.
+ *
+ * @param window the matching window.
+ * @param index the index of the matching pattern in the patterns array.
+ * @param userdata the pointer given to xdo_search_windows_multi.
+ * @return XDO_SEARCH_CONTINUE to keep searching, XDO_SEARCH_STOP to end the
+ *   search.
+ */
+typedef int (*xdo_search_multi_cb_t)(const xdo_t *xdo, Window window,
+                                     unsigned int index, void *userdata);
+
+/**
+ * Search for windows matching any of several patterns in one pass.
+ *
+ * Each pattern is checked against the fields selected in search->searchmask
+ * (SEARCH_NAME, SEARCH_CLASS, SEARCH_CLASSNAME, SEARCH_ROLE, SEARCH_TITLE)
+ * in place of the corresponding field of 'search'; the other criteria of
+ * 'search' apply to every pattern. The window tree is walked once and each
+ * window's properties are fetched at most once, however many patterns there
+ * are. A window matching several patterns is reported once per pattern.
+ *
+ * search->limit applies to each pattern separately. The search ends when
+ * every pattern has reached its limit or the callback returns
+ * XDO_SEARCH_STOP.
+ *
+ * @param search the search query shared by all patterns.
+ * @param patterns the patterns to search for.
+ * @param npatterns the number of patterns.
+ * @param callback function called with each matching window and the index
+ *   of the pattern it matched.
+ * @param userdata passed to the callback as is.
+ * @return XDO_ERROR if a pattern is not a valid regular expression,
+ *   XDO_SUCCESS otherwise.
+ * @see xdo_search_windows_cb
+ */
+int xdo_search_windows_multi(const xdo_t *xdo, const xdo_search_t *search,
+                             const char **patterns, unsigned int npatterns,
+                             xdo_search_multi_cb_t callback, void *userdata);
+
+/**
+ * Called by xdo_search_windows_watch when a window starts or stops matching.
+ *
+ * @param window the window.
+ * @param matched 1 if the window now matches the query, 0 if it no longer
+ *   does (including because it was destroyed).
+ * @param userdata the pointer given to xdo_search_windows_watch.
+ * @return XDO_SEARCH_CONTINUE to keep watching, XDO_SEARCH_STOP to return.
+ */
+typedef int (*xdo_search_watch_cb_t)(const xdo_t *xdo, Window window,
+                                     int matched, void *userdata);
+
+/**
+ * Watch for windows that start or stop matching a search.
+ *
+ * The window tree is searched once, reporting every window that matches,
+ * and then follows X events (windows created, destroyed, mapped, unmapped
+ * and reparented, and changes to the properties the query looks at) to
+ * report each change as it happens. Only windows named in an event are
+ * checked again, so the cost while watching depends on how busy the
+ * display is, not on how many windows there are.
+ *
+ * This selects events on the windows it follows and reads events from the
+ * xdo connection, so it should have the connection to itself.
+ * search->limit and the SEARCH_CLIENTS, SEARCH_TOPLEVEL and SEARCH_PARALLEL
+ * flags are ignored.
+ *
+ * @param search the search query.
+ * @param callback function called for every change.
+ * @param userdata passed to the callback as is.
+ * @return XDO_ERROR if a pattern in the query is not a valid regular
+ *   expression. Otherwise this only returns, with XDO_SUCCESS, after the
+ *   callback returns XDO_SEARCH_STOP.
+ */
+int xdo_search_windows_watch(const xdo_t *xdo, const xdo_search_t *search,
+                             xdo_search_watch_cb_t callback, void *userdata);
+
+/**
+ * An in-memory index of the windows on a display, for programs that search
+ * often.
+ *
+ * The index holds the name, class, classname and role of every window, and
+ * a trigram index over that text. It is kept up to date from X events, so
+ * searching it needs no round trips to the X server for those fields.
+ *
+ * @see xdo_window_index_new
+ */
+typedef struct xdo_window_index xdo_window_index_t;
+
+/**
+ * Build an index of every window on every screen.
+ *
+ * This walks the whole window tree once and selects PropertyChangeMask and
+ * SubstructureNotifyMask on every window. The index then needs the events
+ * of the xdo connection: call xdo_window_index_update to have it read them,
+ * or pass each event read elsewhere to xdo_window_index_handle_event.
+ *
+ * @return the new index. Free it with xdo_window_index_free.
+ */
+xdo_window_index_t *xdo_window_index_new(const xdo_t *xdo);
+
+/**
+ * Free an index and stop selecting events on the windows it followed.
+ */
+void xdo_window_index_free(xdo_window_index_t *index);
+
+/**
+ * Read every event pending on the xdo connection and apply it to the index.
+ * Events that don't concern the index are discarded.
+ */
+void xdo_window_index_update(xdo_window_index_t *index);
+
+/**
+ * Apply one X event to the index, for programs that read events themselves.
+ * Events that don't concern the index are ignored.
+ */
+void xdo_window_index_handle_event(xdo_window_index_t *index,
+                                   const XEvent *event);
+
+/**
+ * Search the windows in an index.
+ *
+ * Takes the same query as xdo_search_windows and returns the same windows.
+ * Pending events are applied first, with xdo_window_index_update. Windows
+ * are narrowed down to those containing the text that the patterns
+ * require, and only those are checked against the full patterns. The pid
+ * and desktop of a window are fetched from the X server the first time a
+ * query needs them and cached until they change.
+ *
+ * Results are ordered by depth in the window tree, shallowest first.
+ * SEARCH_CLIENTS, SEARCH_TOPLEVEL and SEARCH_PARALLEL are ignored.
+ *
+ * @param index the index to search.
+ * @param search the search query.
+ * @param windowlist_ret the list of matching windows to return
+ * @param nwindows_ret the number of windows (length of windowlist_ret)
+ * @return XDO_ERROR if a pattern in the query is not a valid regular
+ *   expression, XDO_SUCCESS otherwise.
+ * @see xdo_search_windows
+ */
+int xdo_window_index_search(xdo_window_index_t *index,
+                            const xdo_search_t *search,
+                            Window **windowlist_ret,
+                            unsigned int *nwindows_ret);
+
+/**
+ * A query started by one of the xdo_async_* functions.
+ *
+ * The handle is valid until its callback has run or it has been cancelled
+ * with xdo_async_cancel.
+ */
+typedef struct xdo_async xdo_async_t;
+
+/**
+ * The result of an asynchronous query. Which fields are set depends on the
+ * query; everything it points to is freed once the callback returns.
+ */
+typedef struct xdo_async_result {
+  /** XDO_SUCCESS, or XDO_ERROR if the query failed (for example, because
+   * the window no longer exists) */
+  int status;
+  /** the window queried; for xdo_async_get_active_window, the active window */
+  Window window;
+  int x;                /** xdo_async_get_window_location: X position */
+  int y;                /** xdo_async_get_window_location: Y position */
+  int screen;           /** xdo_async_get_window_location: screen number */
+  int pid;              /** xdo_async_get_pid_window: the pid, or 0 */
+  unsigned char *name;  /** xdo_async_get_window_name: the name, or NULL */
+  int name_len;         /** xdo_async_get_window_name: length of name in bytes */
+  int name_type;        /** xdo_async_get_window_name: type of name */
+  Window *windows;      /** xdo_async_search_windows: matching windows */
+  unsigned int nwindows; /** xdo_async_search_windows: number of windows */
+} xdo_async_result_t;
+
+/**
+ * Called from xdo_async_dispatch when a query completes. Queries complete
+ * in the order they were started.
+ *
+ * @param xdo the xdo instance the query was started on.
+ * @param result the result of the query.
+ * @param userdata the pointer given when the query was started.
+ */
+typedef void (*xdo_async_cb_t)(const xdo_t *xdo,
+                               const xdo_async_result_t *result,
+                               void *userdata);
+
+/**
+ * Start reading a window's name, like xdo_get_window_name.
+ *
+ * The xdo_async_* functions send their requests and return right away.
+ * Replies are read by xdo_async_dispatch, which calls 'callback' once the
+ * result is complete. Any number of queries may be outstanding on one
+ * connection. Atoms are interned the first time they are needed, which
+ * costs one round trip per process.
+ *
+ * @return a handle for the query.
+ */
+xdo_async_t *xdo_async_get_window_name(xdo_t *xdo, Window window,
+                                       xdo_async_cb_t callback,
+                                       void *userdata);
+
+/**
+ * Start reading a window's position relative to the root window, like
+ * xdo_get_window_location.
+ *
+ * @see xdo_async_get_window_name
+ */
+xdo_async_t *xdo_async_get_window_location(xdo_t *xdo, Window window,
+                                           xdo_async_cb_t callback,
+                                           void *userdata);
+
+/**
+ * Start reading the active window, like xdo_get_active_window. The query
+ * fails if the window manager does not support _NET_ACTIVE_WINDOW.
+ *
+ * @see xdo_async_get_window_name
+ */
+xdo_async_t *xdo_async_get_active_window(xdo_t *xdo,
+                                         xdo_async_cb_t callback,
+                                         void *userdata);
+
+/**
+ * Start reading the pid of a window from _NET_WM_PID. Unlike
+ * xdo_get_pid_window, this does not fall back to the X-Resource extension.
+ *
+ * @see xdo_async_get_window_name
+ */
+xdo_async_t *xdo_async_get_pid_window(xdo_t *xdo, Window window,
+                                      xdo_async_cb_t callback,
+                                      void *userdata);
+
+/**
+ * Start a window search, like xdo_search_windows.
+ *
+ * The window tree is walked one level per round trip, fetching what the
+ * query needs for the whole level at once. 'search' is copied, but the
+ * strings it points to must stay valid until the callback has run.
+ * SEARCH_PARALLEL is ignored. Setting up a SEARCH_PID query still waits
+ * for the X server.
+ *
+ * @return a handle for the query, or NULL if a pattern in the query is not
+ *   a valid regular expression.
+ * @see xdo_async_get_window_name
+ */
+xdo_async_t *xdo_async_search_windows(xdo_t *xdo, const xdo_search_t *search,
+                                      xdo_async_cb_t callback,
+                                      void *userdata);
+
+/**
+ * The file descriptor of the xdo connection, for use with poll, select or
+ * an event loop. Call xdo_async_dispatch when it becomes readable.
+ */
+int xdo_async_fd(const xdo_t *xdo);
+
+/**
+ * Read the replies that have arrived, send any follow-up requests, and call
+ * the callbacks of completed queries, oldest first. Never blocks.
+ *
+ * Replies may already have been read from the connection by Xlib, so call
+ * this once after starting queries too, not only when the file descriptor
+ * is readable. Callbacks may start new queries but must not call
+ * xdo_async_dispatch.
+ *
+ * @return the number of queries still outstanding.
+ */
+int xdo_async_dispatch(xdo_t *xdo);
+
+/**
+ * Cancel a query. Its callback will not be called. Replies already asked
+ * for are still read and dropped by xdo_async_dispatch.
+ */
+void xdo_async_cancel(xdo_t *xdo, xdo_async_t *async);
+
+/**
+ * Begin a batch of window operations.
+ *
+ * While a batch is open, libxdo functions that only send requests (move,
+ * resize, map, minimize, set desktop, etc) queue them without flushing or
+ * waiting for a reply, and EWMH support is checked against a copy of
+ * _NET_SUPPORTED read by the first check that needs it. Errors from the queued requests are
+ * collected instead of terminating the program, each tagged by its sequence
+ * number with the libxdo call and window it came from. Call xdo_batch_end
+ * to flush everything with a single round trip.
+ *
+ * Each xdo_t may have one batch open at a time.
+ *
+ * @return XDO_SUCCESS, or XDO_ERROR if a batch is already open.
+ */
+int xdo_batch_begin(xdo_t *xdo);
+
+/**
+ * Take the errors reported so far for requests in the open batch, without
+ * waiting for the server. Errors for requests it hasn't processed yet are
+ * returned by a later call, or by xdo_batch_end.
+ *
+ * This lets a long batch report failures as they come while staying fully
+ * pipelined.
+ *
+ * @param errors_ret If not NULL, a malloc'd array of the errors is stored
+ *   here. You must free it. If NULL, the errors are discarded.
+ * @param nerrors_ret If not NULL, the number of errors is stored here.
+ * @return XDO_SUCCESS if there were no errors, XDO_ERROR if there were or
+ *   no batch is open.
+ */
+int xdo_batch_take_errors(xdo_t *xdo, xdo_batch_error_t **errors_ret,
+                          unsigned int *nerrors_ret);
+
+/**
+ * End a batch started with xdo_batch_begin.
+ *
+ * This flushes every queued request and waits for the server to process
+ * them (one round trip). Any errors the server reported are returned.
+ *
+ * @param errors_ret If not NULL, a malloc'd array of the errors reported
+ *   for requests in this batch is stored here. You must free it. If NULL,
+ *   the errors are discarded.
+ * @param nerrors_ret If not NULL, the number of errors is stored here.
+ * @return XDO_SUCCESS if no request failed, XDO_ERROR otherwise.
+ */
+int xdo_batch_end(xdo_t *xdo, xdo_batch_error_t **errors_ret,
+                  unsigned int *nerrors_ret);
+
 /**
  * Generic property fetch.
  *
@@ -935,6 +1623,54 @@ int xdo_has_feature(xdo_t *xdo, int feature);
 int xdo_get_viewport_dimensions(xdo_t *xdo, unsigned int *width,
                                 unsigned int *height, int screen);
 
+/**
+ * Get what this connection has cost so far, to find out which calls are
+ * worth batching or caching.
+ *
+ * The requests sent and the bytes written and read are always known for the
+ * whole connection. Round trips, and the cost of each public xdo_* function,
+ * are only counted if the XDO_STATS environment variable was set to a value
+ * other than "0", or XDO_TRACE was set, when the xdo_t was created. A
+ * function called from another one, such as xdo_get_window_property_by_atom
+ * from xdo_get_window_name, is counted as part of its caller. Bytes are
+ * counted when they cross the socket, so requests Xlib buffered count
+ * against the call that flushed them. A search spread over one connection
+ * per screen only counts what it did on this one. With libxdo built by a
+ * compiler other than GCC or Clang, only the totals are counted.
+ *
+ * @param stats_ret Where to store the counts. Free stats_ret->calls when
+ *   done with it.
+ */
+void xdo_get_stats(const xdo_t *xdo, xdo_stats_t *stats_ret);
+
+/**
+ * Get the time to pass as the start of a span to xdo_trace_span.
+ *
+ * If the XDO_TRACE environment variable names a file, libxdo writes a
+ * timeline to it in the Chrome trace event format, which trace viewers such
+ * as Perfetto can load. Every public libxdo call is recorded, with the
+ * requests and round trips it made, as is every sleep libxdo makes, and
+ * programs can add spans of their own. The file is opened by the first call
+ * to this function, or to xdo_new, and is shared with processes forked after
+ * that. It is appended to, never truncated, so other processes tracing to
+ * the same file add their events to it.
+ *
+ * @return Microseconds on the trace clock, or 0 if not tracing.
+ */
+double xdo_trace_now(void);
+
+/**
+ * Record a span from 'start' until now in the XDO_TRACE file. Does nothing
+ * if not tracing.
+ *
+ * @param category A short identifier grouping spans, e.g. "command".
+ * @param name The name shown for the span.
+ * @param start The value xdo_trace_now returned when the span started.
+ * @param detail Shown with the span, or NULL.
+ */
+void xdo_trace_span(const char *category, const char *name, double start,
+                    const char *detail);
+
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,47 @@
+/* xdo asynchronous queries
+ *
+ * Shared by xdo.c, which runs the queue, and xdo_search.c, which
+ * implements xdo_async_search_windows.
+ */
+
+#ifndef _XDO_ASYNC_H_
+#define _XDO_ASYNC_H_
+
+#include "xdo.h"
+
+struct xdo_async {
+  struct xdo_async *next;
+
+  /* True once 'result' is complete */
+  int done;
+
+  /* Take the replies that have arrived and send any follow-up requests.
+   * Returns True once 'result' is complete. Must not block. */
+  int (*poll)(xdo_t *xdo, xdo_async_t *async);
+
+  /* Release 'data' and whatever 'result' points to */
+  void (*free)(xdo_async_t *async);
+
+  void *data;
+  xdo_async_result_t result;
+
+  /* NULL once cancelled */
+  xdo_async_cb_t callback;
+  void *userdata;
+};
+
+/* Queue a query whose requests have been sent. */
+xdo_async_t *_xdo_async_submit(xdo_t *xdo,
+                               int (*poll)(xdo_t *, xdo_async_t *),
+                               void (*free_fn)(xdo_async_t *),
+                               void *data, xdo_async_cb_t callback,
+                               void *userdata);
+
+/* Take the reply to request 'sequence', sent over XCB. Returns False if it
+ * has not arrived yet and 'block' is False. Otherwise returns True, with
+ * '*reply_ret' set to the reply, or NULL if the request failed. Time spent
+ * waiting is counted against 'call' for XDO_STATS. */
+int _xdo_async_reply(const xdo_t *xdo, unsigned int sequence, int block,
+                     void **reply_ret, const char *call);
+
+#endif /* ifndef _XDO_ASYNC_H_ */
@@ -34,11 +34,25 @@ extern int is_command(char *cmd);
 
 extern int window_get_arg(context_t *context, int min_arg, int window_arg_pos,
                           const char **window_arg);
+extern int window_batch_end(context_t *context, const char *cmd);
+extern void window_list_geometry(context_t *context, const Window *windows,
+                                 int nwindows,
+                                 xdo_window_geometry_t **geometry_ret,
+                                 unsigned int **root_w_ret,
+                                 unsigned int **root_h_ret);
 
 extern int context_execute(context_t *);
 
 extern void xdotool_debug(context_t *context, const char *format, ...);
+/* usleep, recorded in the XDO_TRACE timeline */
+extern void xdotool_usleep(unsigned long usec);
 extern void xdotool_output(context_t *context, const char *format, ...);
+extern int xdotool_output_parse(const char *name);
+extern void xdotool_record_begin(context_t *context);
+extern void xdotool_record_int(context_t *context, const char *key, long value);
+extern void xdotool_record_string(context_t *context, const char *key,
+                                  const char *value, int len);
+extern void xdotool_record_end(context_t *context);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,49 @@
+/* xdo error collection
+ *
+ * X errors arrive asynchronously, and Xlib hands them to one process-wide
+ * handler. While collection is on for an xdo_t, errors for requests sent
+ * on its connection are recorded instead of terminating the program, each
+ * tagged with the libxdo call and window it came from by its sequence
+ * number. Shared by xdo.c, which keeps the log, and xdo_search.c.
+ */
+
+#ifndef _XDO_ERRORS_H_
+#define _XDO_ERRORS_H_
+
+#include "xdo.h"
+
+/* An empty log for a connection, as every xdo_t has. Searches that make
+ * a shallow copy of an xdo_t for another connection need their own. */
+struct xdo_error_log *_xdo_error_log_new(Display *xdpy);
+void _xdo_error_log_free(struct xdo_error_log *log);
+
+/* Start collecting errors for requests sent from now on. Scopes nest, and
+ * an error belongs to the innermost scope its request was sent in. With
+ * 'ignore_badwindow', BadWindow errors in this scope are dropped: windows
+ * vanishing under a search are expected. */
+void _xdo_errors_begin(const xdo_t *xdo, int ignore_badwindow);
+
+/* End the innermost scope. Its errors that were not taken are reported on
+ * stderr (unless xdo->quiet) and dropped. Returns how many there were. */
+unsigned int _xdo_errors_end(const xdo_t *xdo);
+
+/* Report and drop the errors collected so far in the innermost scope, as
+ * _xdo_errors_end would, but keep collecting. For scopes that stay open
+ * indefinitely. Returns how many there were. */
+unsigned int _xdo_errors_flush(const xdo_t *xdo);
+
+/* Move the errors collected so far in the innermost scope to a malloc'd
+ * array. Returns how many there were. */
+unsigned int _xdo_errors_take(const xdo_t *xdo,
+                              xdo_batch_error_t **errors_ret);
+
+/* The requests sent next, up to the next tag, are made by 'call' on
+ * 'window'. Does nothing unless errors are being collected. */
+void _xdo_errors_tag(const xdo_t *xdo, const char *call, Window window);
+
+/* Put the program's own error handler back while running its callback,
+ * unless another thread needs ours */
+void _xdo_errors_suspend(void);
+void _xdo_errors_resume(void);
+
+#endif /* ifndef _XDO_ERRORS_H_ */
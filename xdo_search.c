@@ -3,67 +3,517 @@
  * Lets you search windows by a query
  */
 
+#define _GNU_SOURCE 1 /* for strcasestr and FNM_CASEFOLD */
+
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <regex.h>
+#include <fnmatch.h>
+#include <ctype.h>
+#include <dirent.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xatom.h>
 #include <X11/Xresource.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XTest.h>
+#include <X11/extensions/XRes.h>
+#include <xcb/xcb.h>
 #include "xdo.h"
+#include "xdo_async.h"
+#include "xdo_errors.h"
+#include "xdo_stats.h"
+
+/* Search predicates in the order they are evaluated: cheapest and most
+ * selective first. 'hard' predicates must hold in both SEARCH_ANY and
+ * SEARCH_ALL mode; for SEARCH_ANY, one of the others is enough. */
+static const struct {
+  unsigned int mask;
+  int hard;
+  const char *name;
+} predicates[] = {
+  { SEARCH_ONLYVISIBLE, True, "visible" },  /* GetWindowAttributes */
+  { SEARCH_PID, False, "pid" },             /* one small property, exact */
+  { SEARCH_CLASS, False, "class" },         /* WM_CLASS, fetched once ... */
+  { SEARCH_CLASSNAME, False, "classname" }, /* ... for both of these */
+  { SEARCH_NAME, False, "name" },           /* WM_NAME plus text conversion */
+  { SEARCH_TITLE, False, "title" },
+  { SEARCH_ROLE, False, "role" },
+  { SEARCH_DESKTOP, True, "desktop" },      /* one small property */
+};
+#define NPREDICATES (sizeof(predicates) / sizeof(predicates[0]))
+
+/* A compiled search pattern. Regular expressions are only used when the
+ * pattern needs one; literal patterns are plain case-insensitive string
+ * compares. */
+typedef struct pattern {
+  enum {
+    PATTERN_REGEX,     /* regexec */
+    PATTERN_SUBSTRING, /* literal anywhere in the string */
+    PATTERN_EXACT,     /* literal is the whole string */
+    PATTERN_PREFIX,    /* string starts with literal */
+    PATTERN_SUFFIX,    /* string ends with literal */
+    PATTERN_GLOB       /* fnmatch */
+  } type;
+  regex_t re;
+  char *literal;
+  size_t len;
+} pattern_t;
+
+/* A local client and its pid, from the X-Resource extension */
+typedef struct client_pid {
+  XID base; /* resource id base of the client */
+  int pid;
+} client_pid_t;
+
+/* A search query compiled once and checked against every window */
+typedef struct search_query {
+  const xdo_search_t *search;
+  pattern_t title_pat;
+  pattern_t class_pat;
+  pattern_t classname_pat;
+  pattern_t name_pat;
+  pattern_t role_pat;
+  Atom atom_role;
+  Atom atom_wm_state;
+  Atom atom_pid;
+  Atom atom_desktop;
+
+  /* with SEARCH_PIDTREE, search->pid and its descendants, sorted */
+  int *pids;
+  unsigned int npids;
+
+  /* pid of every local client, sorted by base; NULL without X-Resource */
+  client_pid_t *client_pids;
+  unsigned int nclient_pids;
+  XID client_mask;
+
+  /* indexes into predicates[] of the predicates to check, in order */
+  unsigned int plan[NPREDICATES];
+  unsigned int nplan;
+} search_query_t;
+
+/* A text property of a window, converted to UTF-8 */
+typedef struct window_text {
+  int fetched;
+  int empty;  /* property missing or empty; matched as "" */
+  char **list;
+  int count;
+} window_text_t;
+
+/* Window data fetched while checking a window. Each property is fetched at
+ * most once, however many predicates and queries look at it. */
+typedef struct window_info {
+  Window window;
+  int visible_fetched;
+  int visible;
+  int classhint_fetched;
+  Status classhint_status;
+  XClassHint classhint;
+  window_text_t name;
+  window_text_t role;
+  int pid_fetched;
+  int pid;
+  int desktop_fetched;
+  int desktop_ok;
+  long desktop;
+  int wm_state_fetched;
+  int wm_state;
+} window_info_t;
+
+/* Properties _xdo_prefetch_windows can fetch ahead, as bits in a mask */
+enum {
+  PREFETCH_CLASS,    /* WM_CLASS */
+  PREFETCH_NAME,     /* WM_NAME */
+  PREFETCH_ROLE,     /* WM_WINDOW_ROLE */
+  PREFETCH_PID,      /* _NET_WM_PID */
+  PREFETCH_WM_STATE, /* only whether WM_STATE exists */
+  PREFETCH_DESKTOP,  /* _NET_WM_DESKTOP */
+  PREFETCH_VISIBLE,  /* GetWindowAttributes rather than a property */
+  NPREFETCH = PREFETCH_VISIBLE
+};
+
+/* State of one search in progress. A search checks one or more queries
+ * against each window; the tree walk itself is controlled by 'search'. */
+typedef struct search_state {
+  const xdo_search_t *search;
+  search_query_t *queries;
+  unsigned int nqueries;
+  unsigned int *nmatches; /* per query */
+  unsigned int ndone;     /* queries that reached search->limit */
+  xdo_search_multi_cb_t callback;
+  void *userdata;
+  int stopped;
+  int in_worker; /* running on a search_worker_t thread */
+} search_state_t;
+
+/* Results collected by xdo_search_windows */
+typedef struct search_list {
+  Window *windows;
+  unsigned int nwindows;
+  unsigned int size;
+} search_list_t;
+
+/* Matches collected by a search_worker_t */
+typedef struct search_match_list {
+  Window *windows;
+  unsigned int *indexes;
+  unsigned int nmatches;
+  unsigned int size;
+} search_match_list_t;
+
+/* One screen searched on its own thread and connection for SEARCH_PARALLEL */
+typedef struct search_worker {
+  pthread_t thread;
+  int started;
+  int screen;
+  int searched; /* the worker got a connection and searched its screen */
+  xdo_pool_t *pool;
+  search_state_t state;
+  search_match_list_t list;
+} search_worker_t;
+
+/* Wraps a single-query callback for xdo_search_windows_cb */
+typedef struct search_single {
+  xdo_search_cb_t callback;
+  void *userdata;
+} search_single_t;
+
+/* XQueryTree requests sent together, see _xdo_children_send */
+typedef struct children_fetch {
+  xcb_query_tree_cookie_t *cookies;
+  unsigned int n;
+  unsigned int ntaken;
+} children_fetch_t;
+
+/* Requests sent ahead for a batch of windows, see _xdo_prefetch_send.
+ * Each window has a slot for every PREFETCH_* request, in the order they
+ * are sent; 'wanted' says which were. */
+typedef struct prefetch {
+  window_info_t *infos;
+  unsigned int ninfos;
+  unsigned int *wanted;
+  unsigned int *sequences;
+  unsigned int next; /* next slot to take a reply for */
+} prefetch_t;
+
+/* Steps of an xdo_async_search_windows, see search_async_poll */
+enum {
+  ASYNC_SCREEN,   /* start on the next screen */
+  ASYNC_CLIENTS,  /* waiting for the client list of the screen */
+  ASYNC_CHILDREN, /* waiting for the children of a level */
+  ASYNC_WINDOWS,  /* waiting for the prefetched data of 'children' */
+};
+
+/* An xdo_async_search_windows in progress: search_screen and
+ * find_matching_windows turned inside out, sending one batch of requests
+ * per step rather than waiting for the replies. */
+typedef struct search_async {
+  xdo_search_t search;
+  search_state_t state;
+  search_single_t single;
+  search_list_t list;
+  int phase;
+  int screen;
+  int checking_root;  /* 'children' is just the root window */
+  int checking_clients; /* 'children' is the client list */
+
+  Window *level, *next;
+  unsigned int nlevel, nnext;
+  unsigned int level_size, next_size;
+  long depth; /* depth of the windows in 'level' */
+
+  Window *children;
+  unsigned int nchildren, children_size;
+  window_info_t *infos;
+  unsigned int infos_size;
+
+  unsigned int client_sequences[2];
+  unsigned int nclient_replies;
+  void *client_replies[2];
+  children_fetch_t fetch;
+  prefetch_t prefetch;
+} search_async_t;
+
+/* A window in a window_table_t */
+typedef struct window_slot {
+  Window window; /* None if the slot is free */
+  int depth;
+  int matched;
+  unsigned int record; /* index into xdo_window_index.records */
+} window_slot_t;
+
+/* Open addressing hash table of windows, so that finding the window named
+ * in an event costs the same however many windows there are */
+typedef struct window_table {
+  window_slot_t *slots;
+  unsigned int size; /* a power of two */
+  unsigned int count;
+} window_table_t;
+
+/* State of xdo_search_windows_watch */
+typedef struct search_watch {
+  const xdo_search_t *search;
+  search_query_t query;
+  xdo_search_watch_cb_t callback;
+  void *userdata;
+  int stopped;
+
+  /* properties the query looks at */
+  Atom atoms[6];
+  unsigned int natoms;
+
+  window_table_t table;
+} search_watch_t;
+
+/* Trigrams of the text of a window, or that a pattern requires */
+typedef struct trigram_set {
+  unsigned int *trigrams; /* sorted and unique once finished */
+  unsigned int count;
+  unsigned int size;
+} trigram_set_t;
+
+/* The records whose text contains one trigram, sorted */
+typedef struct posting {
+  unsigned int trigram; /* 0 if the slot is free */
+  unsigned int *records;
+  unsigned int count;
+  unsigned int size;
+} posting_t;
+
+/* A window known to an xdo_window_index_t */
+typedef struct index_record {
+  window_info_t info; /* info.window is None if the record is free */
+  Window parent;      /* None for root windows */
+  int depth;
+  int screen;
+  int mapped;
+  trigram_set_t trigrams;
+} index_record_t;
+
+struct xdo_window_index {
+  const xdo_t *xdo;
+  window_table_t table; /* window to record */
+
+  index_record_t *records;
+  unsigned int nrecords;
+  unsigned int size;
+  unsigned int *free_records;
+  unsigned int nfree;
+
+  /* open addressing by trigram */
+  posting_t *postings;
+  unsigned int postings_size; /* a power of two */
+  unsigned int npostings;
+
+  Atom atom_role;
+  Atom atom_pid;
+  Atom atom_desktop;
+  Atom atom_wm_state;
+};
+
+static int pattern_compile(const char *text, pattern_t *pat,
+                           unsigned int searchmask);
+static int pattern_match(const pattern_t *pat, const char *str);
+static void pattern_free(pattern_t *pat);
+static int query_init(const xdo_t *xdo, search_query_t *query,
+                      const xdo_search_t *search);
+static void query_free(search_query_t *query);
+static void window_info_init(window_info_t *info, Window window);
+static void window_info_free(window_info_t *info);
+static int check_window_match(const xdo_t *xdo, window_info_t *info,
+                              const search_query_t *query);
+static XClassHint *_xdo_window_classhint(const xdo_t *xdo, window_info_t *info);
+static window_text_t *_xdo_window_text(const xdo_t *xdo, Window window,
+                                       Atom property, window_text_t *text);
+static void _xdo_window_text_set(const xdo_t *xdo, const XTextProperty *tp,
+                                 window_text_t *text);
+static int _xdo_match_window_text(const window_text_t *text,
+                                  const pattern_t *pat);
+static int _xdo_match_window_class(const xdo_t *xdo, window_info_t *info,
+                                   const pattern_t *pat);
+static int _xdo_match_window_classname(const xdo_t *xdo, window_info_t *info,
+                                       const pattern_t *pat);
+static int _xdo_match_window_pid(const xdo_t *xdo, window_info_t *info,
+                                 const search_query_t *query);
+static void _xdo_query_client_pids(const xdo_t *xdo, search_query_t *query);
+static int _xdo_client_pid(const search_query_t *query, Window window);
+static void _xdo_query_pid_tree(search_query_t *query, int pid);
+static int _xdo_pid_wanted(const search_query_t *query, int pid);
+static int _xdo_match_window_desktop(const xdo_t *xdo, window_info_t *info,
+                                     const search_query_t *query);
+static int _xdo_is_window_visible(const xdo_t *xdo, window_info_t *info);
+static int _xdo_has_wm_state(const xdo_t *xdo, window_info_t *info,
+                             Atom atom_wm_state);
+static int _xdo_pipelined(const xdo_t *xdo);
+static unsigned int _xdo_query_children(const xdo_t *xdo,
+                                        const Window *parents,
+                                        unsigned int nparents,
+                                        Window **children_ret,
+                                        unsigned int *size_ret);
+static void _xdo_prefetch_windows(const xdo_t *xdo,
+                                  const search_state_t *state,
+                                  window_info_t *infos, unsigned int ninfos);
+static void _xdo_children_send(const xdo_t *xdo, const Window *parents,
+                               unsigned int nparents, children_fetch_t *fetch);
+static int _xdo_children_take(const xdo_t *xdo, children_fetch_t *fetch,
+                              int block, Window **children_ret,
+                              unsigned int *size_ret,
+                              unsigned int *count_ret);
+static void _xdo_prefetch_send(const xdo_t *xdo, const search_state_t *state,
+                               window_info_t *infos, unsigned int ninfos,
+                               prefetch_t *prefetch);
+static int _xdo_prefetch_take(const xdo_t *xdo, prefetch_t *prefetch,
+                              int block);
+static int search_check_children(const xdo_t *xdo, search_state_t *state,
+                                 window_info_t *infos, unsigned int ninfos,
+                                 int descend, Window **next_ret,
+                                 unsigned int *nnext_ret,
+                                 unsigned int *next_size_ret);
+static int search_run(const xdo_t *xdo, const xdo_search_t *search,
+                      const xdo_search_t *searches, unsigned int nsearches,
+                      xdo_search_multi_cb_t callback, void *userdata);
+static int search_emit(const xdo_t *xdo, search_state_t *state, Window window,
+                       unsigned int index);
+static int search_check(const xdo_t *xdo, search_state_t *state,
+                        window_info_t *info);
+static void search_screen(const xdo_t *xdo, int screen, search_state_t *state);
+static void search_screens_parallel(const xdo_t *xdo, search_state_t *state);
+static void find_matching_windows(const xdo_t *xdo, Window root,
+                                  search_state_t *state);
+static int find_matching_clients(const xdo_t *xdo, Window root,
+                                 search_state_t *state);
+static int _xdo_search_list_add(const xdo_t *xdo, Window window, void *data);
+static void window_table_init(window_table_t *table);
+static window_slot_t *window_table_find(const window_table_t *table,
+                                        Window window);
+static window_slot_t *window_table_insert(window_table_t *table,
+                                          Window window);
+static void window_table_remove(window_table_t *table, window_slot_t *slot);
+static void watch_remove(const xdo_t *xdo, search_watch_t *watch,
+                         Window window);
+static void index_add_tree(xdo_window_index_t *index, Window window,
+                           Window parent, int depth, int screen);
+static void index_remove(xdo_window_index_t *index, Window window);
+static index_record_t *index_find(xdo_window_index_t *index, Window window);
+static void index_reindex(xdo_window_index_t *index, unsigned int record);
+static posting_t *index_posting(xdo_window_index_t *index,
+                                unsigned int trigram, int create);
+static int index_lookup(xdo_window_index_t *index, const trigram_set_t *set,
+                        unsigned int **records_ret, unsigned int *count_ret);
+static int index_viewable(xdo_window_index_t *index, const index_record_t *rec);
+static void trigram_set_add_text(trigram_set_t *set, const char *text,
+                                 size_t len);
+static void trigram_set_finish(trigram_set_t *set);
+static void pattern_trigrams(const pattern_t *pat, trigram_set_t *set);
+static const pattern_t *query_pattern(const search_query_t *query,
+                                      unsigned int mask);
+static void watch_check(const xdo_t *xdo, search_watch_t *watch,
+                        window_slot_t *slot);
+static void watch_emit(const xdo_t *xdo, search_watch_t *watch, Window window,
+                       int matched);
+static void watch_add_tree(const xdo_t *xdo, search_watch_t *watch,
+                           Window window, int depth);
+static void watch_remove_tree(const xdo_t *xdo, search_watch_t *watch,
+                              Window window);
+static void watch_event(const xdo_t *xdo, search_watch_t *watch, XEvent *e);
+static int _xdo_search_match_list_add(const xdo_t *xdo, Window window,
+                                      unsigned int index, void *data);
+static int _xdo_search_single(const xdo_t *xdo, Window window,
+                              unsigned int index, void *data);
+
+int xdo_search_windows_cb(const xdo_t *xdo, const xdo_search_t *search,
+                          xdo_search_cb_t callback, void *userdata) {
+  XDO_CALL(xdo);
+  search_single_t single;
+
+  single.callback = callback;
+  single.userdata = userdata;
+  return search_run(xdo, search, search, 1, _xdo_search_single, &single);
+} /* int xdo_search_windows_cb */
+
+int xdo_search_windows_multi(const xdo_t *xdo, const xdo_search_t *search,
+                             const char **patterns, unsigned int npatterns,
+                             xdo_search_multi_cb_t callback, void *userdata) {
+  XDO_CALL(xdo);
+  xdo_search_t *searches;
+  unsigned int i;
+  int ret;
 
-static int compile_re(const char *pattern, regex_t *re);
-static int check_window_match(const xdo_t *xdo, Window wid, const xdo_search_t *search);
-static int _xdo_match_window_class(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_classname(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_role(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_name(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_title(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_pid(const xdo_t *xdo, Window window, int pid);
-static int _xdo_is_window_visible(const xdo_t *xdo, Window wid);
-static void find_matching_windows(const xdo_t *xdo, Window window, 
-                                  const xdo_search_t *search,
-                                  Window **windowlist_ret,
-                                  unsigned int *nwindows_ret,
-                                  unsigned int *windowlist_size,
-                                  int current_depth);
+  if (npatterns == 0) {
+    return XDO_SUCCESS;
+  }
 
-int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
-                      Window **windowlist_ret, unsigned int *nwindows_ret) {
-  int i = 0;
+  /* One query per pattern, each checking the same fields as 'search' */
+  searches = calloc(npatterns, sizeof(xdo_search_t));
+  for (i = 0; i < npatterns; i++) {
+    searches[i] = *search;
+    if (search->searchmask & SEARCH_TITLE)
+      searches[i].title = patterns[i];
+    if (search->searchmask & SEARCH_CLASS)
+      searches[i].winclass = patterns[i];
+    if (search->searchmask & SEARCH_CLASSNAME)
+      searches[i].winclassname = patterns[i];
+    if (search->searchmask & SEARCH_NAME)
+      searches[i].winname = patterns[i];
+    if (search->searchmask & SEARCH_ROLE)
+      searches[i].winrole = patterns[i];
+  }
 
-  unsigned int windowlist_size = 100;
-  *nwindows_ret = 0;
-  *windowlist_ret = calloc(windowlist_size, sizeof(Window));
+  ret = search_run(xdo, search, searches, npatterns, callback, userdata);
+  free(searches);
+  return ret;
+} /* int xdo_search_windows_multi */
 
-  /* TODO(sissel): Support multiple screens */
-  if (search->searchmask & SEARCH_SCREEN) {
-      Window root = RootWindow(xdo->xdpy, search->screen);
-      if (check_window_match(xdo, root, search)) {
-        (*windowlist_ret)[*nwindows_ret] = root;
-        (*nwindows_ret)++;
-        /* Don't have to check for size bounds here because
-         * we start with array size 100 */
+static int search_run(const xdo_t *xdo, const xdo_search_t *search,
+                      const xdo_search_t *searches, unsigned int nsearches,
+                      xdo_search_multi_cb_t callback, void *userdata) {
+  int i = 0;
+  unsigned int q;
+  int ret = XDO_SUCCESS;
+  search_state_t state;
+
+  state.queries = calloc(nsearches, sizeof(search_query_t));
+  for (q = 0; q < nsearches; q++) {
+    if (!query_init(xdo, &state.queries[q], &searches[q])) {
+      while (q-- > 0) {
+        query_free(&state.queries[q]);
       }
+      free(state.queries);
+      return XDO_ERROR;
+    }
+  }
 
-      /* Start with depth=1 since we already covered the root windows */
-      find_matching_windows(xdo, root, search, windowlist_ret, nwindows_ret,
-                            &windowlist_size, 1);
+  state.search = search;
+  state.nqueries = nsearches;
+  state.nmatches = calloc(nsearches, sizeof(unsigned int));
+  state.ndone = 0;
+  state.callback = callback;
+  state.userdata = userdata;
+  state.stopped = False;
+  state.in_worker = False;
+
+  /* Don't fail if windows disappear in the meantime; anything else the
+   * server reports is printed and fails the search. Worker connections of
+   * a parallel search collect their own. */
+  _xdo_errors_begin(xdo, True);
+
+  /* Worker connections still share Xlib's global state, such as the locale
+   * used to convert text properties, which Xlib only locks once
+   * xdo_init_threads has run. Without it, the screens are walked serially. */
+  if ((search->searchmask & SEARCH_PARALLEL)
+      && !(search->searchmask & SEARCH_SCREEN)
+      && ScreenCount(xdo->xdpy) > 1 && xdo->threads) {
+    search_screens_parallel(xdo, &state);
   } else {
-    const int screencount = ScreenCount(xdo->xdpy);
-    for (i = 0; i < screencount; i++) {
-      Window root = RootWindow(xdo->xdpy, i);
-      if (check_window_match(xdo, root, search)) {
-        (*windowlist_ret)[*nwindows_ret] = root;
-        (*nwindows_ret)++;
-        /* Don't have to check for size bounds here because
-         * we start with array size 100 */
+    for (i = 0; i < ScreenCount(xdo->xdpy) && !state.stopped; i++) {
+      if ((search->searchmask & SEARCH_SCREEN) && i != search->screen) {
+        continue;
       }
-
-      /* Start with depth=1 since we already covered the root windows */
-      find_matching_windows(xdo, root, search, windowlist_ret,
-                            nwindows_ret, &windowlist_size, 1);
+      search_screen(xdo, i, &state);
     }
   }
 
@@ -77,387 +527,2743 @@ int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
   //printf("classname: %s\n", search->winclassname);
   //printf("//Search\n");
 
-  return XDO_SUCCESS;
-} /* int xdo_search_windows */
+  if (_xdo_errors_end(xdo) > 0) {
+    ret = XDO_ERROR;
+  }
+  for (q = 0; q < nsearches; q++) {
+    query_free(&state.queries[q]);
+  }
+  free(state.queries);
+  free(state.nmatches);
+  return ret;
+} /* int search_run */
 
-static int _xdo_match_window_title(const xdo_t *xdo, Window window, regex_t *re) {
-  fprintf(stderr, "This function (match window by title) is deprecated."
-          " You want probably want to match by the window name.\n");
-  return _xdo_match_window_name(xdo, window, re);
-} /* int _xdo_match_window_title */
+static int _xdo_search_single(const xdo_t *xdo, Window window,
+                              unsigned int index, void *data) {
+  search_single_t *single = data;
 
-static int _xdo_match_window_name(const xdo_t *xdo, Window window, regex_t *re) {
-  /* historically in xdo, 'match_name' matched the classhint 'name' which we
-   * match in _xdo_match_window_classname. But really, most of the time 'name'
-   * refers to the window manager name for the window, which is displayed in
-   * the titlebar */
-  int i;
-  int count = 0;
-  char **list = NULL;
-  XTextProperty tp;
+  (void)index;
+  return single->callback(xdo, window, single->userdata);
+} /* int _xdo_search_single */
 
+static int _xdo_search_list_add(const xdo_t *xdo, Window window, void *data) {
+  search_list_t *list = data;
 
-  XGetWMName(xdo->xdpy, window, &tp);
-  if (tp.nitems > 0) {
-    //XmbTextPropertyToTextList(xdo->xdpy, &tp, &list, &count);
-    Xutf8TextPropertyToTextList(xdo->xdpy, &tp, &list, &count);
-    for (i = 0; i < count; i++) {
-      if (regexec(re, list[i], 0, NULL, 0) == 0) {
-        XFreeStringList(list);
-        XFree(tp.value);
-        return True;
-      }
-    }
+  (void)xdo;
+  if (list->nwindows == list->size) {
+    list->size *= 2;
+    list->windows = realloc(list->windows, list->size * sizeof(Window));
+  }
+  list->windows[list->nwindows++] = window;
+  return XDO_SEARCH_CONTINUE;
+} /* int _xdo_search_list_add */
+
+static int _xdo_search_match_list_add(const xdo_t *xdo, Window window,
+                                      unsigned int index, void *data) {
+  search_match_list_t *list = data;
+
+  (void)xdo;
+  if (list->nmatches == list->size) {
+    list->size *= 2;
+    list->windows = realloc(list->windows, list->size * sizeof(Window));
+    list->indexes = realloc(list->indexes, list->size * sizeof(unsigned int));
+  }
+  list->windows[list->nmatches] = window;
+  list->indexes[list->nmatches] = index;
+  list->nmatches++;
+  return XDO_SEARCH_CONTINUE;
+} /* int _xdo_search_match_list_add */
+
+int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
+                      Window **windowlist_ret, unsigned int *nwindows_ret) {
+  XDO_CALL(xdo);
+  search_list_t list;
+  int ret;
+
+  list.size = 100;
+  list.nwindows = 0;
+  list.windows = calloc(list.size, sizeof(Window));
+
+  ret = xdo_search_windows_cb(xdo, search, _xdo_search_list_add, &list);
+
+  *windowlist_ret = list.windows;
+  *nwindows_ret = list.nwindows;
+  return ret;
+} /* int xdo_search_windows */
+
+static int search_emit(const xdo_t *xdo, search_state_t *state, Window window,
+                       unsigned int index) {
+  /* Hand a match to the callback, with the caller's error handler in place.
+   * Returns True if the search should stop. */
+  const xdo_search_t *search = state->search;
+  int ret;
+
+  if (state->in_worker) {
+    /* Workers only collect; the error handler is shared by all threads */
+    ret = state->callback(xdo, window, index, state->userdata);
   } else {
-    /* Treat windows with no names as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      XFreeStringList(list);
-      XFree(tp.value);
-      return True;
+    _xdo_errors_suspend();
+    ret = state->callback(xdo, window, index, state->userdata);
+    _xdo_errors_resume();
+  }
+
+  state->nmatches[index]++;
+  if (search->limit > 0 && state->nmatches[index] == search->limit) {
+    state->ndone++;
+  }
+  if (ret == XDO_SEARCH_STOP || state->ndone == state->nqueries) {
+    state->stopped = True;
+  }
+  return state->stopped;
+} /* int search_emit */
+
+static int search_check(const xdo_t *xdo, search_state_t *state,
+                        window_info_t *info) {
+  /* Check a window against every query that still wants results. Returns
+   * True if the search should stop. */
+  const xdo_search_t *search = state->search;
+  unsigned int q;
+
+  for (q = 0; q < state->nqueries && !state->stopped; q++) {
+    if (search->limit > 0 && state->nmatches[q] >= search->limit) {
+      continue;
+    }
+    if (check_window_match(xdo, info, &state->queries[q])) {
+      search_emit(xdo, state, info->window, q);
     }
   }
-  XFreeStringList(list);
-  XFree(tp.value);
-  return False;
-} /* int _xdo_match_window_name */
+  return state->stopped;
+} /* int search_check */
 
-static int _xdo_match_window_class(const xdo_t *xdo, Window window, regex_t *re) {
-  XWindowAttributes attr;
-  XClassHint classhint;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
+static void search_screen(const xdo_t *xdo, int screen, search_state_t *state) {
+  Window root = RootWindow(xdo->xdpy, screen);
+  window_info_t info;
+  int stopped;
 
-  if (XGetClassHint(xdo->xdpy, window, &classhint)) {
-    //printf("%d: class %s\n", window, classhint.res_class);
-    if ((classhint.res_class) && (regexec(re, classhint.res_class, 0, NULL, 0) == 0)) {
-      XFree(classhint.res_name);
-      XFree(classhint.res_class);
-      return True;
-    }
-    XFree(classhint.res_name);
-    XFree(classhint.res_class);
-  } else {
-    /* Treat windows with no class as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      return True;
+  if ((state->search->searchmask & SEARCH_CLIENTS)
+      && find_matching_clients(xdo, root, state)) {
+    return;
+  }
+
+  window_info_init(&info, root);
+  stopped = search_check(xdo, state, &info);
+  window_info_free(&info);
+  if (stopped) {
+    return;
+  }
+
+  /* The root window is covered, so search starts with its children */
+  find_matching_windows(xdo, root, state);
+} /* void search_screen */
+
+static void *search_worker_main(void *data) {
+  search_worker_t *worker = data;
+  xdo_t *xdo = xdo_pool_get(worker->pool);
+
+  if (xdo == NULL) {
+    return NULL;
+  }
+  _xdo_errors_begin(xdo, True);
+  search_screen(xdo, worker->screen, &worker->state);
+  _xdo_errors_end(xdo);
+  worker->searched = True;
+  return NULL;
+} /* void *search_worker_main */
+
+static void search_screens_parallel(const xdo_t *xdo, search_state_t *state) {
+  /* Walk every screen at once, each on its own thread with a connection
+   * from a pool sharing our keymap and atoms, then report the results
+   * screen by screen so the order is the same as a serial search. If a
+   * connection or thread can't be had, that screen is searched here on the
+   * main connection. */
+  const int nscreens = ScreenCount(xdo->xdpy);
+  search_worker_t *workers = calloc(nscreens, sizeof(search_worker_t));
+  xdo_pool_t *pool = xdo_pool_new_with_xdo(xdo);
+  int i;
+  unsigned int j;
+
+  for (i = 0; i < nscreens; i++) {
+    search_worker_t *worker = &workers[i];
+
+    worker->screen = i;
+    worker->pool = pool;
+    worker->list.size = 100;
+    worker->list.windows = calloc(worker->list.size, sizeof(Window));
+    worker->list.indexes = calloc(worker->list.size, sizeof(unsigned int));
+    worker->state = *state;
+    worker->state.callback = _xdo_search_match_list_add;
+    worker->state.userdata = &worker->list;
+    worker->state.nmatches = calloc(state->nqueries, sizeof(unsigned int));
+    worker->state.ndone = 0;
+    worker->state.in_worker = True;
+
+    if (pthread_create(&worker->thread, NULL, search_worker_main, worker) == 0) {
+      worker->started = True;
     }
   }
-  return False;
-} /* int _xdo_match_window_class */
 
-static int _xdo_match_window_classname(const xdo_t *xdo, Window window, regex_t *re) {
-  XWindowAttributes attr;
-  XClassHint classhint;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
+  for (i = 0; i < nscreens; i++) {
+    search_worker_t *worker = &workers[i];
 
-  if (XGetClassHint(xdo->xdpy, window, &classhint)) {
-    if ((classhint.res_name) && (regexec(re, classhint.res_name, 0, NULL, 0) == 0)) {
-      XFree(classhint.res_name);
-      XFree(classhint.res_class);
-      return True;
+    if (worker->started) {
+      pthread_join(worker->thread, NULL);
     }
-    XFree(classhint.res_name);
-    XFree(classhint.res_class);
-  } else {
-    /* Treat windows with no class name as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      return True;
+    if (!worker->searched && !state->stopped) {
+      worker->state.in_worker = False;
+      search_screen(xdo, i, &worker->state);
+    }
+
+    /* Each worker counts matches on its own, so skip any that are past a
+     * query's limit once all screens are merged. */
+    for (j = 0; j < worker->list.nmatches && !state->stopped; j++) {
+      const unsigned int q = worker->list.indexes[j];
+      if (state->search->limit == 0 || state->nmatches[q] < state->search->limit) {
+        search_emit(xdo, state, worker->list.windows[j], q);
+      }
     }
+    free(worker->list.windows);
+    free(worker->list.indexes);
+    free(worker->state.nmatches);
   }
-  return False;
-} /* int _xdo_match_window_classname */
 
-static int _xdo_match_window_role(const xdo_t *xdo, Window window, regex_t *re) {
-  int status;
-  int ret = False;
+  /* Closes the workers' connections, not ours */
+  xdo_pool_free(pool);
+  free(workers);
+} /* void search_screens_parallel */
+
+int xdo_search_windows_watch(const xdo_t *xdo, const xdo_search_t *search,
+                             xdo_search_watch_cb_t callback, void *userdata) {
+  XDO_CALL(xdo);
+  search_watch_t watch;
+  XEvent e;
   int i;
-  int count = 0;
-  char **list = NULL;
-  XTextProperty tp;
 
-  status = XGetTextProperty(xdo->xdpy, window, &tp,
-                            XInternAtom(xdo->xdpy, "WM_WINDOW_ROLE", False));
-  if (status && tp.nitems > 0) {
-    Xutf8TextPropertyToTextList(xdo->xdpy, &tp, &list, &count);
-    for (i = 0; i < count; i++) {
-      if (regexec(re, list[i], 0, NULL, 0) == 0) {
-        ret = True;
-      }
-    }
-  } else {
-    /* Treat windows with no role as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      ret = True;
-    }
+  memset(&watch, 0, sizeof(watch));
+  if (!query_init(xdo, &watch.query, search)) {
+    return XDO_ERROR;
   }
-  if(status) {
-    XFreeStringList(list);
-    XFree(tp.value);
+  watch.search = search;
+  watch.callback = callback;
+  watch.userdata = userdata;
+  window_table_init(&watch.table);
+
+  /* A property change only matters if the query looks at it */
+  if (search->searchmask & (SEARCH_NAME | SEARCH_TITLE))
+    watch.atoms[watch.natoms++] = XA_WM_NAME;
+  if (search->searchmask & (SEARCH_CLASS | SEARCH_CLASSNAME))
+    watch.atoms[watch.natoms++] = XA_WM_CLASS;
+  if (search->searchmask & SEARCH_ROLE)
+    watch.atoms[watch.natoms++] = watch.query.atom_role;
+  /* Windows of a wanted owner match once the window manager manages them */
+  if (search->searchmask & SEARCH_PID) {
+    watch.atoms[watch.natoms++] = XInternAtom(xdo->xdpy, "_NET_WM_PID", False);
+    watch.atoms[watch.natoms++] = watch.query.atom_wm_state;
   }
-  return ret;
-} /* int _xdo_match_window_role */
+  if (search->searchmask & SEARCH_DESKTOP)
+    watch.atoms[watch.natoms++] = watch.query.atom_desktop;
 
-static int _xdo_match_window_pid(const xdo_t *xdo, Window window, const int pid) {
-  int window_pid;
+  /* Windows may vanish at any time while we follow them */
+  _xdo_errors_begin(xdo, True);
 
-  window_pid = xdo_get_pid_window(xdo, window);
-  if (pid == window_pid) {
-    return True;
-  } else {
-    return False;
+  /* One full walk to find what matches now; from then on only the windows
+   * named in events are looked at. */
+  for (i = 0; i < ScreenCount(xdo->xdpy) && !watch.stopped; i++) {
+    if ((search->searchmask & SEARCH_SCREEN) && i != search->screen) {
+      continue;
+    }
+    watch_add_tree(xdo, &watch, RootWindow(xdo->xdpy, i), 0);
   }
-} /* int _xdo_match_window_pid */
 
-static int compile_re(const char *pattern, regex_t *re) {
-  int ret;
-  if (pattern == NULL) {
-    regcomp(re, "^$", REG_EXTENDED | REG_ICASE);
-    return True;
+  while (!watch.stopped) {
+    XNextEvent(xdo->xdpy, &e);
+    watch_event(xdo, &watch, &e);
+    /* The scope lasts as long as the watch, so don't let errors pile up */
+    _xdo_errors_flush(xdo);
   }
 
-  ret = regcomp(re, pattern, REG_EXTENDED | REG_ICASE);
-  if (ret != 0) {
-    fprintf(stderr, "Failed to compile regex (return code %d): '%s'\n", ret, pattern);
-    return False;
+  _xdo_errors_end(xdo);
+  query_free(&watch.query);
+  free(watch.table.slots);
+  return XDO_SUCCESS;
+} /* int xdo_search_windows_watch */
+
+static void watch_event(const xdo_t *xdo, search_watch_t *watch, XEvent *e) {
+  const xdo_search_t *search = watch->search;
+  window_slot_t *slot;
+  window_slot_t *parent;
+  unsigned int i;
+
+  switch (e->type) {
+    case CreateNotify:
+      parent = window_table_find(&watch->table, e->xcreatewindow.parent);
+      if (parent != NULL
+          && (search->max_depth < 0 || parent->depth < search->max_depth)) {
+        watch_add_tree(xdo, watch, e->xcreatewindow.window, parent->depth + 1);
+      }
+      break;
+    case DestroyNotify:
+      /* Children are destroyed, and reported, before their parent */
+      watch_remove(xdo, watch, e->xdestroywindow.window);
+      break;
+    case MapNotify:
+    case UnmapNotify:
+      /* Only the window itself is checked again, not the subtree whose
+       * viewability it also changes: window managers map and unmap client
+       * windows themselves, and walking every subtree again would cost
+       * round trips per descendant on each map */
+      if (!(search->searchmask & SEARCH_ONLYVISIBLE)) {
+        break;
+      }
+      slot = window_table_find(&watch->table, e->type == MapNotify
+                               ? e->xmap.window : e->xunmap.window);
+      if (slot != NULL) {
+        watch_check(xdo, watch, slot);
+      }
+      break;
+    case ReparentNotify:
+      /* Sent to both the old and the new parent, if we follow them. A window
+       * moved under a parent we follow is handled once, on that parent's
+       * copy; one moved elsewhere is dropped. */
+      parent = window_table_find(&watch->table, e->xreparent.parent);
+      if (parent != NULL
+          && (search->max_depth < 0 || parent->depth < search->max_depth)) {
+        if (e->xreparent.event == e->xreparent.parent) {
+          watch_add_tree(xdo, watch, e->xreparent.window, parent->depth + 1);
+        }
+      } else {
+        watch_remove_tree(xdo, watch, e->xreparent.window);
+      }
+      break;
+    case PropertyNotify:
+      for (i = 0; i < watch->natoms; i++) {
+        if (e->xproperty.atom == watch->atoms[i]) {
+          slot = window_table_find(&watch->table, e->xproperty.window);
+          if (slot != NULL) {
+            watch_check(xdo, watch, slot);
+          }
+          break;
+        }
+      }
+      break;
   }
-  return True;
-} /* int compile_re */
+} /* void watch_event */
+
+static void watch_add_tree(const xdo_t *xdo, search_watch_t *watch,
+                           Window window, int depth) {
+  /* Follow 'window' and the windows below it, up to search->max_depth,
+   * checking each one. Windows already followed are checked again. */
+  const xdo_search_t *search = watch->search;
+  Window *queue;
+  int *depths;
+  unsigned int nqueue = 1;
+  unsigned int size = 64;
+  unsigned int i;
+
+  queue = calloc(size, sizeof(Window));
+  depths = calloc(size, sizeof(int));
+  queue[0] = window;
+  depths[0] = depth;
+
+  for (i = 0; i < nqueue && !watch->stopped; i++) {
+    const int descend = (search->max_depth < 0 || depths[i] < search->max_depth);
+    window_slot_t *slot;
+    Window dummy;
+    Window *children = NULL;
+    unsigned int nchildren = 0;
+    unsigned int j;
+
+    /* Select events before looking at children, so a child created in
+     * between still shows up as a CreateNotify */
+    XSelectInput(xdo->xdpy, queue[i],
+                 PropertyChangeMask | (descend ? SubstructureNotifyMask : 0));
+
+    slot = window_table_find(&watch->table, queue[i]);
+    if (slot == NULL) {
+      slot = window_table_insert(&watch->table, queue[i]);
+    }
+    slot->depth = depths[i];
+    watch_check(xdo, watch, slot);
 
-static int _xdo_is_window_visible(const xdo_t *xdo, Window wid) {
-  XWindowAttributes wattr;
-  XGetWindowAttributes(xdo->xdpy, wid, &wattr);
-  if (wattr.map_state != IsViewable)
-    return False;
+    if (!descend
+        || !XQueryTree(xdo->xdpy, queue[i], &dummy, &dummy, &children,
+                      &nchildren)) {
+      continue;
+    }
 
-  return True;
-} /* int _xdo_is_window_visible */
+    if (nqueue + nchildren > size) {
+      while (nqueue + nchildren > size) {
+        size *= 2;
+      }
+      queue = realloc(queue, size * sizeof(Window));
+      depths = realloc(depths, size * sizeof(int));
+    }
+    for (j = 0; j < nchildren; j++) {
+      queue[nqueue] = children[j];
+      depths[nqueue] = depths[i] + 1;
+      nqueue++;
+    }
+    if (children != NULL)
+      XFree(children);
+  }
+
+  free(queue);
+  free(depths);
+} /* void watch_add_tree */
+
+static void watch_remove_tree(const xdo_t *xdo, search_watch_t *watch,
+                              Window window) {
+  /* Stop following 'window' and its subtree; it moved out of reach */
+  Window dummy;
+  Window *children = NULL;
+  unsigned int nchildren = 0;
+  unsigned int i;
 
-static int check_window_match(const xdo_t *xdo, Window wid,
-                              const xdo_search_t *search) {
-  regex_t title_re;
-  regex_t class_re;
-  regex_t classname_re;
-  regex_t name_re;
-  regex_t role_re;
+  if (window_table_find(&watch->table, window) == NULL) {
+    return;
+  }
+  XSelectInput(xdo->xdpy, window, NoEventMask);
+  watch_remove(xdo, watch, window);
 
+  if (XQueryTree(xdo->xdpy, window, &dummy, &dummy, &children, &nchildren)) {
+    for (i = 0; i < nchildren; i++) {
+      watch_remove_tree(xdo, watch, children[i]);
+    }
+    if (children != NULL)
+      XFree(children);
+  }
+} /* void watch_remove_tree */
 
-  if (!compile_re(search->title, &title_re) \
-      || !compile_re(search->winclass, &class_re) \
-      || !compile_re(search->winclassname, &classname_re) \
-      || !compile_re(search->winrole, &role_re) \
-      || !compile_re(search->winname, &name_re)) {
+static void watch_check(const xdo_t *xdo, search_watch_t *watch,
+                        window_slot_t *slot) {
+  window_info_t info;
+  int matched;
 
-    regfree(&title_re);
-    regfree(&class_re);
-    regfree(&classname_re);
-    regfree(&name_re);
-    regfree(&role_re);
+  window_info_init(&info, slot->window);
+  matched = check_window_match(xdo, &info, &watch->query);
+  window_info_free(&info);
 
-    return False;
+  if (matched != slot->matched) {
+    slot->matched = matched;
+    watch_emit(xdo, watch, slot->window, matched);
   }
+} /* void watch_check */
 
-  /* Set this to 1 for dev debugging */
-  static const int debug = 0;
+static void watch_emit(const xdo_t *xdo, search_watch_t *watch, Window window,
+                       int matched) {
+  _xdo_errors_suspend();
+  if (watch->callback(xdo, window, matched, watch->userdata) == XDO_SEARCH_STOP) {
+    watch->stopped = True;
+  }
+  _xdo_errors_resume();
+} /* void watch_emit */
 
-  int visible_ok, pid_ok, title_ok, name_ok, class_ok, classname_ok, desktop_ok;
-  int visible_want, pid_want, title_want, name_want, class_want, classname_want, desktop_want;
-  int role_ok, role_want;
-
-  visible_ok = pid_ok = title_ok = name_ok = class_ok = classname_ok = desktop_ok = True;
-    //(search->require == SEARCH_ANY ? False : True);
-
-  desktop_want = search->searchmask & SEARCH_DESKTOP;
-  visible_want = search->searchmask & SEARCH_ONLYVISIBLE;
-  pid_want = search->searchmask & SEARCH_PID;
-  title_want = search->searchmask & SEARCH_TITLE;
-  name_want = search->searchmask & SEARCH_NAME;
-  class_want = search->searchmask & SEARCH_CLASS;
-  classname_want = search->searchmask & SEARCH_CLASSNAME;
-  role_ok = True;
-  role_want = search->searchmask & SEARCH_ROLE;
-
-  do {
-    if (desktop_want) {
-      long desktop = -1;
-
-      /* We're modifying xdo here, but since we restore it, we're still 
-       * obeying the "const" contract. */
-      int old_quiet = xdo->quiet;
-      xdo_t *xdo2 = (xdo_t *)xdo;
-      xdo2->quiet = 1;
-      int ret = xdo_get_desktop_for_window(xdo2, wid, &desktop);
-      xdo2->quiet = old_quiet;
-
-      /* Desktop matched if we support desktop queries *and* the desktop is
-       * equal */
-      desktop_ok = (ret == XDO_SUCCESS && desktop == search->desktop);
-    }
-
-    /* Visibility is a hard condition, fail always if we wanted 
-     * only visible windows and this one isn't */
-    if (visible_want && !_xdo_is_window_visible(xdo, wid)) {
-      if (debug) fprintf(stderr, "skip %ld visible\n", wid); 
-      visible_ok = False;
-      break;
-    }
+static void watch_remove(const xdo_t *xdo, search_watch_t *watch,
+                         Window window) {
+  window_slot_t *slot = window_table_find(&watch->table, window);
 
-    if (pid_want && !_xdo_match_window_pid(xdo, wid, search->pid)) {
-      if (debug) fprintf(stderr, "skip %ld pid\n", wid); 
-      pid_ok = False;
+  if (slot == NULL) {
+    return;
+  }
+  if (slot->matched) {
+    watch_emit(xdo, watch, window, False);
+  }
+  window_table_remove(&watch->table, slot);
+} /* void watch_remove */
+
+static void window_table_init(window_table_t *table) {
+  table->size = 1024;
+  table->count = 0;
+  table->slots = calloc(table->size, sizeof(window_slot_t));
+} /* void window_table_init */
+
+static unsigned int window_table_hash(const window_table_t *table,
+                                      Window window) {
+  /* Window ids share their high bits per client; mix them into the low ones */
+  unsigned long h = window ^ (window >> 16);
+  return (unsigned int)(h * 2654435761UL) & (table->size - 1);
+} /* unsigned int window_table_hash */
+
+static window_slot_t *window_table_find(const window_table_t *table,
+                                        Window window) {
+  unsigned int i = window_table_hash(table, window);
+
+  while (table->slots[i].window != None) {
+    if (table->slots[i].window == window) {
+      return &table->slots[i];
     }
-
-    if (title_want && !_xdo_match_window_title(xdo, wid, &title_re)) {
-      if (debug) fprintf(stderr, "skip %ld title\n", wid);
-      title_ok = False;
+    i = (i + 1) & (table->size - 1);
+  }
+  return NULL;
+} /* window_slot_t *window_table_find */
+
+static window_slot_t *window_table_insert(window_table_t *table,
+                                          Window window) {
+  unsigned int i;
+
+  /* Keep the table at most half full */
+  if ((table->count + 1) * 2 > table->size) {
+    window_slot_t *old = table->slots;
+    unsigned int oldsize = table->size;
+
+    table->size *= 2;
+    table->slots = calloc(table->size, sizeof(window_slot_t));
+    for (i = 0; i < oldsize; i++) {
+      if (old[i].window != None) {
+        unsigned int j = window_table_hash(table, old[i].window);
+        while (table->slots[j].window != None) {
+          j = (j + 1) & (table->size - 1);
+        }
+        table->slots[j] = old[i];
+      }
     }
+    free(old);
+  }
 
-    if (name_want && !_xdo_match_window_name(xdo, wid, &name_re)) {
-      if (debug) fprintf(stderr, "skip %ld winname\n", wid);
-      name_ok = False;
+  i = window_table_hash(table, window);
+  while (table->slots[i].window != None) {
+    i = (i + 1) & (table->size - 1);
+  }
+  memset(&table->slots[i], 0, sizeof(window_slot_t));
+  table->slots[i].window = window;
+  table->count++;
+  return &table->slots[i];
+} /* window_slot_t *window_table_insert */
+
+static void window_table_remove(window_table_t *table, window_slot_t *slot) {
+  const unsigned int mask = table->size - 1;
+  unsigned int i, j;
+
+  /* Shift later slots of the probe chain back into the hole, so lookups
+   * never need tombstones */
+  i = slot - table->slots;
+  j = i;
+  for (;;) {
+    unsigned int home;
+
+    j = (j + 1) & mask;
+    if (table->slots[j].window == None) {
+      break;
     }
-
-    if (class_want && !_xdo_match_window_class(xdo, wid, &class_re)) {
-      if (debug) fprintf(stderr, "skip %ld winclass\n", wid);
-      class_ok = False;
+    home = window_table_hash(table, table->slots[j].window);
+    /* Move it unless its home slot lies cyclically in (i, j] */
+    if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+      table->slots[i] = table->slots[j];
+      i = j;
     }
+  }
+  table->slots[i].window = None;
+  table->count--;
+} /* void window_table_remove */
 
-    if (classname_want && !_xdo_match_window_classname(xdo, wid, &classname_re)) {
-      if (debug) fprintf(stderr, "skip %ld winclassname\n", wid);
-      classname_ok = False;
-    }
+xdo_window_index_t *xdo_window_index_new(const xdo_t *xdo) {
+  XDO_CALL(xdo);
+  xdo_window_index_t *index = calloc(1, sizeof(xdo_window_index_t));
+  int i;
 
-    if (role_want && !_xdo_match_window_role(xdo, wid, &role_re)) {
-      if (debug) fprintf(stderr, "skip %ld winrole\n", wid);
-      role_ok = False;
-    }
-  } while (0);
+  index->xdo = xdo;
+  window_table_init(&index->table);
+  index->size = 256;
+  index->records = calloc(index->size, sizeof(index_record_t));
+  index->free_records = calloc(index->size, sizeof(unsigned int));
+  index->postings_size = 4096;
+  index->postings = calloc(index->postings_size, sizeof(posting_t));
+  index->atom_role = XInternAtom(xdo->xdpy, "WM_WINDOW_ROLE", False);
+  index->atom_pid = XInternAtom(xdo->xdpy, "_NET_WM_PID", False);
+  index->atom_desktop = XInternAtom(xdo->xdpy, "_NET_WM_DESKTOP", False);
+  index->atom_wm_state = XInternAtom(xdo->xdpy, "WM_STATE", False);
+
+  _xdo_errors_begin(xdo, True);
+  for (i = 0; i < ScreenCount(xdo->xdpy); i++) {
+    index_add_tree(index, RootWindow(xdo->xdpy, i), None, 0, i);
+  }
+  _xdo_errors_end(xdo);
+  return index;
+} /* xdo_window_index_t *xdo_window_index_new */
 
-  regfree(&title_re);
-  regfree(&class_re);
-  regfree(&classname_re);
-  regfree(&name_re);
-  regfree(&role_re);
+void xdo_window_index_free(xdo_window_index_t *index) {
+  unsigned int i;
 
-  if (debug) {
-    fprintf(stderr, "win: %ld, pid:%d, title:%d, name:%d, class:%d, visible:%d\n",
-            wid, pid_ok, title_ok, name_ok, class_ok, visible_ok);
+  if (index == NULL) {
+    return;
   }
 
-  switch (search->require) {
-    case SEARCH_ALL:
-      return visible_ok && pid_ok && title_ok && name_ok && class_ok \
-             && classname_ok && desktop_ok && role_ok;
+  for (i = 0; i < index->nrecords; i++) {
+    index_record_t *rec = &index->records[i];
+    if (rec->info.window != None) {
+      XSelectInput(index->xdo->xdpy, rec->info.window, NoEventMask);
+      window_info_free(&rec->info);
+    }
+    free(rec->trigrams.trigrams);
+  }
+  for (i = 0; i < index->postings_size; i++) {
+    free(index->postings[i].records);
+  }
+  free(index->postings);
+  free(index->records);
+  free(index->free_records);
+  free(index->table.slots);
+  free(index);
+} /* void xdo_window_index_free */
+
+void xdo_window_index_update(xdo_window_index_t *index) {
+  XDO_CALL(index->xdo);
+  XEvent e;
+
+  while (XPending(index->xdo->xdpy) > 0) {
+    XNextEvent(index->xdo->xdpy, &e);
+    xdo_window_index_handle_event(index, &e);
+  }
+} /* void xdo_window_index_update */
+
+void xdo_window_index_handle_event(xdo_window_index_t *index,
+                                   const XEvent *e) {
+  XDO_CALL(index->xdo);
+  const xdo_t *xdo = index->xdo;
+  index_record_t *rec;
+  index_record_t *parent;
+
+  _xdo_errors_begin(index->xdo, True);
+  switch (e->type) {
+    case CreateNotify:
+      parent = index_find(index, e->xcreatewindow.parent);
+      if (parent != NULL) {
+        index_add_tree(index, e->xcreatewindow.window, parent->info.window,
+                       parent->depth + 1, parent->screen);
+      }
+      break;
+    case DestroyNotify:
+      index_remove(index, e->xdestroywindow.window);
+      break;
+    case MapNotify:
+      rec = index_find(index, e->xmap.window);
+      if (rec != NULL) {
+        rec->mapped = True;
+      }
+      break;
+    case UnmapNotify:
+      rec = index_find(index, e->xunmap.window);
+      if (rec != NULL) {
+        rec->mapped = False;
+      }
+      break;
+    case ReparentNotify:
+      /* Sent to both the old and the new parent; use the new parent's copy */
+      parent = index_find(index, e->xreparent.parent);
+      if (parent != NULL && e->xreparent.event == e->xreparent.parent) {
+        /* This also updates the depth of the windows below */
+        index_add_tree(index, e->xreparent.window, parent->info.window,
+                       parent->depth + 1, parent->screen);
+      }
       break;
-    case SEARCH_ANY:
-      return visible_ok && ((pid_want && pid_ok) || (title_want && title_ok) \
-                            || (name_want && name_ok) \
-                            || (role_want && role_ok) \
-                            || (class_want && class_ok) \
-                            || (classname_want && classname_ok)) \
-                         && desktop_ok;
+    case PropertyNotify:
+      rec = index_find(index, e->xproperty.window);
+      if (rec == NULL) {
+        break;
+      }
+      if (e->xproperty.atom == XA_WM_NAME) {
+        if (rec->info.name.list != NULL)
+          XFreeStringList(rec->info.name.list);
+        memset(&rec->info.name, 0, sizeof(window_text_t));
+        _xdo_window_text(xdo, rec->info.window, XA_WM_NAME, &rec->info.name);
+        index_reindex(index, rec - index->records);
+      } else if (e->xproperty.atom == index->atom_role) {
+        if (rec->info.role.list != NULL)
+          XFreeStringList(rec->info.role.list);
+        memset(&rec->info.role, 0, sizeof(window_text_t));
+        _xdo_window_text(xdo, rec->info.window, index->atom_role,
+                         &rec->info.role);
+        index_reindex(index, rec - index->records);
+      } else if (e->xproperty.atom == XA_WM_CLASS) {
+        if (rec->info.classhint_fetched && rec->info.classhint_status) {
+          XFree(rec->info.classhint.res_name);
+          XFree(rec->info.classhint.res_class);
+        }
+        rec->info.classhint_fetched = False;
+        _xdo_window_classhint(xdo, &rec->info);
+        index_reindex(index, rec - index->records);
+      } else if (e->xproperty.atom == index->atom_pid) {
+        /* Fetched again the next time a search needs it */
+        rec->info.pid_fetched = False;
+      } else if (e->xproperty.atom == index->atom_desktop) {
+        rec->info.desktop_fetched = False;
+      } else if (e->xproperty.atom == index->atom_wm_state) {
+        /* Set when the window manager starts managing the window */
+        rec->info.wm_state_fetched = False;
+      }
       break;
   }
-  
-  fprintf(stderr, 
-          "Unexpected code reached. search->require is not valid? (%d); "
-          "this may be a bug?\n",
-          search->require);
-  return False;
-} /* int check_window_match */
+  _xdo_errors_end(index->xdo);
+} /* void xdo_window_index_handle_event */
 
-static int ignore_badwindow(Display *dpy, XErrorEvent *xerr) {
-#define ERROR_BUF_SIZE 256
-  char buf[ERROR_BUF_SIZE];
-  char request[ERROR_BUF_SIZE];
+static int _index_match_cmp(const void *a, const void *b) {
+  const index_record_t *ra = *(index_record_t * const *)a;
+  const index_record_t *rb = *(index_record_t * const *)b;
 
-  if (xerr->error_code == BadWindow)
-    return 0;
+  /* Shallowest first, like the breadth-first tree walk */
+  if (ra->depth != rb->depth) {
+    return ra->depth < rb->depth ? -1 : 1;
+  }
+  return ra < rb ? -1 : (ra > rb);
+} /* int _index_match_cmp */
+
+int xdo_window_index_search(xdo_window_index_t *index,
+                            const xdo_search_t *search,
+                            Window **windowlist_ret,
+                            unsigned int *nwindows_ret) {
+  XDO_CALL(index->xdo);
+  const xdo_t *xdo = index->xdo;
+  search_query_t query;
+  unsigned int *candidates = NULL;
+  unsigned int ncandidates = 0;
+  int narrowed = False;
+  index_record_t **matches;
+  unsigned int nmatches = 0;
+  unsigned int i, n;
+
+  *windowlist_ret = NULL;
+  *nwindows_ret = 0;
+  if (!query_init(xdo, &query, search)) {
+    return XDO_ERROR;
+  }
+  xdo_window_index_update(index);
+
+  /* Narrow the candidates with the trigrams the patterns require. With
+   * SEARCH_ALL, every pattern must match, so their candidates intersect.
+   * With SEARCH_ANY, a window may match through any soft predicate, so
+   * all of them must narrow for the union to mean anything. */
+  for (i = 0; i < query.nplan; i++) {
+    const unsigned int p = query.plan[i];
+    const pattern_t *pat;
+    trigram_set_t set;
+    unsigned int *records;
+    unsigned int count;
+
+    if (predicates[p].hard) {
+      continue;
+    }
 
-  XGetErrorText(dpy, xerr->error_code, buf, sizeof(buf));
-  fprintf(stderr, "X Error of failed request: %s\n", buf);
-
-  /* Intentionally ignore errors from protocol extensions, they are not used in
-   * this file. */
-  snprintf(request, sizeof(request), "%d", xerr->request_code);
-  XGetErrorDatabaseText(dpy, "XRequest", request, "", buf,
-      sizeof(buf));
-  fprintf(stderr, "Major opcode: %d (%s)\n",
-      xerr->request_code, buf);
-  exit(1);
-}
-
-static void find_matching_windows(const xdo_t *xdo, Window window, 
-                                  const xdo_search_t *search,
-                                  Window **windowlist_ret,
-                                  unsigned int *nwindows_ret,
-                                  unsigned int *windowlist_size,
-                                  int current_depth) {
-  /* Query for children of 'wid'. For each child, check match.
-   * We want to do a breadth-first search.
-   *
-   * If match, add to list.
-   * If over limit, break.
-   * Recurse.
-   */
+    memset(&set, 0, sizeof(set));
+    pat = query_pattern(&query, predicates[p].mask);
+    if (pat != NULL) {
+      pattern_trigrams(pat, &set);
+    }
+    if (set.count == 0) {
+      free(set.trigrams);
+      if (search->require == SEARCH_ANY) {
+        narrowed = False;
+        break;
+      }
+      continue;
+    }
 
-  Window dummy;
-  Window *children = NULL;
-  unsigned int i, nchildren;
-  int (*old_error_handler)(Display *dpy, XErrorEvent *xerr);
+    index_lookup(index, &set, &records, &count);
+    free(set.trigrams);
+    if (!narrowed) {
+      candidates = records;
+      ncandidates = count;
+      narrowed = True;
+    } else {
+      /* Merge the two sorted lists */
+      unsigned int *merged = malloc((ncandidates + count + 1) * sizeof(unsigned int));
+      unsigned int a = 0, b = 0;
+      n = 0;
+      while (a < ncandidates && b < count) {
+        if (candidates[a] == records[b]) {
+          merged[n++] = candidates[a];
+          a++;
+          b++;
+        } else if (candidates[a] < records[b]) {
+          if (search->require == SEARCH_ANY)
+            merged[n++] = candidates[a];
+          a++;
+        } else {
+          if (search->require == SEARCH_ANY)
+            merged[n++] = records[b];
+          b++;
+        }
+      }
+      if (search->require == SEARCH_ANY) {
+        while (a < ncandidates)
+          merged[n++] = candidates[a++];
+        while (b < count)
+          merged[n++] = records[b++];
+      }
+      free(candidates);
+      free(records);
+      candidates = merged;
+      ncandidates = n;
+    }
+  }
 
-  /* Break early, if we have enough windows already. */
-  if (search->limit > 0 && *nwindows_ret >= search->limit) {
-    return;
+  if (!narrowed) {
+    free(candidates);
+    candidates = NULL;
+    ncandidates = index->nrecords;
   }
 
-  /* Break if too deep */
-  if (search->max_depth != -1 && current_depth > search->max_depth) {
-    return;
+  /* The full check runs on the cached window data; only pid and desktop
+   * are fetched, once per window, if the query asks for them */
+  _xdo_errors_begin(xdo, True);
+  matches = malloc((ncandidates + 1) * sizeof(index_record_t *));
+  for (i = 0; i < ncandidates; i++) {
+    index_record_t *rec = &index->records[narrowed ? candidates[i] : i];
+
+    if (rec->info.window == None) {
+      continue;
+    }
+    if (search->max_depth >= 0 && rec->depth > search->max_depth) {
+      continue;
+    }
+    if ((search->searchmask & SEARCH_SCREEN) && rec->screen != search->screen) {
+      continue;
+    }
+    if (search->searchmask & SEARCH_ONLYVISIBLE) {
+      rec->info.visible_fetched = True;
+      rec->info.visible = index_viewable(index, rec);
+    }
+    if (check_window_match(xdo, &rec->info, &query)) {
+      matches[nmatches++] = rec;
+    }
+  }
+  _xdo_errors_end(xdo);
+
+  qsort(matches, nmatches, sizeof(index_record_t *), _index_match_cmp);
+  if (search->limit > 0 && nmatches > search->limit) {
+    nmatches = search->limit;
+  }
+
+  *windowlist_ret = calloc(nmatches + 1, sizeof(Window));
+  for (i = 0; i < nmatches; i++) {
+    (*windowlist_ret)[i] = matches[i]->info.window;
   }
+  *nwindows_ret = nmatches;
+
+  free(matches);
+  free(candidates);
+  query_free(&query);
+  return XDO_SUCCESS;
+} /* int xdo_window_index_search */
+
+static index_record_t *index_find(xdo_window_index_t *index, Window window) {
+  window_slot_t *slot = window_table_find(&index->table, window);
+
+  return slot != NULL ? &index->records[slot->record] : NULL;
+} /* index_record_t *index_find */
+
+static void index_add_tree(xdo_window_index_t *index, Window window,
+                           Window parent, int depth, int screen) {
+  /* Add 'window' and every window below it. Windows already in the index
+   * just get their parent and depth updated. */
+  const xdo_t *xdo = index->xdo;
+  Window *queue;
+  Window *parents;
+  int *depths;
+  unsigned int nqueue = 1;
+  unsigned int size = 64;
+  unsigned int i;
+
+  queue = calloc(size, sizeof(Window));
+  parents = calloc(size, sizeof(Window));
+  depths = calloc(size, sizeof(int));
+  queue[0] = window;
+  parents[0] = parent;
+  depths[0] = depth;
+
+  for (i = 0; i < nqueue; i++) {
+    window_slot_t *slot;
+    index_record_t *rec;
+    Window dummy;
+    Window *children = NULL;
+    unsigned int nchildren = 0;
+    unsigned int j;
+
+    /* Select events before reading anything, so later changes are seen */
+    XSelectInput(xdo->xdpy, queue[i],
+                 PropertyChangeMask | SubstructureNotifyMask);
+
+    slot = window_table_find(&index->table, queue[i]);
+    if (slot == NULL) {
+      XWindowAttributes wattr;
+      unsigned int id;
+
+      if (index->nfree > 0) {
+        id = index->free_records[--index->nfree];
+      } else {
+        if (index->nrecords == index->size) {
+          index->size *= 2;
+          index->records = realloc(index->records,
+                                   index->size * sizeof(index_record_t));
+          index->free_records = realloc(index->free_records,
+                                        index->size * sizeof(unsigned int));
+        }
+        id = index->nrecords++;
+        memset(&index->records[id], 0, sizeof(index_record_t));
+      }
+      slot = window_table_insert(&index->table, queue[i]);
+      slot->record = id;
+
+      rec = &index->records[id];
+      window_info_init(&rec->info, queue[i]);
+      rec->mapped = (XGetWindowAttributes(xdo->xdpy, queue[i], &wattr)
+                     && wattr.map_state != IsUnmapped);
+      _xdo_window_classhint(xdo, &rec->info);
+      _xdo_window_text(xdo, queue[i], XA_WM_NAME, &rec->info.name);
+      _xdo_window_text(xdo, queue[i], index->atom_role, &rec->info.role);
+      index_reindex(index, id);
+    }
 
-  /* Don't crash if window dissappear in the meantime */
-  old_error_handler = XSetErrorHandler(ignore_badwindow);
+    rec = &index->records[slot->record];
+    rec->parent = parents[i];
+    rec->depth = depths[i];
+    rec->screen = screen;
 
-  /* Break if XQueryTree fails.
-   * TODO(sissel): report an error? */
-  Status success = XQueryTree(xdo->xdpy, window, &dummy, &dummy, &children, &nchildren);
+    if (!XQueryTree(xdo->xdpy, queue[i], &dummy, &dummy, &children,
+                   &nchildren)) {
+      continue;
+    }
 
-  if (!success) {
+    if (nqueue + nchildren > size) {
+      while (nqueue + nchildren > size) {
+        size *= 2;
+      }
+      queue = realloc(queue, size * sizeof(Window));
+      parents = realloc(parents, size * sizeof(Window));
+      depths = realloc(depths, size * sizeof(int));
+    }
+    for (j = 0; j < nchildren; j++) {
+      queue[nqueue] = children[j];
+      parents[nqueue] = queue[i];
+      depths[nqueue] = depths[i] + 1;
+      nqueue++;
+    }
     if (children != NULL)
       XFree(children);
+  }
+
+  free(queue);
+  free(parents);
+  free(depths);
+} /* void index_add_tree */
+
+static void index_remove(xdo_window_index_t *index, Window window) {
+  window_slot_t *slot = window_table_find(&index->table, window);
+  index_record_t *rec;
+  trigram_set_t trigrams;
+
+  if (slot == NULL) {
     return;
   }
 
-  /* Breadth first, check all children for matches */
-  for (i = 0; i < nchildren; i++) {
-    Window child = children[i];
-    if (!check_window_match(xdo, child, search))
+  /* Drop the record from the postings by indexing no text for it */
+  rec = &index->records[slot->record];
+  window_info_free(&rec->info);
+  memset(&rec->info, 0, sizeof(window_info_t));
+  index_reindex(index, slot->record);
+
+  trigrams = rec->trigrams;
+  memset(rec, 0, sizeof(index_record_t));
+  rec->trigrams = trigrams; /* reused by the next window in this record */
+
+  index->free_records[index->nfree++] = slot->record;
+  window_table_remove(&index->table, slot);
+} /* void index_remove */
+
+static void index_reindex(xdo_window_index_t *index, unsigned int record) {
+  index_record_t *rec = &index->records[record];
+  trigram_set_t *set = &rec->trigrams;
+  const window_info_t *info = &rec->info;
+  unsigned int i;
+  int j;
+
+  /* Remove the record from the postings of its old trigrams */
+  for (i = 0; i < set->count; i++) {
+    posting_t *posting = index_posting(index, set->trigrams[i], False);
+    unsigned int lo = 0, hi;
+
+    if (posting == NULL) {
       continue;
+    }
+    hi = posting->count;
+    while (lo < hi) {
+      unsigned int mid = (lo + hi) / 2;
+      if (posting->records[mid] < record)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo < posting->count && posting->records[lo] == record) {
+      memmove(&posting->records[lo], &posting->records[lo + 1],
+              (posting->count - lo - 1) * sizeof(unsigned int));
+      posting->count--;
+    }
+  }
 
-    (*windowlist_ret)[*nwindows_ret] = child;
-    (*nwindows_ret)++;
+  set->count = 0;
+  for (j = 0; j < info->name.count; j++) {
+    trigram_set_add_text(set, info->name.list[j], strlen(info->name.list[j]));
+  }
+  for (j = 0; j < info->role.count; j++) {
+    trigram_set_add_text(set, info->role.list[j], strlen(info->role.list[j]));
+  }
+  if (info->classhint_fetched && info->classhint_status) {
+    if (info->classhint.res_name != NULL)
+      trigram_set_add_text(set, info->classhint.res_name,
+                           strlen(info->classhint.res_name));
+    if (info->classhint.res_class != NULL)
+      trigram_set_add_text(set, info->classhint.res_class,
+                           strlen(info->classhint.res_class));
+  }
+  trigram_set_finish(set);
+
+  /* Add it to the postings of its new trigrams */
+  for (i = 0; i < set->count; i++) {
+    posting_t *posting = index_posting(index, set->trigrams[i], True);
+    unsigned int lo = 0, hi = posting->count;
+
+    while (lo < hi) {
+      unsigned int mid = (lo + hi) / 2;
+      if (posting->records[mid] < record)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (posting->count == posting->size) {
+      posting->size = posting->size ? posting->size * 2 : 4;
+      posting->records = realloc(posting->records,
+                                 posting->size * sizeof(unsigned int));
+    }
+    memmove(&posting->records[lo + 1], &posting->records[lo],
+            (posting->count - lo) * sizeof(unsigned int));
+    posting->records[lo] = record;
+    posting->count++;
+  }
+} /* void index_reindex */
 
-    if (search->limit > 0 && *nwindows_ret >= search->limit) {
-      /* Limit hit, break early. */
-      break;
+static posting_t *index_posting(xdo_window_index_t *index,
+                                unsigned int trigram, int create) {
+  unsigned int mask = index->postings_size - 1;
+  unsigned int i = (trigram * 2654435761U) & mask;
+
+  while (index->postings[i].trigram != 0) {
+    if (index->postings[i].trigram == trigram) {
+      return &index->postings[i];
     }
+    i = (i + 1) & mask;
+  }
+  if (!create) {
+    return NULL;
+  }
 
-    if (*windowlist_size == *nwindows_ret) {
-      *windowlist_size *= 2;
-      *windowlist_ret = realloc(*windowlist_ret, 
-                                *windowlist_size * sizeof(Window));
+  /* Keep the table at most half full */
+  if ((index->npostings + 1) * 2 > index->postings_size) {
+    posting_t *old = index->postings;
+    unsigned int oldsize = index->postings_size;
+    unsigned int j;
+
+    index->postings_size *= 2;
+    index->postings = calloc(index->postings_size, sizeof(posting_t));
+    mask = index->postings_size - 1;
+    for (j = 0; j < oldsize; j++) {
+      if (old[j].trigram != 0) {
+        unsigned int k = (old[j].trigram * 2654435761U) & mask;
+        while (index->postings[k].trigram != 0) {
+          k = (k + 1) & mask;
+        }
+        index->postings[k] = old[j];
+      }
     }
-  } /* for (i in children) ... */
-  XSetErrorHandler(old_error_handler);
+    free(old);
 
-  /* Now check children-children */
-  if (search->max_depth == -1 || (current_depth + 1) <= search->max_depth) {
-    for (i = 0; i < nchildren; i++) {
-      find_matching_windows(xdo, children[i], search, windowlist_ret,
-                            nwindows_ret, windowlist_size,
-                            current_depth + 1);
+    i = (trigram * 2654435761U) & mask;
+    while (index->postings[i].trigram != 0) {
+      i = (i + 1) & mask;
     }
-  } /* recurse on children if not at max depth */
+  }
 
-  if (children != NULL)
-    XFree(children);
-} /* void find_matching_windows */
+  index->postings[i].trigram = trigram;
+  index->npostings++;
+  return &index->postings[i];
+} /* posting_t *index_posting */
+
+static int index_lookup(xdo_window_index_t *index, const trigram_set_t *set,
+                        unsigned int **records_ret, unsigned int *count_ret) {
+  /* The records containing every trigram in 'set', sorted */
+  posting_t *smallest = NULL;
+  unsigned int *records;
+  unsigned int count;
+  unsigned int i, j;
+
+  for (i = 0; i < set->count; i++) {
+    posting_t *posting = index_posting(index, set->trigrams[i], False);
+    if (posting == NULL || posting->count == 0) {
+      *records_ret = NULL;
+      *count_ret = 0;
+      return False;
+    }
+    if (smallest == NULL || posting->count < smallest->count) {
+      smallest = posting;
+    }
+  }
+
+  records = malloc((smallest->count + 1) * sizeof(unsigned int));
+  memcpy(records, smallest->records, smallest->count * sizeof(unsigned int));
+  count = smallest->count;
+
+  for (i = 0; i < set->count && count > 0; i++) {
+    posting_t *posting = index_posting(index, set->trigrams[i], False);
+    unsigned int n = 0;
+
+    if (posting == smallest) {
+      continue;
+    }
+    for (j = 0; j < count; j++) {
+      unsigned int lo = 0, hi = posting->count;
+      while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (posting->records[mid] < records[j])
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      if (lo < posting->count && posting->records[lo] == records[j]) {
+        records[n++] = records[j];
+      }
+    }
+    count = n;
+  }
+
+  *records_ret = records;
+  *count_ret = count;
+  return count > 0;
+} /* int index_lookup */
+
+static int index_viewable(xdo_window_index_t *index, const index_record_t *rec) {
+  /* Viewable means mapped, and every ancestor up to the root mapped too */
+  while (rec->parent != None) {
+    if (!rec->mapped) {
+      return False;
+    }
+    rec = index_find(index, rec->parent);
+    if (rec == NULL) {
+      return False;
+    }
+  }
+  return True;
+} /* int index_viewable */
+
+static int _trigram_cmp(const void *a, const void *b) {
+  const unsigned int ta = *(const unsigned int *)a;
+  const unsigned int tb = *(const unsigned int *)b;
+  return ta < tb ? -1 : (ta > tb);
+} /* int _trigram_cmp */
+
+static void trigram_set_add_text(trigram_set_t *set, const char *text,
+                                 size_t len) {
+  /* ASCII letters are folded to lower case to match like REG_ICASE */
+  size_t i;
+
+  for (i = 0; i + 2 < len; i++) {
+    unsigned int trigram = 0;
+    size_t k;
+
+    for (k = 0; k < 3; k++) {
+      unsigned char c = text[i + k];
+      if (c >= 'A' && c <= 'Z') {
+        c += 'a' - 'A';
+      }
+      trigram = (trigram << 8) | c;
+    }
+    if (set->count == set->size) {
+      set->size = set->size ? set->size * 2 : 32;
+      set->trigrams = realloc(set->trigrams, set->size * sizeof(unsigned int));
+    }
+    set->trigrams[set->count++] = trigram;
+  }
+} /* void trigram_set_add_text */
+
+static void trigram_set_finish(trigram_set_t *set) {
+  unsigned int i, n = 0;
+
+  if (set->count == 0) {
+    return;
+  }
+  qsort(set->trigrams, set->count, sizeof(unsigned int), _trigram_cmp);
+  for (i = 0; i < set->count; i++) {
+    if (n == 0 || set->trigrams[i] != set->trigrams[n - 1]) {
+      set->trigrams[n++] = set->trigrams[i];
+    }
+  }
+  set->count = n;
+} /* void trigram_set_finish */
+
+static const char *_pattern_skip_bracket(const char *p) {
+  /* Return the ']' closing the bracket expression starting at 'p' */
+  const char *q = p + 1;
+
+  if (*q == '^' || *q == '!') {
+    q++;
+  }
+  if (*q == ']') {
+    q++;
+  }
+  while (*q != '\0' && *q != ']') {
+    if (*q == '[' && (q[1] == ':' || q[1] == '=' || q[1] == '.')) {
+      const char close = q[1];
+      q += 2;
+      while (*q != '\0' && !(*q == close && q[1] == ']')) {
+        q++;
+      }
+      if (*q != '\0') {
+        q += 2;
+      }
+      continue;
+    }
+    q++;
+  }
+  return *q == '\0' ? q - 1 : q;
+} /* const char *_pattern_skip_bracket */
+
+static void pattern_trigrams(const pattern_t *pat, trigram_set_t *set) {
+  /* Collect the trigrams of text that any string matching 'pat' must
+   * contain. This is conservative: runs of plain ASCII characters outside
+   * of groups, with optional characters dropped. Anything with
+   * alternatives requires nothing. */
+  const char *p = pat->literal;
+  char *run;
+  size_t len = 0;
+  int depth = 0;
+  int last_literal = False; /* the last atom is the end of 'run' */
+
+  if (p == NULL) {
+    return;
+  }
+  run = malloc(strlen(p) + 1);
+
+#define RUN_END() \
+  do { trigram_set_add_text(set, run, len); len = 0; } while (0)
+
+  switch (pat->type) {
+    case PATTERN_SUBSTRING:
+    case PATTERN_EXACT:
+    case PATTERN_PREFIX:
+    case PATTERN_SUFFIX:
+      for (; *p != '\0'; p++) {
+        if ((unsigned char)*p >= 0x80) {
+          RUN_END();
+        } else {
+          run[len++] = *p;
+        }
+      }
+      break;
+    case PATTERN_GLOB:
+      for (; *p != '\0'; p++) {
+        if (*p == '*' || *p == '?') {
+          RUN_END();
+        } else if (*p == '[') {
+          RUN_END();
+          p = _pattern_skip_bracket(p);
+        } else {
+          if (*p == '\\' && p[1] != '\0') {
+            p++;
+          }
+          if ((unsigned char)*p >= 0x80) {
+            RUN_END();
+          } else {
+            run[len++] = *p;
+          }
+        }
+      }
+      break;
+    case PATTERN_REGEX:
+      if (strchr(p, '|') != NULL) {
+        break;
+      }
+      for (; *p != '\0'; p++) {
+        unsigned char c = *p;
+
+        switch (c) {
+          case '(':
+            depth++;
+            RUN_END();
+            last_literal = False;
+            break;
+          case ')':
+            if (depth > 0)
+              depth--;
+            RUN_END();
+            last_literal = False;
+            break;
+          case '[':
+            RUN_END();
+            p = _pattern_skip_bracket(p);
+            last_literal = False;
+            break;
+          case '*':
+          case '+':
+          case '?':
+          case '{':
+            /* The atom before may be absent or repeated, and quantifiers
+             * can be stacked ("a+?"), so leave it out */
+            if (last_literal && len > 0)
+              len--;
+            RUN_END();
+            last_literal = False;
+            if (c == '{') {
+              while (p[1] != '\0' && *p != '}')
+                p++;
+            }
+            break;
+          case '.':
+          case '^':
+          case '$':
+            RUN_END();
+            last_literal = False;
+            break;
+          case '\\':
+            /* \w, \b, \1 and friends are not literals */
+            if (p[1] == '\0' || isalnum((unsigned char)p[1])
+                || (unsigned char)p[1] >= 0x80) {
+              RUN_END();
+              last_literal = False;
+              if (p[1] != '\0')
+                p++;
+              break;
+            }
+            c = *++p;
+            /* fall through */
+          default:
+            if (c >= 0x80) {
+              RUN_END();
+              last_literal = False;
+            } else if (depth == 0) {
+              run[len++] = c;
+              last_literal = True;
+            } else {
+              last_literal = False;
+            }
+            break;
+        }
+      }
+      break;
+  }
+  RUN_END();
+#undef RUN_END
+
+  free(run);
+  trigram_set_finish(set);
+} /* void pattern_trigrams */
+
+static const pattern_t *query_pattern(const search_query_t *query,
+                                      unsigned int mask) {
+  switch (mask) {
+    case SEARCH_CLASS: return &query->class_pat;
+    case SEARCH_CLASSNAME: return &query->classname_pat;
+    case SEARCH_NAME: return &query->name_pat;
+    case SEARCH_TITLE: return &query->title_pat;
+    case SEARCH_ROLE: return &query->role_pat;
+  }
+  return NULL;
+} /* const pattern_t *query_pattern */
+
+static window_text_t *_xdo_window_text(const xdo_t *xdo, Window window,
+                                       Atom property, window_text_t *text) {
+  /* historically in xdo, 'match_name' matched the classhint 'name' which we
+   * match in _xdo_match_window_classname. But really, most of the time 'name'
+   * refers to the window manager name for the window, which is displayed in
+   * the titlebar. That is WM_NAME, fetched here like WM_WINDOW_ROLE. */
+  XTextProperty tp;
+
+  if (text->fetched) {
+    return text;
+  }
+
+  memset(&tp, 0, sizeof(tp));
+  XGetTextProperty(xdo->xdpy, window, &tp, property);
+  _xdo_window_text_set(xdo, &tp, text);
+  if (tp.value != NULL)
+    XFree(tp.value);
+  return text;
+} /* window_text_t *_xdo_window_text */
+
+static void _xdo_window_text_set(const xdo_t *xdo, const XTextProperty *tp,
+                                 window_text_t *text) {
+  /* Convert a text property, however it was fetched, to UTF-8 */
+  text->fetched = True;
+  text->empty = True;
+  text->list = NULL;
+  text->count = 0;
+
+  if (tp->value != NULL && tp->nitems > 0) {
+    //XmbTextPropertyToTextList(xdo->xdpy, tp, &text->list, &text->count);
+    Xutf8TextPropertyToTextList(xdo->xdpy, (XTextProperty *)tp, &text->list,
+                                &text->count);
+    text->empty = False;
+  }
+} /* void _xdo_window_text_set */
+
+static int _xdo_match_window_text(const window_text_t *text,
+                                  const pattern_t *pat) {
+  int i;
+
+  /* Treat windows without the property as empty strings */
+  if (text->empty) {
+    return pattern_match(pat, "");
+  }
+
+  for (i = 0; i < text->count; i++) {
+    if (pattern_match(pat, text->list[i])) {
+      return True;
+    }
+  }
+  return False;
+} /* int _xdo_match_window_text */
+
+static XClassHint *_xdo_window_classhint(const xdo_t *xdo, window_info_t *info) {
+  /* Fetch WM_CLASS once for both the class and classname predicates */
+  if (!info->classhint_fetched) {
+    info->classhint_fetched = True;
+    info->classhint_status = XGetClassHint(xdo->xdpy, info->window,
+                                       &info->classhint);
+  }
+  return info->classhint_status ? &info->classhint : NULL;
+} /* XClassHint *_xdo_window_classhint */
+
+static int _xdo_match_window_class(const xdo_t *xdo, window_info_t *info,
+                                   const pattern_t *pat) {
+  XClassHint *classhint = _xdo_window_classhint(xdo, info);
+
+  if (classhint != NULL) {
+    //printf("%d: class %s\n", window, classhint->res_class);
+    return (classhint->res_class != NULL)
+           && pattern_match(pat, classhint->res_class);
+  }
+
+  /* Treat windows with no class as empty strings */
+  return pattern_match(pat, "");
+} /* int _xdo_match_window_class */
+
+static int _xdo_match_window_classname(const xdo_t *xdo, window_info_t *info,
+                                       const pattern_t *pat) {
+  XClassHint *classhint = _xdo_window_classhint(xdo, info);
+
+  if (classhint != NULL) {
+    return (classhint->res_name != NULL)
+           && pattern_match(pat, classhint->res_name);
+  }
+
+  /* Treat windows with no class name as empty strings */
+  return pattern_match(pat, "");
+} /* int _xdo_match_window_classname */
+
+static int _xdo_match_window_pid(const xdo_t *xdo, window_info_t *info,
+                                 const search_query_t *query) {
+  int owner;
+
+  if (!info->pid_fetched) {
+    unsigned char *data;
+    long nitems = 0;
+    Atom type;
+    int size;
+
+    info->pid_fetched = True;
+    info->pid = 0;
+    data = xdo_get_window_property_by_atom(xdo, info->window, query->atom_pid,
+                                           &nitems, &type, &size);
+    if (nitems > 0) {
+      info->pid = (int) *((unsigned long *)data);
+    }
+    free(data);
+  }
+
+  /* _NET_WM_PID is what the application says about itself, and is right
+   * even when the connection is forwarded (ssh -X) or made from another pid
+   * namespace, so it wins over X-Resource like in xdo_get_pid_window */
+  if (info->pid != 0) {
+    return _xdo_pid_wanted(query, info->pid);
+  }
+
+  /* Without it, fall back to the process that created the window, known
+   * without asking the server. Only count windows managed by the window
+   * manager rather than every toolkit subwindow of the process. */
+  if (query->client_pids == NULL) {
+    return False;
+  }
+  owner = _xdo_client_pid(query, info->window);
+  return owner != 0 && _xdo_pid_wanted(query, owner)
+         && _xdo_has_wm_state(xdo, info, query->atom_wm_state);
+} /* int _xdo_match_window_pid */
+
+static int _client_pid_cmp(const void *a, const void *b) {
+  const XID ba = ((const client_pid_t *)a)->base;
+  const XID bb = ((const client_pid_t *)b)->base;
+  return ba < bb ? -1 : (ba > bb);
+} /* int _client_pid_cmp */
+
+static void _xdo_query_client_pids(const xdo_t *xdo, search_query_t *query) {
+  /* Two requests map every local client to its pid, for any number of
+   * windows. Needs X-Resource 1.2 for XResQueryClientIds. */
+  int dummy;
+  int major = 0, minor = 0;
+  XResClient *clients = NULL;
+  int nclients = 0;
+  XResClientIdSpec spec;
+  XResClientIdValue *ids = NULL;
+  long nids = 0;
+  long i;
+
+  query->client_pids = NULL;
+  query->nclient_pids = 0;
+  query->client_mask = 0;
+
+  if (XResQueryExtension(xdo->xdpy, &dummy, &dummy) != True
+      || !XResQueryVersion(xdo->xdpy, &major, &minor)
+      || major < 1 || (major == 1 && minor < 2)) {
+    return;
+  }
+
+  /* Every client has the same resource id mask */
+  if (!XResQueryClients(xdo->xdpy, &nclients, &clients) || nclients == 0) {
+    if (clients != NULL)
+      XFree(clients);
+    return;
+  }
+  query->client_mask = clients[0].resource_mask;
+  XFree(clients);
+
+  spec.client = None; /* all clients */
+  spec.mask = XRES_CLIENT_ID_PID_MASK;
+  if (XResQueryClientIds(xdo->xdpy, 1, &spec, &nids, &ids) != Success) {
+    return;
+  }
+
+  query->client_pids = calloc(nids + 1, sizeof(client_pid_t));
+  for (i = 0; i < nids; i++) {
+    if (XResGetClientIdType(&ids[i]) == XRES_CLIENT_ID_PID
+        && XResGetClientPid(&ids[i]) > 0) {
+      client_pid_t *client = &query->client_pids[query->nclient_pids++];
+      client->base = ids[i].spec.client & ~query->client_mask;
+      client->pid = (int) XResGetClientPid(&ids[i]);
+    }
+  }
+  XResClientIdsDestroy(nids, ids);
+
+  qsort(query->client_pids, query->nclient_pids, sizeof(client_pid_t),
+        _client_pid_cmp);
+} /* void _xdo_query_client_pids */
+
+static int _xdo_client_pid(const search_query_t *query, Window window) {
+  /* The pid of the client that created 'window', or 0 if unknown */
+  const XID base = window & ~query->client_mask;
+  unsigned int lo = 0, hi = query->nclient_pids;
+
+  while (lo < hi) {
+    unsigned int mid = (lo + hi) / 2;
+    if (query->client_pids[mid].base < base)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < query->nclient_pids && query->client_pids[lo].base == base) {
+    return query->client_pids[lo].pid;
+  }
+  return 0;
+} /* int _xdo_client_pid */
+
+static int _pid_cmp(const void *a, const void *b) {
+  const int pa = *(const int *)a;
+  const int pb = *(const int *)b;
+  return pa < pb ? -1 : (pa > pb);
+} /* int _pid_cmp */
+
+static int _pid_parent_cmp(const void *a, const void *b) {
+  /* Sort (pid, ppid) pairs by ppid */
+  return _pid_cmp((const int *)a + 1, (const int *)b + 1);
+} /* int _pid_parent_cmp */
+
+static void _xdo_query_pid_tree(search_query_t *query, int pid) {
+  /* Read the parent of every process from /proc once, then collect the
+   * descendants of 'pid' breadth-first */
+  int (*procs)[2] = NULL; /* (pid, ppid) */
+  unsigned int nprocs = 0;
+  unsigned int size = 0;
+  unsigned int i;
+  DIR *dir;
+  struct dirent *ent;
+
+  query->pids = calloc(1, sizeof(int));
+  query->pids[0] = pid;
+  query->npids = 1;
+
+  dir = opendir("/proc");
+  if (dir == NULL) {
+    return;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    char path[64];
+    char buf[512];
+    FILE *fp;
+    size_t len;
+    char *comm_end;
+    char state;
+    int ppid;
+
+    if (!isdigit((unsigned char)ent->d_name[0])) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/proc/%d/stat", atoi(ent->d_name));
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+      continue; /* exited in the meantime */
+    }
+    len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    /* "pid (comm) state ppid ...", where comm may contain anything */
+    comm_end = strrchr(buf, ')');
+    if (comm_end == NULL || sscanf(comm_end + 1, " %c %d", &state, &ppid) != 2) {
+      continue;
+    }
+    if (nprocs == size) {
+      size = size ? size * 2 : 256;
+      procs = realloc(procs, size * sizeof(*procs));
+    }
+    procs[nprocs][0] = atoi(ent->d_name);
+    procs[nprocs][1] = ppid;
+    nprocs++;
+  }
+  closedir(dir);
+
+  /* Children of a process are found by binary search on the parent */
+  qsort(procs, nprocs, sizeof(*procs), _pid_parent_cmp);
+  query->pids = realloc(query->pids, (nprocs + 1) * sizeof(int));
+  for (i = 0; i < query->npids; i++) {
+    const int parent = query->pids[i];
+    unsigned int lo = 0, hi = nprocs;
+
+    while (lo < hi) {
+      unsigned int mid = (lo + hi) / 2;
+      if (procs[mid][1] < parent)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    for (; lo < nprocs && procs[lo][1] == parent; lo++) {
+      query->pids[query->npids++] = procs[lo][0];
+    }
+  }
+  free(procs);
+
+  qsort(query->pids, query->npids, sizeof(int), _pid_cmp);
+} /* void _xdo_query_pid_tree */
+
+static int _xdo_pid_wanted(const search_query_t *query, int pid) {
+  unsigned int lo = 0, hi = query->npids;
+
+  if (query->pids == NULL) {
+    return pid == query->search->pid;
+  }
+  while (lo < hi) {
+    unsigned int mid = (lo + hi) / 2;
+    if (query->pids[mid] < pid)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < query->npids && query->pids[lo] == pid;
+} /* int _xdo_pid_wanted */
+
+static int _xdo_match_window_desktop(const xdo_t *xdo, window_info_t *info,
+                                     const search_query_t *query) {
+  /* Read _NET_WM_DESKTOP directly rather than through
+   * xdo_get_desktop_for_window, which checks _NET_SUPPORTED on every call
+   * and complains about windows without a desktop. */
+  if (!info->desktop_fetched) {
+    unsigned char *data;
+    long nitems = 0;
+    Atom type;
+    int size = 0;
+
+    info->desktop_fetched = True;
+    info->desktop_ok = False;
+    data = xdo_get_window_property_by_atom(xdo, info->window,
+                                           query->atom_desktop, &nitems,
+                                           &type, &size);
+    if (nitems > 0 && size == 32) {
+      info->desktop = *((long *)data);
+      info->desktop_ok = True;
+    }
+    free(data);
+  }
+
+  /* Desktop matched if we support desktop queries *and* the desktop is
+   * equal */
+  return (info->desktop_ok && info->desktop == query->search->desktop);
+} /* int _xdo_match_window_desktop */
+
+static int _pattern_is_literal(const char *text) {
+  /* Only plain ASCII without regex operators is safe to match as a
+   * substring; REG_ICASE may fold other characters differently. */
+  for (; *text != '\0'; text++) {
+    if ((unsigned char)*text >= 0x80 || strchr(".[]()*+?{}|^$\\", *text)) {
+      return False;
+    }
+  }
+  return True;
+} /* int _pattern_is_literal */
+
+static int pattern_compile(const char *text, pattern_t *pat,
+                           unsigned int searchmask) {
+  int ret;
+  size_t len;
+
+  memset(pat, 0, sizeof(*pat));
+  if (text == NULL) {
+    /* No pattern only matches empty strings */
+    pat->type = PATTERN_EXACT;
+    pat->literal = strdup("");
+    return True;
+  }
+
+  len = strlen(text);
+  if (searchmask & SEARCH_FIXED) {
+    pat->type = PATTERN_SUBSTRING;
+  } else if (searchmask & SEARCH_GLOB) {
+    /* Globs with '*' only at either end are literal compares */
+    const size_t lead = (len > 0 && text[0] == '*');
+    const size_t trail = (len > lead && text[len - 1] == '*');
+    const char *inner = text + lead;
+    const size_t inner_len = len - lead - trail;
+
+    if (strcspn(inner, "*?[\\") >= inner_len) {
+      if (lead) {
+        pat->type = trail ? PATTERN_SUBSTRING : PATTERN_SUFFIX;
+      } else {
+        pat->type = trail ? PATTERN_PREFIX : PATTERN_EXACT;
+      }
+      pat->literal = strndup(inner, inner_len);
+      pat->len = inner_len;
+      return True;
+    }
+    pat->type = PATTERN_GLOB;
+  } else if (_pattern_is_literal(text)) {
+    pat->type = PATTERN_SUBSTRING;
+  } else {
+    pat->type = PATTERN_REGEX;
+    ret = regcomp(&pat->re, text, REG_EXTENDED | REG_ICASE);
+    if (ret != 0) {
+      char reason[256];
+      regerror(ret, &pat->re, reason, sizeof(reason));
+      fprintf(stderr, "Failed to compile regex '%s': %s\n", text, reason);
+      return False;
+    }
+    /* The source is kept for pattern_trigrams */
+    pat->literal = strdup(text);
+    pat->len = len;
+    return True;
+  }
+
+  pat->literal = strdup(text);
+  pat->len = len;
+  return True;
+} /* int pattern_compile */
+
+static int pattern_match(const pattern_t *pat, const char *str) {
+  size_t len;
+
+  switch (pat->type) {
+    case PATTERN_REGEX:
+      return regexec(&pat->re, str, 0, NULL, 0) == 0;
+    case PATTERN_SUBSTRING:
+      return strcasestr(str, pat->literal) != NULL;
+    case PATTERN_EXACT:
+      return strcasecmp(str, pat->literal) == 0;
+    case PATTERN_PREFIX:
+      return strncasecmp(str, pat->literal, pat->len) == 0;
+    case PATTERN_SUFFIX:
+      len = strlen(str);
+      return len >= pat->len
+             && strcasecmp(str + len - pat->len, pat->literal) == 0;
+    case PATTERN_GLOB:
+      return fnmatch(pat->literal, str, FNM_CASEFOLD) == 0;
+  }
+  return False;
+} /* int pattern_match */
+
+static void pattern_free(pattern_t *pat) {
+  if (pat->type == PATTERN_REGEX) {
+    regfree(&pat->re);
+  }
+  free(pat->literal);
+} /* void pattern_free */
+
+static int query_init(const xdo_t *xdo, search_query_t *query,
+                      const xdo_search_t *search) {
+  unsigned int i;
+  struct {
+    const char *text;
+    pattern_t *pat;
+  } patterns[] = {
+    { search->title, &query->title_pat },
+    { search->winclass, &query->class_pat },
+    { search->winclassname, &query->classname_pat },
+    { search->winname, &query->name_pat },
+    { search->winrole, &query->role_pat },
+  };
+  const unsigned int npatterns = sizeof(patterns) / sizeof(patterns[0]);
+
+  query->search = search;
+  for (i = 0; i < npatterns; i++) {
+    if (!pattern_compile(patterns[i].text, patterns[i].pat,
+                         search->searchmask)) {
+      while (i-- > 0) {
+        pattern_free(patterns[i].pat);
+      }
+      return False;
+    }
+  }
+
+  if (search->searchmask & SEARCH_TITLE) {
+    fprintf(stderr, "This function (match window by title) is deprecated."
+            " You want probably want to match by the window name.\n");
+  }
+
+  query->atom_role = None;
+  if (search->searchmask & SEARCH_ROLE) {
+    query->atom_role = XInternAtom(xdo->xdpy, "WM_WINDOW_ROLE", False);
+  }
+  query->atom_wm_state = None;
+  if (search->searchmask & (SEARCH_TOPLEVEL | SEARCH_PID)) {
+    query->atom_wm_state = XInternAtom(xdo->xdpy, "WM_STATE", False);
+  }
+  query->atom_desktop = None;
+  if (search->searchmask & SEARCH_DESKTOP) {
+    query->atom_desktop = XInternAtom(xdo->xdpy, "_NET_WM_DESKTOP", False);
+  }
+  query->atom_pid = None;
+  query->client_pids = NULL;
+  query->nclient_pids = 0;
+  query->pids = NULL;
+  query->npids = 0;
+  if (search->searchmask & SEARCH_PID) {
+    query->atom_pid = XInternAtom(xdo->xdpy, "_NET_WM_PID", False);
+    _xdo_query_client_pids(xdo, query);
+    if (search->searchmask & SEARCH_PIDTREE) {
+      _xdo_query_pid_tree(query, search->pid);
+    }
+  }
+
+  /* The plan is the requested predicates in cost order */
+  query->nplan = 0;
+  for (i = 0; i < NPREDICATES; i++) {
+    if (search->searchmask & predicates[i].mask) {
+      query->plan[query->nplan++] = i;
+    }
+  }
+  return True;
+} /* int query_init */
+
+static void query_free(search_query_t *query) {
+  free(query->client_pids);
+  free(query->pids);
+  pattern_free(&query->title_pat);
+  pattern_free(&query->class_pat);
+  pattern_free(&query->classname_pat);
+  pattern_free(&query->name_pat);
+  pattern_free(&query->role_pat);
+} /* void query_free */
+
+static int _xdo_is_window_visible(const xdo_t *xdo, window_info_t *info) {
+  XWindowAttributes wattr;
+
+  if (!info->visible_fetched) {
+    info->visible_fetched = True;
+    info->visible = (XGetWindowAttributes(xdo->xdpy, info->window, &wattr)
+                     && wattr.map_state == IsViewable);
+  }
+  return info->visible;
+} /* int _xdo_is_window_visible */
+
+static int _xdo_has_wm_state(const xdo_t *xdo, window_info_t *info,
+                             Atom atom_wm_state) {
+  /* Ask for no data, we only care whether the property exists */
+  Atom type = None;
+  int format;
+  unsigned long nitems, bytes_after;
+  unsigned char *prop = NULL;
+
+  if (info->wm_state_fetched) {
+    return info->wm_state;
+  }
+  info->wm_state_fetched = True;
+  info->wm_state = False;
+
+  if (XGetWindowProperty(xdo->xdpy, info->window, atom_wm_state, 0, 0, False,
+                AnyPropertyType, &type, &format, &nitems,
+                &bytes_after, &prop) != Success) {
+    return False;
+  }
+  if (prop != NULL)
+    XFree(prop);
+  info->wm_state = (type != None);
+  return info->wm_state;
+} /* int _xdo_has_wm_state */
+
+static int check_predicate(const xdo_t *xdo, window_info_t *info,
+                           const search_query_t *query, unsigned int mask) {
+  switch (mask) {
+    case SEARCH_ONLYVISIBLE:
+      return _xdo_is_window_visible(xdo, info);
+    case SEARCH_PID:
+      return _xdo_match_window_pid(xdo, info, query);
+    case SEARCH_CLASS:
+      return _xdo_match_window_class(xdo, info, &query->class_pat);
+    case SEARCH_CLASSNAME:
+      return _xdo_match_window_classname(xdo, info, &query->classname_pat);
+    case SEARCH_NAME:
+      return _xdo_match_window_text(
+          _xdo_window_text(xdo, info->window, XA_WM_NAME, &info->name),
+          &query->name_pat);
+    case SEARCH_TITLE:
+      return _xdo_match_window_text(
+          _xdo_window_text(xdo, info->window, XA_WM_NAME, &info->name),
+          &query->title_pat);
+    case SEARCH_ROLE:
+      return _xdo_match_window_text(
+          _xdo_window_text(xdo, info->window, query->atom_role, &info->role),
+          &query->role_pat);
+    case SEARCH_DESKTOP:
+      return _xdo_match_window_desktop(xdo, info, query);
+  }
+  return False;
+} /* int check_predicate */
+
+static void window_info_init(window_info_t *info, Window window) {
+  memset(info, 0, sizeof(*info));
+  info->window = window;
+} /* void window_info_init */
+
+static void window_info_free(window_info_t *info) {
+  if (info->classhint_fetched && info->classhint_status) {
+    XFree(info->classhint.res_name);
+    XFree(info->classhint.res_class);
+  }
+  if (info->name.list != NULL)
+    XFreeStringList(info->name.list);
+  if (info->role.list != NULL)
+    XFreeStringList(info->role.list);
+} /* void window_info_free */
+
+static int check_window_match(const xdo_t *xdo, window_info_t *info,
+                              const search_query_t *query) {
+  /* Set this to 1 for dev debugging */
+  static const int debug = 0;
+
+  const xdo_search_t *search = query->search;
+  const Window wid = info->window;
+  int any_ok = False;
+  int ret;
+  unsigned int i;
+
+  if (search->require != SEARCH_ANY && search->require != SEARCH_ALL) {
+    fprintf(stderr, 
+            "Unexpected code reached. search->require is not valid? (%d); "
+            "this may be a bug?\n",
+            search->require);
+    return False;
+  }
+
+  /* Walk the plan, stopping at the first predicate that decides the result:
+   * any failure for SEARCH_ALL, or a failed hard predicate for SEARCH_ANY.
+   * Once one of the other predicates has matched for SEARCH_ANY, only the
+   * remaining hard ones are checked. */
+  ret = True;
+  for (i = 0; i < query->nplan; i++) {
+    const int p = query->plan[i];
+
+    if (!predicates[p].hard && search->require == SEARCH_ANY && any_ok) {
+      continue;
+    }
+
+    if (check_predicate(xdo, info, query, predicates[p].mask)) {
+      if (!predicates[p].hard) {
+        any_ok = True;
+      }
+      continue;
+    }
+
+    if (debug) fprintf(stderr, "skip %ld %s\n", wid, predicates[p].name);
+    if (predicates[p].hard || search->require == SEARCH_ALL) {
+      ret = False;
+      break;
+    }
+  }
+
+  /* SEARCH_ANY needs at least one of the non-hard predicates to match */
+  if (ret && search->require == SEARCH_ANY) {
+    ret = any_ok;
+  }
+  return ret;
+} /* int check_window_match */
+
+static void find_matching_windows(const xdo_t *xdo, Window root,
+                                  search_state_t *state) {
+  /* Breadth-first search below 'root', one level at a time. 'level' holds
+   * the windows whose children are checked next, and the children that
+   * should be descended into are collected in 'next'. The two buffers are
+   * swapped after each level, so they only grow to the widest level.
+   *
+   * When requests are pipelined (XDO_FEATURE_XCB), the whole level is
+   * queried at once and everything the queries look at is fetched ahead,
+   * so each level costs about two round trips however wide it is.
+   * Otherwise each parent is queried and its children checked in turn.
+   *
+   * If match, report it.
+   * If over limit or told to stop, stop right away; no further XQueryTree
+   * is sent.
+   */
+
+  const xdo_search_t *search = state->search;
+  const int pipelined = _xdo_pipelined(xdo);
+  Window *children = NULL;
+  unsigned int children_size = 0;
+  window_info_t *infos = NULL;
+  unsigned int infos_size = 0;
+  unsigned int i, j, end, nchildren;
+
+  Window *level, *next, *swap;
+  unsigned int nlevel, nnext;
+  unsigned int level_size = 64, next_size = 64, swap_size;
+  long depth = 0; /* depth of the windows in 'level' */
+
+  /* Break early, if we have enough windows already. */
+  if (state->stopped) {
+    return;
+  }
+
+  level = malloc(level_size * sizeof(Window));
+  next = malloc(next_size * sizeof(Window));
+  level[0] = root;
+  nlevel = 1;
+
+  /* Stop once the children would be too deep */
+  while (nlevel > 0 && (search->max_depth == -1 || depth < search->max_depth)) {
+    /* Only queue children if their own children are within max depth */
+    int descend = (search->max_depth == -1 || depth + 1 < search->max_depth);
+    nnext = 0;
+
+    for (i = 0; i < nlevel; i = end) {
+      int stopped;
+
+      /* Windows where XQueryTree fails are skipped; they have probably been
+       * destroyed since we saw them. */
+      end = pipelined ? nlevel : i + 1;
+      nchildren = _xdo_query_children(xdo, level + i, end - i, &children,
+                                      &children_size);
+      if (nchildren > infos_size) {
+        infos_size = nchildren;
+        infos = realloc(infos, infos_size * sizeof(window_info_t));
+      }
+      for (j = 0; j < nchildren; j++) {
+        window_info_init(&infos[j], children[j]);
+      }
+      if (pipelined) {
+        _xdo_prefetch_windows(xdo, state, infos, nchildren);
+      }
+
+      stopped = search_check_children(xdo, state, infos, nchildren, descend,
+                                      &next, &nnext, &next_size);
+      for (j = 0; j < nchildren; j++) {
+        window_info_free(&infos[j]);
+      }
+      if (stopped) {
+        /* Limit hit or told to stop, we are done. */
+        goto done;
+      }
+    } /* for (i in level) ... */
+
+    swap = level;
+    level = next;
+    next = swap;
+    nlevel = nnext;
+    swap_size = level_size;
+    level_size = next_size;
+    next_size = swap_size;
+    depth++;
+  } /* while levels remain */
+
+done:
+  free(level);
+  free(next);
+  free(children);
+  free(infos);
+} /* void find_matching_windows */
+
+static int _xdo_pipelined(const xdo_t *xdo) {
+  return (xdo->features_mask & (1 << XDO_FEATURE_XCB)) != 0;
+} /* int _xdo_pipelined */
+
+static int search_check_children(const xdo_t *xdo, search_state_t *state,
+                                 window_info_t *infos, unsigned int ninfos,
+                                 int descend, Window **next_ret,
+                                 unsigned int *nnext_ret,
+                                 unsigned int *next_size_ret) {
+  /* Check windows that share a level of the tree, queueing those to
+   * descend into on '*next_ret'. Returns True if the search should stop. */
+  const xdo_search_t *search = state->search;
+  unsigned int j;
+
+  for (j = 0; j < ninfos; j++) {
+    window_info_t *info = &infos[j];
+
+    if (search_check(xdo, state, info)) {
+      /* Limit hit or told to stop, we are done. */
+      return True;
+    }
+
+    /* Nothing below an unviewable window can be viewable, and with
+     * SEARCH_TOPLEVEL nothing below a client window is searched. */
+    if (descend
+        && !(info->visible_fetched && !info->visible)
+        && !((search->searchmask & SEARCH_TOPLEVEL)
+             && _xdo_has_wm_state(xdo, info,
+                                  state->queries[0].atom_wm_state))) {
+      if (*nnext_ret == *next_size_ret) {
+        *next_size_ret *= 2;
+        *next_ret = realloc(*next_ret, *next_size_ret * sizeof(Window));
+      }
+      (*next_ret)[(*nnext_ret)++] = info->window;
+    }
+  } /* for (j in infos) ... */
+  return False;
+} /* int search_check_children */
+
+static unsigned int _xdo_query_children(const xdo_t *xdo,
+                                        const Window *parents,
+                                        unsigned int nparents,
+                                        Window **children_ret,
+                                        unsigned int *size_ret) {
+  /* Store the children of all of 'parents' in '*children_ret', in order,
+   * growing it as needed. Returns how many there are. When pipelined, every
+   * XQueryTree is sent before the first reply is read. */
+  unsigned int count = 0;
+  unsigned int i;
+
+  if (_xdo_pipelined(xdo)) {
+    children_fetch_t fetch;
+
+    _xdo_children_send(xdo, parents, nparents, &fetch);
+    _xdo_children_take(xdo, &fetch, True, children_ret, size_ret, &count);
+    return count;
+  }
+
+  for (i = 0; i < nparents; i++) {
+    Window dummy;
+    Window *children = NULL;
+    unsigned int nchildren = 0;
+
+    if (!XQueryTree(xdo->xdpy, parents[i], &dummy, &dummy, &children,
+                   &nchildren)) {
+      if (children != NULL)
+        XFree(children);
+      continue;
+    }
+
+    if (count + nchildren > *size_ret) {
+      while (count + nchildren > *size_ret) {
+        *size_ret = (*size_ret == 0) ? 64 : *size_ret * 2;
+      }
+      *children_ret = realloc(*children_ret, *size_ret * sizeof(Window));
+    }
+    memcpy(*children_ret + count, children, nchildren * sizeof(Window));
+    count += nchildren;
+
+    if (children != NULL)
+      XFree(children);
+  }
+  return count;
+} /* unsigned int _xdo_query_children */
+
+static void _xdo_children_send(const xdo_t *xdo, const Window *parents,
+                               unsigned int nparents, children_fetch_t *fetch) {
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  unsigned int i;
+
+  fetch->cookies = malloc((nparents + 1) * sizeof(*fetch->cookies));
+  fetch->n = nparents;
+  fetch->ntaken = 0;
+  for (i = 0; i < nparents; i++) {
+    fetch->cookies[i] = xcb_query_tree(xcb, parents[i]);
+  }
+} /* void _xdo_children_send */
+
+static int _xdo_children_take(const xdo_t *xdo, children_fetch_t *fetch,
+                              int block, Window **children_ret,
+                              unsigned int *size_ret,
+                              unsigned int *count_ret) {
+  /* Append the children from the replies that have arrived to
+   * '*children_ret'. Returns True once every reply is in; parents that
+   * failed, probably destroyed since we saw them, have no children. */
+  while (fetch->ntaken < fetch->n) {
+    xcb_query_tree_reply_t *reply;
+    xcb_window_t *ids;
+    unsigned int j, nchildren;
+
+    if (!_xdo_async_reply(xdo, fetch->cookies[fetch->ntaken].sequence, block,
+                          (void **)&reply, __func__)) {
+      return False;
+    }
+    fetch->ntaken++;
+    if (reply == NULL) {
+      continue;
+    }
+
+    nchildren = xcb_query_tree_children_length(reply);
+    ids = xcb_query_tree_children(reply);
+    if (*count_ret + nchildren > *size_ret) {
+      while (*count_ret + nchildren > *size_ret) {
+        *size_ret = (*size_ret == 0) ? 64 : *size_ret * 2;
+      }
+      *children_ret = realloc(*children_ret, *size_ret * sizeof(Window));
+    }
+    for (j = 0; j < nchildren; j++) {
+      (*children_ret)[(*count_ret)++] = ids[j];
+    }
+    free(reply);
+  }
+
+  free(fetch->cookies);
+  fetch->cookies = NULL;
+  return True;
+} /* int _xdo_children_take */
+
+static Status _xdo_classhint_from_reply(const xcb_get_property_reply_t *reply,
+                                        XClassHint *classhint) {
+  /* Parse WM_CLASS the way XGetClassHint does: two NUL-terminated strings,
+   * the second of which may be missing */
+  const char *data;
+  int len, name_len;
+
+  if (reply == NULL || reply->type != XA_STRING || reply->format != 8) {
+    return 0;
+  }
+  data = xcb_get_property_value(reply);
+  len = xcb_get_property_value_length(reply);
+  name_len = strnlen(data, len);
+  classhint->res_name = strndup(data, name_len);
+  if (name_len < len) {
+    data += name_len + 1;
+    len -= name_len + 1;
+  } else {
+    len = 0;
+  }
+  classhint->res_class = strndup(data, strnlen(data, len));
+  return 1;
+} /* Status _xdo_classhint_from_reply */
+
+static void _xdo_prefetch_store(const xdo_t *xdo, window_info_t *info,
+                                unsigned int which,
+                                const xcb_get_property_reply_t *reply) {
+  /* Fill the cache the predicates would otherwise fill with Xlib calls */
+  XTextProperty tp;
+  int len = (reply != NULL) ? xcb_get_property_value_length(reply) : 0;
+
+  switch (which) {
+    case PREFETCH_CLASS:
+      info->classhint_fetched = True;
+      info->classhint_status = _xdo_classhint_from_reply(reply,
+                                                         &info->classhint);
+      break;
+    case PREFETCH_NAME:
+    case PREFETCH_ROLE:
+      /* Xlib hands out text properties NUL-terminated; do the same */
+      memset(&tp, 0, sizeof(tp));
+      if (reply != NULL && reply->type != None && reply->format != 0) {
+        tp.value = malloc(len + 1);
+        memcpy(tp.value, xcb_get_property_value(reply), len);
+        tp.value[len] = '\0';
+        tp.encoding = reply->type;
+        tp.format = reply->format;
+        tp.nitems = len / (reply->format / 8);
+      }
+      _xdo_window_text_set(xdo, &tp, (which == PREFETCH_NAME) ? &info->name
+                                                              : &info->role);
+      free(tp.value);
+      break;
+    case PREFETCH_PID:
+      info->pid_fetched = True;
+      info->pid = 0;
+      if (reply != NULL && reply->format == 32 && len >= 4) {
+        info->pid = (int) *((uint32_t *)xcb_get_property_value(reply));
+      }
+      break;
+    case PREFETCH_WM_STATE:
+      info->wm_state_fetched = True;
+      info->wm_state = (reply != NULL && reply->type != None);
+      break;
+    case PREFETCH_DESKTOP:
+      /* Xlib sign-extends 32-bit items into longs; so -1 stays -1 */
+      info->desktop_fetched = True;
+      info->desktop_ok = (reply != NULL && reply->format == 32 && len >= 4);
+      if (info->desktop_ok) {
+        info->desktop = *((int32_t *)xcb_get_property_value(reply));
+      }
+      break;
+  }
+} /* void _xdo_prefetch_store */
+
+static void _xdo_prefetch_windows(const xdo_t *xdo,
+                                  const search_state_t *state,
+                                  window_info_t *infos, unsigned int ninfos) {
+  /* Fetch what the queries will look at for all of 'infos' in a single
+   * round trip, filling the same caches the predicates fill one request at
+   * a time. */
+  prefetch_t prefetch;
+
+  _xdo_prefetch_send(xdo, state, infos, ninfos, &prefetch);
+  _xdo_prefetch_take(xdo, &prefetch, True);
+} /* void _xdo_prefetch_windows */
+
+static void _xdo_prefetch_send(const xdo_t *xdo, const search_state_t *state,
+                               window_info_t *infos, unsigned int ninfos,
+                               prefetch_t *prefetch) {
+  /* Windows whose process is known not to be wanted are not asked for
+   * _NET_WM_PID; the pid predicate rules them out without it. */
+  const unsigned long mask = state->search->searchmask;
+  const search_query_t *query = &state->queries[0];
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  Atom atoms[NPREFETCH];
+  uint32_t lengths[NPREFETCH];
+  unsigned int i, k;
+
+  atoms[PREFETCH_CLASS] = XA_WM_CLASS;
+  atoms[PREFETCH_NAME] = XA_WM_NAME;
+  atoms[PREFETCH_ROLE] = query->atom_role;
+  atoms[PREFETCH_PID] = query->atom_pid;
+  atoms[PREFETCH_WM_STATE] = query->atom_wm_state;
+  atoms[PREFETCH_DESKTOP] = query->atom_desktop;
+  for (k = 0; k < NPREFETCH; k++) {
+    lengths[k] = UINT32_MAX; /* the whole property */
+  }
+  lengths[PREFETCH_PID] = 1;
+  lengths[PREFETCH_WM_STATE] = 0;
+  lengths[PREFETCH_DESKTOP] = 1;
+
+  prefetch->infos = infos;
+  prefetch->ninfos = ninfos;
+  prefetch->wanted = calloc(ninfos + 1, sizeof(unsigned int));
+  prefetch->sequences = malloc((ninfos * (NPREFETCH + 1) + 1)
+                               * sizeof(unsigned int));
+  prefetch->next = 0;
+
+  for (i = 0; i < ninfos; i++) {
+    window_info_t *info = &infos[i];
+    unsigned int *wanted = &prefetch->wanted[i];
+    unsigned int *sequences = &prefetch->sequences[i * (NPREFETCH + 1)];
+    int owner_wanted = True;
+
+    if (query->client_pids != NULL) {
+      int owner = _xdo_client_pid(query, info->window);
+      owner_wanted = (owner == 0 || _xdo_pid_wanted(query, owner));
+    }
+
+    if ((mask & (SEARCH_CLASS | SEARCH_CLASSNAME)) && !info->classhint_fetched)
+      *wanted |= 1 << PREFETCH_CLASS;
+    if ((mask & (SEARCH_NAME | SEARCH_TITLE)) && !info->name.fetched)
+      *wanted |= 1 << PREFETCH_NAME;
+    if ((mask & SEARCH_ROLE) && !info->role.fetched)
+      *wanted |= 1 << PREFETCH_ROLE;
+    if ((mask & SEARCH_PID) && !info->pid_fetched)
+      *wanted |= 1 << PREFETCH_PID;
+    if (((mask & SEARCH_TOPLEVEL) || ((mask & SEARCH_PID) && owner_wanted))
+        && !info->wm_state_fetched)
+      *wanted |= 1 << PREFETCH_WM_STATE;
+    if ((mask & SEARCH_DESKTOP) && !info->desktop_fetched)
+      *wanted |= 1 << PREFETCH_DESKTOP;
+    if ((mask & SEARCH_ONLYVISIBLE) && !info->visible_fetched)
+      *wanted |= 1 << PREFETCH_VISIBLE;
+
+    for (k = 0; k < NPREFETCH; k++) {
+      if (*wanted & (1 << k)) {
+        sequences[k] = xcb_get_property(xcb, 0, info->window, atoms[k],
+            XCB_GET_PROPERTY_TYPE_ANY, 0, lengths[k]).sequence;
+      }
+    }
+    if (*wanted & (1 << PREFETCH_VISIBLE)) {
+      sequences[PREFETCH_VISIBLE] = xcb_get_window_attributes(xcb,
+          info->window).sequence;
+    }
+  }
+} /* void _xdo_prefetch_send */
+
+static int _xdo_prefetch_take(const xdo_t *xdo, prefetch_t *prefetch,
+                              int block) {
+  /* Store the replies that have arrived, in the order they were sent.
+   * Returns True once every reply is in. */
+  const unsigned int nslots = prefetch->ninfos * (NPREFETCH + 1);
+
+  for (; prefetch->next < nslots; prefetch->next++) {
+    const unsigned int i = prefetch->next / (NPREFETCH + 1);
+    const unsigned int k = prefetch->next % (NPREFETCH + 1);
+    window_info_t *info = &prefetch->infos[i];
+    void *reply;
+
+    if (!(prefetch->wanted[i] & (1 << k))) {
+      continue;
+    }
+    if (!_xdo_async_reply(xdo, prefetch->sequences[prefetch->next], block,
+                          &reply, __func__)) {
+      return False;
+    }
+
+    if (k == PREFETCH_VISIBLE) {
+      xcb_get_window_attributes_reply_t *attr = reply;
+
+      info->visible_fetched = True;
+      info->visible = (attr != NULL
+                       && attr->map_state == XCB_MAP_STATE_VIEWABLE);
+    } else {
+      _xdo_prefetch_store(xdo, info, k, reply);
+    }
+    free(reply);
+  }
+
+  free(prefetch->wanted);
+  free(prefetch->sequences);
+  prefetch->wanted = NULL;
+  prefetch->sequences = NULL;
+  return True;
+} /* int _xdo_prefetch_take */
+
+static int find_matching_clients(const xdo_t *xdo, Window root,
+                                 search_state_t *state) {
+  /* Check the windows listed in the root window's client list, in stacking
+   * order if the window manager provides it. Returns False if there is no
+   * client list, in which case the caller should walk the tree instead. */
+  static const char *properties[] = {
+    "_NET_CLIENT_LIST_STACKING", "_NET_CLIENT_LIST", NULL
+  };
+  Window *clients = NULL;
+  window_info_t *infos;
+  long i, nclients = 0;
+  Atom type = None;
+  int size = 0;
+
+  for (i = 0; properties[i] != NULL; i++) {
+    clients = (Window *)xdo_get_window_property_by_atom(xdo, root,
+        XInternAtom(xdo->xdpy, properties[i], False), &nclients, &type, &size);
+    if (clients != NULL && type == XA_WINDOW && size == 32) {
+      break;
+    }
+    if (clients != NULL) {
+      XFree(clients);
+      clients = NULL;
+    }
+  }
+
+  if (clients == NULL) {
+    return False;
+  }
+
+  /* Clients may be destroyed before we get to them; BadWindow errors are
+   * already being dropped for the whole search. */
+  infos = malloc(nclients * sizeof(window_info_t));
+  for (i = 0; i < nclients; i++) {
+    window_info_init(&infos[i], clients[i]);
+  }
+  if (_xdo_pipelined(xdo)) {
+    _xdo_prefetch_windows(xdo, state, infos, nclients);
+  }
+
+  for (i = 0; i < nclients && !state->stopped; i++) {
+    search_check(xdo, state, &infos[i]);
+  } /* for (i in clients) ... */
+
+  for (i = 0; i < nclients; i++) {
+    window_info_free(&infos[i]);
+  }
+  free(infos);
+  XFree(clients);
+  return True;
+} /* int find_matching_clients */
+
+static void search_async_windows(const xdo_t *xdo, search_async_t *async) {
+  /* Fetch what the queries need for 'children' */
+  unsigned int j;
+
+  if (async->nchildren > async->infos_size) {
+    async->infos_size = async->nchildren;
+    async->infos = realloc(async->infos,
+                           async->infos_size * sizeof(window_info_t));
+  }
+  for (j = 0; j < async->nchildren; j++) {
+    window_info_init(&async->infos[j], async->children[j]);
+  }
+  _xdo_prefetch_send(xdo, &async->state, async->infos, async->nchildren,
+                     &async->prefetch);
+  async->phase = ASYNC_WINDOWS;
+} /* void search_async_windows */
+
+static void search_async_root(const xdo_t *xdo, search_async_t *async) {
+  /* Check the root window itself, then walk the tree below it */
+  if (async->children_size == 0) {
+    async->children_size = 64;
+    async->children = malloc(async->children_size * sizeof(Window));
+  }
+  async->children[0] = RootWindow(xdo->xdpy, async->screen);
+  async->nchildren = 1;
+  async->checking_root = True;
+  async->checking_clients = False;
+  search_async_windows(xdo, async);
+} /* void search_async_root */
+
+static int search_async_screen(const xdo_t *xdo, search_async_t *async) {
+  /* Start on the next screen. Returns True if there is none left. */
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  Window root;
+
+  while (async->screen < ScreenCount(xdo->xdpy)
+         && (async->search.searchmask & SEARCH_SCREEN)
+         && async->screen != async->search.screen) {
+    async->screen++;
+  }
+  if (async->state.stopped || async->screen >= ScreenCount(xdo->xdpy)) {
+    return True;
+  }
+
+  if (!(async->search.searchmask & SEARCH_CLIENTS)) {
+    search_async_root(xdo, async);
+    return False;
+  }
+
+  /* Ask for both client lists at once, like find_matching_clients */
+  root = RootWindow(xdo->xdpy, async->screen);
+  async->client_sequences[0] = xcb_get_property(xcb, 0, root,
+      XInternAtom(xdo->xdpy, "_NET_CLIENT_LIST_STACKING", False),
+      XA_WINDOW, 0, UINT32_MAX).sequence;
+  async->client_sequences[1] = xcb_get_property(xcb, 0, root,
+      XInternAtom(xdo->xdpy, "_NET_CLIENT_LIST", False),
+      XA_WINDOW, 0, UINT32_MAX).sequence;
+  async->nclient_replies = 0;
+  async->phase = ASYNC_CLIENTS;
+  return False;
+} /* int search_async_screen */
+
+static int search_async_clients(const xdo_t *xdo, search_async_t *async) {
+  /* Check the client list once it is in, or walk the tree if there is
+   * none. Returns False while waiting for the replies. */
+  xcb_get_property_reply_t *clients = NULL;
+  unsigned int i;
+
+  while (async->nclient_replies < 2) {
+    if (!_xdo_async_reply(xdo, async->client_sequences[async->nclient_replies],
+                          False,
+                          &async->client_replies[async->nclient_replies],
+                          __func__)) {
+      return False;
+    }
+    async->nclient_replies++;
+  }
+
+  for (i = 0; i < 2 && clients == NULL; i++) {
+    xcb_get_property_reply_t *reply = async->client_replies[i];
+    if (reply != NULL && reply->type == XA_WINDOW && reply->format == 32) {
+      clients = reply;
+    }
+  }
+
+  if (clients == NULL) {
+    search_async_root(xdo, async);
+  } else {
+    const uint32_t *ids = xcb_get_property_value(clients);
+
+    async->nchildren = clients->value_len;
+    if (async->nchildren > async->children_size) {
+      async->children_size = async->nchildren;
+      async->children = realloc(async->children,
+                                async->children_size * sizeof(Window));
+    }
+    for (i = 0; i < async->nchildren; i++) {
+      async->children[i] = ids[i];
+    }
+    async->checking_root = False;
+    async->checking_clients = True;
+    search_async_windows(xdo, async);
+  }
+
+  for (i = 0; i < 2; i++) {
+    free(async->client_replies[i]);
+    async->client_replies[i] = NULL;
+  }
+  return True;
+} /* int search_async_clients */
+
+static int search_async_check(const xdo_t *xdo, search_async_t *async) {
+  /* Check 'children' now that their data is in, then ask for the next
+   * level. Returns True if the search is complete. */
+  const xdo_search_t *search = &async->search;
+  int descend = (search->max_depth == -1 || async->depth + 1 < search->max_depth);
+  Window *swap;
+  unsigned int j, swap_size;
+  int stopped;
+
+  stopped = search_check_children(xdo, &async->state, async->infos,
+                                  async->nchildren,
+                                  descend && !async->checking_root
+                                  && !async->checking_clients,
+                                  &async->next, &async->nnext,
+                                  &async->next_size);
+  for (j = 0; j < async->nchildren; j++) {
+    window_info_free(&async->infos[j]);
+  }
+  async->nchildren = 0;
+  if (stopped) {
+    return True;
+  }
+
+  if (async->checking_clients) {
+    async->screen++;
+    async->phase = ASYNC_SCREEN;
+    return False;
+  }
+
+  if (async->checking_root) {
+    /* The root window is covered, so the walk starts with its children */
+    async->checking_root = False;
+    async->level[0] = RootWindow(xdo->xdpy, async->screen);
+    async->nlevel = 1;
+    async->depth = 0;
+  } else {
+    swap = async->level;
+    async->level = async->next;
+    async->next = swap;
+    async->nlevel = async->nnext;
+    swap_size = async->level_size;
+    async->level_size = async->next_size;
+    async->next_size = swap_size;
+    async->depth++;
+  }
+  async->nnext = 0;
+
+  /* Stop once the children would be too deep */
+  if (async->nlevel == 0
+      || (search->max_depth != -1 && async->depth >= search->max_depth)) {
+    async->screen++;
+    async->phase = ASYNC_SCREEN;
+    return False;
+  }
+
+  _xdo_children_send(xdo, async->level, async->nlevel, &async->fetch);
+  async->phase = ASYNC_CHILDREN;
+  return False;
+} /* int search_async_check */
+
+static int search_async_poll(xdo_t *xdo, xdo_async_t *handle) {
+  /* Go through the steps until a reply is missing or the search is done */
+  search_async_t *async = handle->data;
+  int done = False;
+  int progress = True;
+
+  _xdo_errors_begin(xdo, True);
+  while (!done && progress) {
+    switch (async->phase) {
+      case ASYNC_SCREEN:
+        done = search_async_screen(xdo, async);
+        break;
+      case ASYNC_CLIENTS:
+        progress = search_async_clients(xdo, async);
+        break;
+      case ASYNC_CHILDREN:
+        progress = _xdo_children_take(xdo, &async->fetch, False,
+                                      &async->children,
+                                      &async->children_size,
+                                      &async->nchildren);
+        if (progress) {
+          search_async_windows(xdo, async);
+        }
+        break;
+      case ASYNC_WINDOWS:
+        progress = _xdo_prefetch_take(xdo, &async->prefetch, False);
+        if (progress) {
+          done = search_async_check(xdo, async);
+        }
+        break;
+    }
+  }
+  _xdo_errors_end(xdo);
+
+  if (done) {
+    handle->result.status = XDO_SUCCESS;
+    handle->result.windows = async->list.windows;
+    handle->result.nwindows = async->list.nwindows;
+  }
+  return done;
+} /* int search_async_poll */
+
+static void search_async_free(xdo_async_t *handle) {
+  search_async_t *async = handle->data;
+  unsigned int i;
+
+  /* Freed mid-search by xdo_free; replies still on their way are dropped
+   * with the connection */
+  if (async->phase == ASYNC_WINDOWS && async->prefetch.wanted != NULL) {
+    for (i = 0; i < async->nchildren; i++) {
+      window_info_free(&async->infos[i]);
+    }
+    free(async->prefetch.wanted);
+    free(async->prefetch.sequences);
+  }
+  free(async->fetch.cookies);
+  for (i = 0; i < 2; i++) {
+    free(async->client_replies[i]);
+  }
+
+  query_free(&async->state.queries[0]);
+  free(async->state.queries);
+  free(async->state.nmatches);
+  free(async->list.windows);
+  free(async->level);
+  free(async->next);
+  free(async->children);
+  free(async->infos);
+  free(async);
+} /* void search_async_free */
+
+xdo_async_t *xdo_async_search_windows(xdo_t *xdo, const xdo_search_t *search,
+                                      xdo_async_cb_t callback,
+                                      void *userdata) {
+  XDO_CALL(xdo);
+  search_async_t *async = calloc(1, sizeof(search_async_t));
+  xdo_async_t *handle;
+
+  async->search = *search;
+  async->state.queries = calloc(1, sizeof(search_query_t));
+  if (!query_init(xdo, &async->state.queries[0], &async->search)) {
+    free(async->state.queries);
+    free(async);
+    return NULL;
+  }
+  async->state.search = &async->search;
+  async->state.nqueries = 1;
+  async->state.nmatches = calloc(1, sizeof(unsigned int));
+  async->state.callback = _xdo_search_single;
+  async->state.userdata = &async->single;
+
+  /* Matches are collected, and handed over all at once on completion */
+  async->list.size = 100;
+  async->list.windows = calloc(async->list.size, sizeof(Window));
+  async->single.callback = _xdo_search_list_add;
+  async->single.userdata = &async->list;
+
+  async->level_size = async->next_size = 64;
+  async->level = malloc(async->level_size * sizeof(Window));
+  async->next = malloc(async->next_size * sizeof(Window));
+  async->phase = ASYNC_SCREEN;
+
+  /* Send the first requests right away */
+  handle = _xdo_async_submit(xdo, search_async_poll, search_async_free,
+                             async, callback, userdata);
+  handle->done = search_async_poll(xdo, handle);
+  xcb_flush(XGetXCBConnection(xdo->xdpy));
+  return handle;
+} /* xdo_async_t *xdo_async_search_windows */
@@ -0,0 +1,62 @@
+/* xdo call accounting for XDO_STATS and XDO_TRACE
+ *
+ * Included by xdo.c and xdo_search.c. Each public xdo_* function that talks
+ * to the X server starts with XDO_CALL(xdo). When it returns, the requests
+ * it sent, the round trips it made, the bytes that went over the connection
+ * and its wall time are added up under its name. A public function called
+ * by another one is part of its caller's cost and is not counted on its own.
+ *
+ * Round trips through Xlib are noticed by an Xlib after-function, which runs
+ * after every request: if the server has answered everything sent since the
+ * last check, the client must have waited for it. Replies waited for through
+ * XCB directly are counted with _xdo_stats_waited.
+ */
+
+#ifndef _XDO_STATS_H_
+#define _XDO_STATS_H_
+
+#include <stdint.h>
+#include "xdo.h"
+
+struct timespec;
+
+/* A public call in progress, see XDO_CALL */
+struct xdo_call {
+  struct xdo_stats_log *log; /* NULL if the connection is not counting */
+  const char *name;          /* the __func__ of the public function */
+  int outer;                 /* not called from another public function */
+  unsigned long request;     /* NextRequest when the call started */
+  unsigned long round_trips;
+  uint64_t sent;
+  uint64_t received;
+  double start;              /* microseconds, CLOCK_MONOTONIC */
+};
+
+/* An empty record for a connection, as every xdo_t with XDO_STATS has */
+struct xdo_stats_log *_xdo_stats_log_new(Display *xdpy);
+void _xdo_stats_log_free(struct xdo_stats_log *log);
+
+/* Start and finish counting public function 'name' on 'xdo' */
+struct xdo_call _xdo_call_begin(const xdo_t *xdo, const char *name);
+void _xdo_call_end(struct xdo_call *call);
+
+/* 'call' waited through XCB for the server to answer 'request' since
+ * 'since' (CLOCK_MONOTONIC) */
+void _xdo_stats_waited(const xdo_t *xdo, const char *request,
+                       const char *call, const struct timespec *since);
+
+/* usleep, traced as a sleep in 'call' */
+int _xdo_usleep(const char *call, unsigned long usec);
+
+/* Count the rest of the enclosing public function against its name, up to
+ * whichever return it leaves by. This needs the cleanup attribute of GCC
+ * and Clang; built with other compilers, libxdo only counts totals. */
+#if defined(__GNUC__)
+#define XDO_CALL(xdo) \
+  struct xdo_call _xdo_call __attribute__((cleanup(_xdo_call_end))) = \
+    _xdo_call_begin((xdo), __func__)
+#else
+#define XDO_CALL(xdo) (void)(xdo)
+#endif
+
+#endif /* ifndef _XDO_STATS_H_ */
@@ -15,6 +15,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +25,11 @@
 #include <errno.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <time.h> /* for clock_gettime */
+
+#if defined(MISSING_CLOCK_GETTIME)
+#  include "patch_clock_gettime.h"
+#endif
 
 #include "xdo.h"
 #include "xdotool.h"
@@ -31,6 +37,10 @@
 
 static int script_main(int argc, char **argv);
 static int args_main(int argc, char **argv);
+static int displays_main(context_t *context, const char *displays);
+static int stats_wanted(void);
+static int threads_wanted(int argc, char **argv);
+static void stats_print(context_t *context);
 
 void consume_args(context_t *context, int argc) {
   if (argc > context->argc) {
@@ -113,6 +123,56 @@ int window_get_arg(context_t *context, int min_arg, int window_arg_pos,
   return True;
 } /* int window_get_arg(context_t *, int, int, char **, int *) */
 
+/* Close the batch opened with xdo_batch_begin and report any window whose
+ * queued requests failed. Returns XDO_ERROR if any did.
+ *
+ * Window commands open a batch unless given --sync: without it there is
+ * nothing to wait for between windows, so the requests for all of them are
+ * queued and flushed once here. */
+int window_batch_end(context_t *context, const char *cmd) {
+  xdo_batch_error_t *errors = NULL;
+  unsigned int nerrors = 0;
+  unsigned int i;
+  char buf[256];
+
+  if (xdo_batch_end(context->xdo, &errors, &nerrors) == XDO_SUCCESS) {
+    return XDO_SUCCESS;
+  }
+
+  for (i = 0; i < nerrors; i++) {
+    XGetErrorText(context->xdo->xdpy, errors[i].error_code, buf, sizeof(buf));
+    fprintf(stderr, "%s: request for window %ld failed: %s\n",
+            cmd, errors[i].window, buf);
+  }
+  free(errors);
+  return XDO_ERROR;
+} /* int window_batch_end(context_t *, const char *) */
+
+/* Read the geometry of every window and, if root_w_ret and root_h_ret are
+ * given, the size of every screen for percentages. This takes a fixed
+ * number of round trips rather than a few round trips per window, so window
+ * commands can work out all their requests before sending any. Free the
+ * arrays returned when done. */
+void window_list_geometry(context_t *context, const Window *windows,
+                          int nwindows, xdo_window_geometry_t **geometry_ret,
+                          unsigned int **root_w_ret,
+                          unsigned int **root_h_ret) {
+  int screen, nscreens = ScreenCount(context->xdo->xdpy);
+
+  *geometry_ret = calloc(nwindows + 1, sizeof(xdo_window_geometry_t));
+  xdo_get_windows_geometry(context->xdo, windows, nwindows, *geometry_ret);
+
+  if (root_w_ret == NULL || root_h_ret == NULL) {
+    return;
+  }
+  *root_w_ret = calloc(nscreens, sizeof(unsigned int));
+  *root_h_ret = calloc(nscreens, sizeof(unsigned int));
+  for (screen = 0; screen < nscreens; screen++) {
+    xdo_get_window_size(context->xdo, RootWindow(context->xdo->xdpy, screen),
+                        &(*root_w_ret)[screen], &(*root_h_ret)[screen]);
+  }
+} /* void window_list_geometry(context_t *, ...) */
+
 void window_list(context_t *context, const char *window_arg,
                  Window **windowlist_ret, int *nwindows_ret,
                  const int add_to_list) {
@@ -258,10 +318,25 @@ struct dispatch {
 
   { "exec", cmd_exec, },
   { "sleep", cmd_sleep, },
+  { "latencyprobe", cmd_latencyprobe, },
+  { "record", cmd_record, },
+  { "replay", cmd_replay, },
 
   { NULL, NULL, },
 };
 
+/* What each command cost with XDO_STATS, indexed like dispatch[] */
+typedef struct command_stats {
+  unsigned long runs;
+  double time;
+  unsigned long requests;
+  unsigned long round_trips;
+  unsigned long long bytes_sent;
+  unsigned long long bytes_received;
+} command_stats_t;
+
+static command_stats_t command_stats[sizeof(dispatch) / sizeof(dispatch[0])];
+
 int is_command(char* cmd) {
   int i;
   for (i = 0; dispatch[i].name != NULL; i++) {
@@ -276,8 +351,25 @@ int main(int argc, char **argv) {
   return xdotool_main(argc, argv);
 }
 
+static int threads_wanted(int argc, char **argv) {
+  int i;
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--parallel") || !strcmp(argv[i], "-parallel")) {
+      return True;
+    }
+  }
+  return False;
+} /* int threads_wanted(int, char **) */
+
 int xdotool_main(int argc, char **argv) {
 
+  /* search --parallel walks each screen on a thread of its own, which Xlib
+   * only allows if told before anything else uses it. Commands read from a
+   * script aren't known yet, so those searches walk the screens serially. */
+  if (threads_wanted(argc, argv)) {
+    xdo_init_threads();
+  }
+
   /* If argv[1] is a file or "-", read commands from file or stdin,
    * else use commands from argv.
    */
@@ -346,6 +438,10 @@ int script_main(int argc, char **argv) {
   context.nwindows = 0;
   context.have_last_mouse = False;
   context.debug = (getenv("DEBUG") != NULL);
+  context.output = OUTPUT_TEXT;
+  context.output_fields = 0;
+  context.display = NULL;
+  context.stats = stats_wanted();
 
   if (context.xdo == NULL) {
     fprintf(stderr, "Failed creating new xdo instance\n");
@@ -524,7 +620,7 @@ int script_main(int argc, char **argv) {
   }
   fclose(input);
 
-
+  stats_print(&context);
   xdo_free(context.xdo);
   free(context.windows);
 
@@ -539,11 +635,18 @@ int args_main(int argc, char **argv) {
   int ret = 0;
   int opt;
   int option_index;
+  int output = OUTPUT_TEXT;
+  const char *display = NULL;
+  static char output_buffer[65536];
 
-  const char *usage = "Usage: %s <cmd> <args>\n";
+  const char *usage =
+    "Usage: %s [--display=DISPLAY[,DISPLAY...]] [--output=json|tsv|nul] "
+    "<cmd> <args>\n";
   static struct option long_options[] = {
     { "help", no_argument, NULL, 'h' },
     { "version", no_argument, NULL, 'v' },
+    { "output", required_argument, NULL, 'o' },
+    { "display", required_argument, NULL, 'd' },
     { 0, 0, 0, 0 }
   };
 
@@ -569,23 +672,49 @@ int args_main(int argc, char **argv) {
       case 'v':
         cmd_version(NULL);
         exit(EXIT_SUCCESS);
+      case 'o':
+        output = xdotool_output_parse(optarg);
+        if (output < 0) {
+          fprintf(stderr, "Invalid output mode '%s'\n", optarg);
+          fprintf(stderr, usage, argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'd':
+        display = optarg;
+        break;
       default:
         fprintf(stderr, usage, argv[0]);
         exit(EXIT_FAILURE);
     }
   }
   
+  /* Machine-readable output is written in large blocks and only flushed
+   * once the command chain is done. */
+  if (output != OUTPUT_TEXT) {
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+  }
+
   context_t context;
-  context.xdo = xdo_new(NULL);
+  context.xdo = NULL;
   context.prog = *argv;
-  argv++; argc--;
+  argv += optind; argc -= optind;
   context.argc = argc;
   context.argv = argv;
   context.windows = NULL;
   context.nwindows = 0;
   context.have_last_mouse = False;
   context.debug = (getenv("DEBUG") != NULL);
+  context.output = output;
+  context.output_fields = 0;
+  context.display = NULL;
+  context.stats = stats_wanted();
+
+  if (display != NULL && strchr(display, ',') != NULL) {
+    return displays_main(&context, display);
+  }
 
+  context.xdo = xdo_new(display);
   if (context.xdo == NULL) {
     fprintf(stderr, "Failed creating new xdo instance.\n");
     return 1;
@@ -594,17 +723,189 @@ int args_main(int argc, char **argv) {
 
   ret = context_execute(&context);
 
+  stats_print(&context);
   xdo_free(context.xdo);
   free(context.windows);
 
   return ret;
 } /* int args_main(int, char **) */
 
+/* Run the command chain on every display in a comma-separated list at once,
+ * in a child process per display. Forking is far cheaper than starting
+ * xdotool again, and each child gets its own connection and window stack, so
+ * a slow display holds up only its own chain. */
+static int displays_main(context_t *context, const char *displays) {
+  char *names = strdup(displays);
+  char *name, *saveptr;
+  FILE **outputs;
+  unsigned int i, ndisplays = 0, size = 1;
+  char buffer[4096];
+  size_t len;
+  pid_t pid;
+  int status;
+  int ret = EXIT_SUCCESS;
+  /* Opens the XDO_TRACE file, if any, for the children to share */
+  double start = xdo_trace_now();
+
+  for (name = names; *name != '\0'; name++) {
+    size += (*name == ',');
+  }
+  outputs = calloc(size, sizeof(FILE *));
+
+  /* Don't let buffered output be written once per child */
+  fflush(stdout);
+
+  for (name = strtok_r(names, ",", &saveptr); name != NULL;
+       name = strtok_r(NULL, ",", &saveptr)) {
+    /* Records are collected per display and written out in the order the
+     * displays were given; text output goes straight through, a line at a
+     * time. */
+    if (context->output != OUTPUT_TEXT) {
+      outputs[ndisplays] = tmpfile();
+      if (outputs[ndisplays] == NULL) {
+        fprintf(stderr, "Failed creating output file for display %s: %s\n",
+                name, strerror(errno));
+        ret = EXIT_FAILURE;
+        break;
+      }
+    }
+    pid = fork();
+    if (pid == -1) {
+      fprintf(stderr, "fork failed: %s\n", strerror(errno));
+      ret = EXIT_FAILURE;
+      break;
+    }
+    if (pid != 0) {
+      ndisplays++;
+      continue;
+    }
+
+    if (outputs[ndisplays] != NULL) {
+      dup2(fileno(outputs[ndisplays]), STDOUT_FILENO);
+    }
+    /* 'exec' commands started from this chain use the same display */
+    setenv("DISPLAY", name, True);
+    context->display = name;
+    context->xdo = xdo_new(name);
+    if (context->xdo == NULL) {
+      fprintf(stderr, "Failed creating new xdo instance for display %s.\n",
+              name);
+      exit(EXIT_FAILURE);
+    }
+    context->xdo->debug = context->debug;
+    ret = context_execute(context);
+    stats_print(context);
+    xdo_free(context->xdo);
+    exit(ret);
+  }
+
+  while (wait(&status) != -1) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  for (i = 0; i < size; i++) {
+    if (outputs[i] == NULL) {
+      continue;
+    }
+    rewind(outputs[i]);
+    while ((len = fread(buffer, 1, sizeof(buffer), outputs[i])) > 0) {
+      fwrite(buffer, 1, len, stdout);
+    }
+    fclose(outputs[i]);
+  }
+  fflush(stdout);
+
+  xdo_trace_span("command", "--display", start, displays);
+  free(outputs);
+  free(names);
+  return ret;
+} /* int displays_main */
+
+static int stats_wanted(void) {
+  const char *value = getenv("XDO_STATS");
+  return value != NULL && *value != '\0' && strcmp(value, "0");
+}
+
+static double stats_seconds(const struct timespec *start,
+                            const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec)
+         + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Run dispatch[cmd] and add what it cost to command_stats[cmd]. A command
+ * running a chain of its own, like 'behave', includes that chain's cost. */
+static int stats_run(context_t *context, int cmd) {
+  command_stats_t *stats = &command_stats[cmd];
+  xdo_stats_t before, after;
+  struct timespec start, end;
+  int ret;
+
+  xdo_get_stats(context->xdo, &before);
+  free(before.calls);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ret = dispatch[cmd].func(context);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  xdo_get_stats(context->xdo, &after);
+  free(after.calls);
+
+  stats->runs++;
+  stats->time += stats_seconds(&start, &end);
+  stats->requests += after.requests - before.requests;
+  stats->round_trips += after.round_trips - before.round_trips;
+  stats->bytes_sent += after.bytes_sent - before.bytes_sent;
+  stats->bytes_received += after.bytes_received - before.bytes_received;
+  return ret;
+} /* int stats_run(context_t *, int) */
+
+/* With XDO_STATS, write what the command chain cost to stderr */
+static void stats_print(context_t *context) {
+  xdo_stats_t stats;
+  unsigned int i;
+
+  if (!context->stats || context->xdo == NULL) {
+    return;
+  }
+
+  xdo_get_stats(context->xdo, &stats);
+  if (context->display != NULL) {
+    fprintf(stderr, "xdotool stats for display %s:\n", context->display);
+  } else {
+    fprintf(stderr, "xdotool stats:\n");
+  }
+  fprintf(stderr, "%-35s %6s %10s %9s %11s %10s %10s\n", "command", "runs",
+          "time(ms)", "requests", "round trips", "sent", "received");
+  for (i = 0; dispatch[i].name != NULL; i++) {
+    command_stats_t *cmd = &command_stats[i];
+    if (cmd->runs == 0) {
+      continue;
+    }
+    fprintf(stderr, "%-35s %6lu %10.3f %9lu %11lu %10llu %10llu\n",
+            dispatch[i].name, cmd->runs, cmd->time * 1000, cmd->requests,
+            cmd->round_trips, cmd->bytes_sent, cmd->bytes_received);
+  }
+
+  fprintf(stderr, "%-35s %6s %10s %9s %11s %10s %10s\n", "libxdo call",
+          "calls", "time(ms)", "requests", "round trips", "sent", "received");
+  for (i = 0; i < stats.ncalls; i++) {
+    xdo_stat_t *call = &stats.calls[i];
+    fprintf(stderr, "%-35s %6lu %10.3f %9lu %11lu %10llu %10llu\n",
+            call->call, call->count, call->time * 1000, call->requests,
+            call->round_trips, call->bytes_sent, call->bytes_received);
+  }
+  fprintf(stderr, "%-35s %6s %10s %9lu %11lu %10llu %10llu\n", "total", "",
+          "", stats.requests, stats.round_trips, stats.bytes_sent,
+          stats.bytes_received);
+  free(stats.calls);
+} /* void stats_print(context_t *) */
+
 int context_execute(context_t *context) {
   int cmd_found = 0;
   int i = 0;
   char *cmd = NULL;
   int ret = XDO_SUCCESS;
+  double start;
 
   /* Loop until all argv is consumed. */
   while (context->argc > 0 && ret == XDO_SUCCESS) {
@@ -617,7 +918,13 @@ int context_execute(context_t *context) {
         if (context->debug) {
           fprintf(stderr, "command: %s\n", cmd);
         }
-        ret = dispatch[i].func(context);
+        start = xdo_trace_now();
+        if (context->stats) {
+          ret = stats_run(context, i);
+        } else {
+          ret = dispatch[i].func(context);
+        }
+        xdo_trace_span("command", dispatch[i].name, start, context->display);
       }
     }
 
@@ -627,6 +934,7 @@ int context_execute(context_t *context) {
       ret = 1;
     }
   } /* while ... */
+  fflush(stdout);
   return ret;
 } /* int args_main(int, char **) */
 
@@ -654,6 +962,13 @@ int cmd_version(context_t *context) {
   return 0;
 }
 
+void xdotool_usleep(unsigned long usec) {
+  double start = xdo_trace_now();
+
+  usleep(usec);
+  xdo_trace_span("sleep", "usleep", start, NULL);
+}
+
 void xdotool_debug(context_t *context, const char *format, ...) {
   va_list args;
 
@@ -666,12 +981,145 @@ void xdotool_debug(context_t *context, const char *format, ...) {
 } /* xdotool_debug */
 
 void xdotool_output(context_t *context, const char *format, ...) {
-  context = context; /* Do something with context to avoid warnings */
   va_list args;
 
   va_start(args, format);
   vfprintf(stdout, format, args);
-  fprintf(stdout, "\n");
-  fflush(stdout);
+  fputc('\n', stdout);
+  /* Machine-readable output is flushed at the end of the chain instead. */
+  if (context == NULL || context->output == OUTPUT_TEXT) {
+    fflush(stdout);
+  }
   va_end(args);
 } /* xdotool_output */
+
+int xdotool_output_parse(const char *name) {
+  if (!strcmp(name, "text")) {
+    return OUTPUT_TEXT;
+  } else if (!strcmp(name, "tsv")) {
+    return OUTPUT_TSV;
+  } else if (!strcmp(name, "json")) {
+    return OUTPUT_JSON;
+  } else if (!strcmp(name, "nul")) {
+    return OUTPUT_NUL;
+  }
+  return -1;
+} /* xdotool_output_parse */
+
+/* Records are written to stdout without flushing:
+ *   tsv  - fields separated by tabs, one record per line. Tabs, newlines,
+ *          carriage returns and backslashes in strings are escaped as \t,
+ *          \n, \r and \\.
+ *   json - one object per line. Bytes that are not valid UTF-8 in strings
+ *          are written as U+FFFD.
+ *   nul  - fields separated by tabs, each record terminated by a NUL byte.
+ *          Strings are written verbatim.
+ */
+void xdotool_record_begin(context_t *context) {
+  context->output_fields = 0;
+  if (context->output == OUTPUT_JSON) {
+    fputc('{', stdout);
+  }
+  if (context->display != NULL) {
+    xdotool_record_string(context, "display", context->display,
+                          strlen(context->display));
+  }
+} /* xdotool_record_begin */
+
+static void _record_field(context_t *context, const char *key) {
+  if (context->output == OUTPUT_JSON) {
+    printf("%s\"%s\":", context->output_fields > 0 ? "," : "", key);
+  } else if (context->output_fields > 0) {
+    fputc('\t', stdout);
+  }
+  context->output_fields++;
+} /* _record_field */
+
+void xdotool_record_int(context_t *context, const char *key, long value) {
+  _record_field(context, key);
+  printf("%ld", value);
+} /* xdotool_record_int */
+
+/* The length of the UTF-8 sequence starting at 's', or 0 if it is not a
+ * valid one */
+static int _record_utf8_length(const unsigned char *s, int len) {
+  int n, i;
+
+  if (s[0] < 0x80) {
+    return 1;
+  } else if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+    n = 2;
+  } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+    n = 3;
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    n = 4;
+  } else {
+    return 0;
+  }
+  if (n > len) {
+    return 0;
+  }
+  for (i = 1; i < n; i++) {
+    if ((s[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+  }
+  /* Overlong forms, surrogates and code points past U+10FFFF */
+  if ((s[0] == 0xe0 && s[1] < 0xa0) || (s[0] == 0xed && s[1] > 0x9f)
+      || (s[0] == 0xf0 && s[1] < 0x90) || (s[0] == 0xf4 && s[1] > 0x8f)) {
+    return 0;
+  }
+  return n;
+} /* _record_utf8_length */
+
+void xdotool_record_string(context_t *context, const char *key,
+                           const char *value, int len) {
+  int i, n;
+
+  _record_field(context, key);
+  if (context->output == OUTPUT_JSON) {
+    fputc('"', stdout);
+  }
+  for (i = 0; i < len; i++) {
+    unsigned char c = value[i];
+    if (context->output == OUTPUT_JSON) {
+      if (c == '"' || c == '\\') {
+        fputc('\\', stdout);
+        fputc(c, stdout);
+      } else if (c < 0x20) {
+        printf("\\u%04x", c);
+      } else if (c < 0x80) {
+        fputc(c, stdout);
+      } else if ((n = _record_utf8_length((const unsigned char *)value + i,
+                                          len - i)) == 0) {
+        fputs("\\ufffd", stdout);
+      } else {
+        fwrite(value + i, 1, n, stdout);
+        i += n - 1;
+      }
+    } else if (context->output == OUTPUT_TSV) {
+      switch (c) {
+        case '\t': fputs("\\t", stdout); break;
+        case '\n': fputs("\\n", stdout); break;
+        case '\r': fputs("\\r", stdout); break;
+        case '\\': fputs("\\\\", stdout); break;
+        default: fputc(c, stdout);
+      }
+    } else {
+      fputc(c, stdout);
+    }
+  }
+  if (context->output == OUTPUT_JSON) {
+    fputc('"', stdout);
+  }
+} /* xdotool_record_string */
+
+void xdotool_record_end(context_t *context) {
+  if (context->output == OUTPUT_JSON) {
+    fputs("}\n", stdout);
+  } else if (context->output == OUTPUT_NUL) {
+    fputc('\0', stdout);
+  } else {
+    fputc('\n', stdout);
+  }
+} /* xdotool_record_end */
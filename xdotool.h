@@ -23,6 +23,10 @@ extern "C" {
 } /* end define window_each */
 
   
+/* Output modes for --output, see xdotool_record_begin() */
+enum {
+  OUTPUT_TEXT, OUTPUT_TSV, OUTPUT_JSON, OUTPUT_NUL
+};
 
 typedef struct context {
   xdo_t *xdo;
@@ -41,6 +45,17 @@ typedef struct context {
   int last_mouse_y;
   int last_mouse_screen;
   int have_last_mouse;
+
+  /* Output mode (OUTPUT_*) and fields written to the current record */
+  int output;
+  int output_fields;
+
+  /* With --display listing several displays, the one this chain runs on.
+   * Records are tagged with it. */
+  const char *display;
+
+  /* XDO_STATS is set: count what each command costs and print it at exit */
+  int stats;
 } context_t;
 
 int xdotool_main(int argc, char **argv);
@@ -58,6 +73,9 @@ int cmd_getwindowpid(context_t *context);
 int cmd_getwindowgeometry(context_t *context);
 int cmd_help(context_t *context);
 int cmd_key(context_t *context);
+int cmd_latencyprobe(context_t *context);
+int cmd_record(context_t *context);
+int cmd_replay(context_t *context);
 int cmd_mousedown(context_t *context);
 int cmd_mousemove(context_t *context);
 int cmd_mousemove_relative(context_t *context);